@@ -0,0 +1,152 @@
+
+#include "json.h"
+#include "interpreter.h"
+#include "vector.h"
+#include "rng.h"
+#include <iostream>
+#include <iomanip>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <new>
+#include <cstdlib>
+
+
+using namespace std;
+
+
+// This program counts heap allocations, showing the effect of inline
+// storage of small vectors and of the arena of temporary vectors (see
+// vector.h). It reports the calls to malloc (wrapped at link time, see
+// the Makefile) and to operator new per operation, outside of and within
+// an ArenaScope, first for elementary vector operations, then per call
+// of evaluate for all functions defined in a problems.json file, with
+// the bytecode and the tree interpreter, in several dimensions. Within
+// a scope, steady-state evaluation of every function is expected to be
+// free of calls to malloc.
+//
+// usage: allocbench problems.json
+
+
+size_t g_malloc = 0;
+size_t g_new = 0;
+
+extern "C" void* __real_malloc(size_t size);
+extern "C" void* __wrap_malloc(size_t size)
+{
+	g_malloc++;
+	return __real_malloc(size);
+}
+
+void* operator new(size_t size)
+{
+	g_new++;
+	void* p = __real_malloc(size);
+	if (! p) throw bad_alloc();
+	return p;
+}
+void operator delete(void* p) noexcept
+{ free(p); }
+void operator delete(void* p, size_t) noexcept
+{ free(p); }
+
+// allocations per call of f, averaged over the given number of calls,
+// after a few calls for warming up
+struct Count
+{
+	double mallocs;
+	double news;
+};
+template <typename F>
+Count count(F f, unsigned int calls = 100)
+{
+	for (unsigned int k=0; k<3; k++) f();
+	size_t m = g_malloc, n = g_new;
+	for (unsigned int k=0; k<calls; k++) f();
+	Count ret;
+	ret.mallocs = (double)(g_malloc - m) / calls;
+	ret.news = (double)(g_new - n) / calls;
+	return ret;
+}
+template <typename F>
+Count countScoped(F f)
+{
+	return count([&]() { ArenaScope scope; f(); });
+}
+
+int main(int argc, char** argv)
+{
+	if (argc != 2) { cerr << "usage: " << argv[0] << " problems.json" << endl; return 1; }
+
+	Json dict;
+	if (! dict.load(argv[1])) { cerr << "failed to load " << argv[1] << endl; return 1; }
+
+	RNG rng(1);
+	volatile double sink = 0.0;            // keeps results alive
+
+	// elementary operations
+	cout << setw(28) << left << "operation" << right << setw(6) << "d" << setw(12) << "malloc" << setw(12) << "scoped" << endl;
+	const size_t sizes[] = { 1, 3, 8, 9, 100 };
+	for (size_t k=0; k<sizeof(sizes)/sizeof(sizes[0]); k++)
+	{
+		size_t d = sizes[k];
+		Vector a(d), b(d);
+		for (size_t i=0; i<d; i++) { a[i] = rng.gauss(); b[i] = rng.gauss(); }
+		const char* names[] = { "construction", "a + b", "(a + b) * 2 - a", "sub(0, d, false)", "copy and move" };
+		for (size_t op=0; op<sizeof(names)/sizeof(names[0]); op++)
+		{
+			auto f = [&]()
+			{
+				if (op == 0) { Vector v(d, 1.0); sink += v[0]; }
+				else if (op == 1) { Vector v = a + b; sink += v[0]; }
+				else if (op == 2) { Vector v = (a + b) * 2.0 - a; sink += v[0]; }
+				else if (op == 3) { Vector v = a.sub(0, d, false); sink += v[0]; }
+				else { Vector v = a.copy(); Vector w(std::move(v)); sink += w[0]; }
+			};
+			Count plain = count(f), scoped = countScoped(f);
+			cout << setw(28) << left << names[op] << right << setw(6) << d << fixed << setprecision(1) << setw(12) << plain.mallocs << setw(12) << scoped.mallocs << endl;
+		}
+	}
+	cout << endl;
+
+	// evaluation of all functions
+	vector<ExpressionPtr> functions;
+	for (Json::object_iterator it = dict.object_begin(); it != dict.object_end(); ++it) functions.push_back(parse(it->second.asString()));
+	const size_t dimensions[] = { 2, 8, 40, 100 };
+	size_t allocating = 0;
+	cout << setw(10) << left << "mode" << right << setw(6) << "d" << setw(12) << "functions"
+		<< setw(12) << "malloc" << setw(12) << "scoped" << setw(12) << "max scoped" << setw(12) << "new" << "   (per evaluation)" << endl;
+	for (int mode=0; mode<2; mode++)
+	{
+		setInterpreterMode(mode == 0 ? BytecodeInterpreter : TreeInterpreter);
+		for (size_t k=0; k<sizeof(dimensions)/sizeof(dimensions[0]); k++)
+		{
+			size_t d = dimensions[k];
+			Vector x(d);
+			for (size_t i=0; i<d; i++) x[i] = rng.uniform();
+			size_t n = 0;
+			double plain = 0.0, scoped = 0.0, worst = 0.0, news = 0.0;
+			for (size_t f=0; f<functions.size(); f++)
+			{
+				// functions not defined in this dimension are skipped, errors allocate
+				ExpressionPtr ex = specialize(functions[f], d);
+				try { sink += evaluate(ex, x); }
+				catch (exception const&) { continue; }
+
+				Count c = count([&]() { sink += evaluate(ex, x); });
+				Count s = countScoped([&]() { sink += evaluate(ex, x); });
+				n++;
+				plain += c.mallocs;
+				scoped += s.mallocs;
+				news += s.news;
+				if (s.mallocs > worst) worst = s.mallocs;
+				if (s.mallocs > 0.0) allocating++;
+			}
+			cout << setw(10) << left << (mode == 0 ? "bytecode" : "tree") << right << setw(6) << d << setw(12) << n
+				<< fixed << setprecision(2) << setw(12) << plain / n << setw(12) << scoped / n << setw(12) << worst << setw(12) << news / n << endl;
+		}
+	}
+
+	cout << allocating << " evaluations calling malloc within a scope" << endl;
+	return (allocating == 0) ? 0 : 1;
+}
@@ -0,0 +1,384 @@
+
+#include "batch.h"
+#include "kernels.h"
+#include "vecmath.h"
+
+#include <stdexcept>
+#include <algorithm>
+#include <limits>
+#include <cmath>
+#include <cassert>
+
+
+using namespace std;
+
+
+BatchRegisters::BatchRegisters(Program const& program)
+: lanes(0)
+, dimension(0)
+, v(program.vectors)
+, vn(program.vectors, 0)
+{ }
+
+namespace {
+
+// raised for blocks that must be evaluated point by point
+struct Fallback
+{ };
+
+// lanes per block: blocks of high-dimensional inputs are kept small
+size_t lanesFor(size_t dimension)
+{
+	size_t lanes = 8192 / std::max<size_t>(dimension, 1);
+	return std::max<size_t>(8, std::min<size_t>(64, lanes & ~(size_t)7));
+}
+
+// register allocation and constants for the given input dimension
+void setup(Program const& program, BatchRegisters& reg, size_t dimension)
+{
+	size_t K = lanesFor(dimension);
+	reg.lanes = K;
+	reg.dimension = dimension;
+	reg.s.assign(program.scalars * K, 0.0);
+	for (size_t i=0; i<program.scalarConstant.size(); i++)
+	{
+		double* d = &reg.s[program.scalarConstant[i].first * K];
+		std::fill(d, d + K, program.scalarConstant[i].second);
+	}
+	for (size_t i=0; i<program.vectorConstant.size(); i++)
+	{
+		int r = program.vectorConstant[i].first;
+		Vector const& c = program.vectorConstant[i].second;
+		reg.v[r].resize(c.size() * K);
+		reg.vn[r] = c.size();
+		for (size_t j=0; j<c.size(); j++) std::fill(reg.v[r].begin() + j * K, reg.v[r].begin() + (j + 1) * K, c[j]);
+	}
+	reg.scratch.resize(8 * K);
+}
+
+// execution of the instructions of a program on all lanes
+struct Lanes
+{
+	Lanes(Program const& program_, BatchRegisters& reg_)
+	: program(program_)
+	, reg(reg_)
+	, K(reg_.lanes)
+	{ }
+
+	double* s(int r)
+	{ return &reg.s[r * K]; }
+	double* row(int r, size_t i)
+	{ return &reg.v[r][i * K]; }
+	double* vector(int r, size_t n)
+	{
+		reg.v[r].resize(n * K);
+		reg.vn[r] = n;
+		return reg.v[r].data();
+	}
+
+	// integer parts of the lanes of a scalar register, equal for all lanes
+	int uniform(int r)
+	{
+		const double* a = s(r);
+		int ret = (int)floor(a[0]);
+		for (size_t k=1; k<K; k++) if ((int)floor(a[k]) != ret) throw Fallback();
+		return ret;
+	}
+
+	// reduction of the rows of vector register r into dst, with the
+	// association of the summation mode of kernels.h
+	void reduce(Opcode op, double* dst, int r, int r2 = -1)
+	{
+		size_t n = reg.vn[r];
+		bool product = (op == opSProd);
+		double init = product ? 1.0 : 0.0;
+		double* t = reg.scratch.data();
+		if (summationMode() == OrderedSummation)
+		{
+			std::fill(dst, dst + K, init);
+			for (size_t i=0; i<n; i++) accumulate(op, dst, i, r, r2, t);
+			return;
+		}
+		std::vector<double>& p = m_partial;
+		p.assign(8 * K, init);
+		for (size_t i=0; i<n; i++) accumulate(op, &p[(i % 8) * K], i, r, r2, t);
+		double* q = &p[0];
+		if (product)
+		{
+			// ((p0*p4) * (p2*p6)) * ((p1*p5) * (p3*p7))
+			for (size_t j=0; j<4; j++) kernelMul(q + j * K, q + j * K, q + (j + 4) * K, K);
+			kernelMul(q, q, q + 2 * K, K);
+			kernelMul(q + K, q + K, q + 3 * K, K);
+			kernelMul(dst, q, q + K, K);
+		}
+		else
+		{
+			for (size_t j=0; j<4; j++) kernelAdd(q + j * K, q + j * K, q + (j + 4) * K, K);
+			kernelAdd(q, q, q + 2 * K, K);
+			kernelAdd(q + K, q + K, q + 3 * K, K);
+			kernelAdd(dst, q, q + K, K);
+		}
+	}
+
+	// acc += term i of the reduction
+	void accumulate(Opcode op, double* acc, size_t i, int r, int r2, double* t)
+	{
+		const double* a = row(r, i);
+		switch (op)
+		{
+		case opSSum:
+			kernelAdd(acc, acc, a, K);
+			break;
+		case opSProd:
+			kernelMul(acc, acc, a, K);
+			break;
+		case opSDot:
+			kernelMul(t, a, row(r2, i), K);
+			kernelAdd(acc, acc, t, K);
+			break;
+		default:
+			kernelMul(t, a, a, K);
+			kernelAdd(acc, acc, t, K);
+			break;
+		}
+	}
+
+	void run(std::vector<Instruction> const& code)
+	{
+		for (size_t k=0; k<code.size(); k++) execute(code[k]);
+	}
+
+	void execute(Instruction const& in)
+	{
+		switch (in.op)
+		{
+		case opSNeg:
+			kernelNeg(s(in.dst), s(in.a), K);
+			break;
+		case opSAdd:
+			kernelAdd(s(in.dst), s(in.a), s(in.b), K);
+			break;
+		case opSSub:
+			kernelSub(s(in.dst), s(in.a), s(in.b), K);
+			break;
+		case opSMul:
+			kernelMul(s(in.dst), s(in.a), s(in.b), K);
+			break;
+		case opSDiv:
+			kernelDiv(s(in.dst), s(in.a), s(in.b), K);
+			break;
+		case opSPow:
+			kernelPow(s(in.dst), s(in.a), s(in.b), K);
+			break;
+		case opSFunc:
+			kernelFunction(in.f, s(in.dst), s(in.a), K);
+			break;
+		case opSDim:
+			std::fill(s(in.dst), s(in.dst) + K, (double)reg.vn[in.a]);
+			break;
+		case opSEntry:
+		{
+			double* d = s(in.dst);
+			const double* b = s(in.b);
+			int size = (int)reg.vn[in.a];
+			const double* v = reg.v[in.a].data();
+			for (size_t k=0; k<K; k++)
+			{
+				int i = (int)floor(b[k]);
+				if (i < 1 || i > size) throw Fallback();
+				d[k] = v[(i - 1) * K + k];
+			}
+			break;
+		}
+		case opSDot:
+		case opSSum:
+		case opSProd:
+		case opSSqrNorm:
+			reduce(in.op, s(in.dst), in.a, in.b);
+			break;
+		case opSNorm:
+		{
+			double* d = s(in.dst);
+			reduce(opSSqrNorm, d, in.a);
+			for (size_t k=0; k<K; k++) d[k] = std::sqrt(d[k]);
+			break;
+		}
+		case opSMin:
+		case opSMax:
+		{
+			double* d = s(in.dst);
+			size_t n = reg.vn[in.a];
+			if (n == 0) { std::fill(d, d + K, numeric_limits<double>::quiet_NaN()); break; }
+			std::copy(row(in.a, 0), row(in.a, 0) + K, d);
+			for (size_t i=1; i<n; i++)
+			{
+				const double* a = row(in.a, i);
+				if (in.op == opSMin) for (size_t k=0; k<K; k++) d[k] = std::min(d[k], a[k]);
+				else for (size_t k=0; k<K; k++) d[k] = std::max(d[k], a[k]);
+			}
+			break;
+		}
+		case opVNeg:
+		case opVAdd:
+		case opVSub:
+		case opVEMul:
+		case opVEDiv:
+		case opVEPowV:
+		{
+			// all components of all lanes at once
+			size_t n = reg.vn[in.a];
+			double* d = vector(in.dst, n);
+			const double* a = reg.v[in.a].data();
+			const double* b = (in.op == opVNeg) ? nullptr : reg.v[in.b].data();
+			size_t m = n * K;
+			switch (in.op)
+			{
+			case opVNeg:
+				kernelNeg(d, a, m);
+				break;
+			case opVAdd:
+				kernelAdd(d, a, b, m);
+				break;
+			case opVSub:
+				kernelSub(d, a, b, m);
+				break;
+			case opVEMul:
+				kernelMul(d, a, b, m);
+				break;
+			case opVEDiv:
+				kernelDiv(d, a, b, m);
+				break;
+			default:
+				kernelPow(d, a, b, m);
+				break;
+			}
+			break;
+		}
+		case opVScale:
+		case opVDiv:
+		case opVEPowS:
+		case opVScaleAdd:
+		case opVScaleSub:
+		{
+			// the scalar differs between lanes, hence row by row
+			size_t n = reg.vn[in.a];
+			vector(in.dst, n);
+			const double* b = s(in.b);
+			for (size_t i=0; i<n; i++)
+			{
+				double* d = row(in.dst, i);
+				const double* a = row(in.a, i);
+				switch (in.op)
+				{
+				case opVScale:
+					kernelMul(d, a, b, K);
+					break;
+				case opVDiv:
+					kernelDiv(d, a, b, K);
+					break;
+				case opVEPowS:
+					kernelPow(d, a, b, K);
+					break;
+				case opVScaleAdd:
+					kernelMul(d, a, b, K);
+					kernelAdd(d, d, row(in.c, i), K);
+					break;
+				default:
+					kernelMul(d, a, b, K);
+					kernelSub(d, d, row(in.c, i), K);
+					break;
+				}
+			}
+			break;
+		}
+		case opVCompose:
+		{
+			std::vector<Operand> const& parts = program.composition[in.a];
+			size_t n = 0;
+			for (size_t k=0; k<parts.size(); k++) n += parts[k].isVector ? reg.vn[parts[k].reg] : 1;
+			double* d = vector(in.dst, n);
+			for (size_t k=0; k<parts.size(); k++)
+			{
+				int r = parts[k].reg;
+				const double* a = parts[k].isVector ? reg.v[r].data() : s(r);
+				size_t m = (parts[k].isVector ? reg.vn[r] : 1) * K;
+				d = std::copy(a, a + m, d);
+			}
+			break;
+		}
+		case opVRange:
+		{
+			int f = uniform(in.b);
+			int l = uniform(in.c);
+			int size = l - f + 1;
+			if (f < 1 || l > (int)reg.vn[in.a] || size < 0) throw Fallback();
+			double* d = vector(in.dst, (size_t)size);
+			const double* a = row(in.a, f - 1);
+			std::copy(a, a + size * K, d);
+			break;
+		}
+		case opVFill:
+		case opVIota:
+		{
+			int size = uniform(in.a);
+			if (size < 0) throw Fallback();
+			double* d = vector(in.dst, (size_t)size);
+			for (int i=0; i<size; i++) std::fill(d + i * K, d + (i + 1) * K, (in.op == opVFill) ? in.imm : i + 1);
+			break;
+		}
+		case opVApply:
+		{
+			// the body once per component, on all lanes
+			Lambda const& l = program.lambda[in.b];
+			size_t n = reg.vn[in.a];
+			vector(in.dst, n);
+			for (size_t i=0; i<n; i++)
+			{
+				const double* a = row(in.a, i);
+				std::copy(a, a + K, s(l.argument));
+				run(program.block[l.block]);
+				std::copy(s(l.result), s(l.result) + K, row(in.dst, i));
+			}
+			break;
+		}
+		default:
+			assert(false);
+			break;
+		}
+	}
+
+	Program const& program;
+	BatchRegisters& reg;
+	size_t K;
+	std::vector<double> m_partial;
+};
+
+}
+
+void executeBatch(Program const& program, BatchRegisters& batch, Registers& registers, const double* points, size_t dimension, size_t count, double* values)
+{
+	if (batch.lanes == 0 || batch.dimension != dimension) setup(program, batch, dimension);
+	size_t K = batch.lanes;
+	Lanes lanes(program, batch);
+	for (size_t start=0; start<count; start+=K)
+	{
+		size_t n = std::min(K, count - start);
+		const double* p = points + start * dimension;
+		try
+		{
+			// transpose the block into the input register, unused lanes repeat the last point
+			double* x = lanes.vector(0, dimension);
+			for (size_t i=0; i<dimension; i++)
+			{
+				for (size_t k=0; k<K; k++) x[i * K + k] = p[std::min(k, n - 1) * dimension + i];
+			}
+			lanes.run(program.block[0]);
+			const double* r = lanes.s(program.result);
+			std::copy(r, r + n, values + start);
+		}
+		catch (...)
+		{
+			for (size_t k=0; k<n; k++) values[start + k] = execute(program, registers, Vector(dimension, p + k * dimension));
+		}
+	}
+}
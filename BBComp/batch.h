@@ -0,0 +1,63 @@
+
+#pragma once
+
+
+//
+// Batch Evaluation
+// ----------------
+//
+// Programs (see bytecode.h) can be evaluated on blocks of points at
+// once, in structure-of-arrays layout: every scalar register holds one
+// value per point ("lane"), and a vector register with d components
+// holds a d x lanes array, row-major, such that the values of a single
+// component are contiguous. Every instruction is dispatched once per
+// block and processes all lanes with the array kernels of kernels.h and
+// vecmath.h, hence vectorization applies across points, also for
+// functions of only two or three variables.
+//
+// Blocks pay off for inputs of low dimension. For inputs of more than
+// maxBatchDimension components, the point-wise interpreter vectorizes
+// within points and is at least as fast, hence evaluateBatch (see
+// interpreter.h) evaluates such points one by one.
+//
+// Each lane performs the operations of the point-wise interpreter,
+// including the order of the terms of reductions, hence results
+// coincide bit for bit with those of evaluate. Blocks for which this
+// scheme does not apply (vector sizes differing between points) or
+// which raise an error are re-evaluated point by point; errors are
+// thus raised exactly as by a sequence of evaluations.
+//
+
+
+#include <vector>
+#include <cstddef>
+
+#include "bytecode.h"
+
+
+const std::size_t maxBatchDimension = 64;
+
+
+// Register files for the evaluation of a program on blocks of points.
+struct BatchRegisters
+{
+	BatchRegisters()
+	: lanes(0)
+	, dimension(0)
+	{ }
+
+	explicit BatchRegisters(Program const& program);
+
+	std::size_t lanes;                           // number of points per block
+	std::size_t dimension;                       // input dimension the registers are set up for
+	std::vector<double> s;                       // scalar registers: lanes values each
+	std::vector< std::vector<double> > v;        // vector registers: components x lanes
+	std::vector<std::size_t> vn;                 // vector registers: number of components
+	std::vector<double> scratch;                 // partial results of reductions
+};
+
+
+// Evaluate a program on count points of the given dimension, stored
+// row-major, and write the values to values[0] to values[count-1]. The
+// registers are used for point-wise evaluation where necessary.
+void executeBatch(Program const& program, BatchRegisters& batch, Registers& registers, const double* points, std::size_t dimension, std::size_t count, double* values);
@@ -11,6 +11,7 @@
 #include "hypervolume.h"
 #include "interpreter.h"
 #include "problems.h"
+#include "threadpool.h"
 
 #include <cstdio>
 #include <cstdlib>
@@ -19,6 +20,7 @@
 #include <string>
 #include <algorithm>
 #include <memory>
+#include <chrono>
 
 
 using namespace std;
@@ -37,7 +39,8 @@ struct ProblemInstance
 	, m_budget(0)
 	, m_evaluations(0)
 	, m_bestvalue(1e100)
-	, m_problem(nullptr)
+	, m_frontChanged(false)
+	, m_pointCost(0.0)
 	{ }
 
 	unsigned int dimension() const
@@ -51,10 +54,13 @@ struct ProblemInstance
 		m_budget = 0;
 		m_evaluations = 0;
 		m_bestvalue = 1e100;
+		m_frontChanged = false;
 		m_nondominated.clear();
 		m_problemname = "";
+		m_pointCost = 0.0;
+		m_hypervolumeError = 0.0;
 
-		if (m_problem) { delete m_problem; m_problem = nullptr; }
+		m_problem.reset();
 	}
 
 	bool set(int id, Json definition, int evals)
@@ -68,7 +74,16 @@ struct ProblemInstance
 			m_bestvalue = 1e100;
 			m_problemname = definition["type"].asString();
 
-			m_problem = createProblem(definition);
+			// hypervolume computation for more than three objectives
+			string method = definition["hypervolume"]("exact");
+			if (method == "monte-carlo")
+			{
+				m_hypervolumeError = definition["hypervolume-error"](1e-3);
+				if (m_hypervolumeError < 1e-5) { clear(); return false; }
+			}
+			else if (method != "exact") { clear(); return false; }
+
+			m_problem = getProblem(definition);
 			unsigned int dim = m_problem->dimension();
 			unsigned int obj = m_problem->objectives();
 			m_nondominated.clear();
@@ -83,52 +98,96 @@ struct ProblemInstance
 		}
 	}
 
-	double evalSO(const double* point)
+	// evaluate n points stored row-major in #points,
+	// write n * objectives() values to #values,
+	// spread the work over the thread pool if given
+	void evalBatch(const double* points, size_t n, double* values, ThreadPool* pool = nullptr)
 	{
 		assert(m_problem);
-		assert(m_problem->objectives() == 1);
 
-		Vector x((size_t)m_problem->dimension());
-		for (size_t i=0; i<x.size(); i++) x[i] = point[i];
-		return m_problem->evalSO(x);
+		if (pool == nullptr || pool->threads() == 1 || n <= 1)
+		{
+			evalRange(points, 0, n, values);
+			return;
+		}
+
+		// calibrate the cost per point with the first point of the first batch
+		size_t start = 0;
+		if (m_pointCost <= 0.0)
+		{
+			chrono::steady_clock::time_point t0 = chrono::steady_clock::now();
+			evalRange(points, 0, 1, values);
+			m_pointCost = chrono::duration<double>(chrono::steady_clock::now() - t0).count();
+			start = 1;
+		}
+
+		// Each point is evaluated independently and written to its own
+		// slot, hence the result does not depend on the scheduling.
+		size_t m = n - start;
+		chrono::steady_clock::time_point t0 = chrono::steady_clock::now();
+		pool->parallelFor(m, pool->chunkSize(m, m_pointCost), [&](size_t begin, size_t end)
+		{
+			evalRange(points, start + begin, start + end, values);
+		});
+		double elapsed = chrono::duration<double>(chrono::steady_clock::now() - t0).count();
+		m_pointCost = 0.5 * m_pointCost + 0.5 * elapsed * pool->threads() / m;
 	}
 
-	Vector evalMO(const double* point)
+	// evaluate points with indices begin, ..., end-1 of the batch,
+	// temporaries of each evaluation live in the thread's arena
+	void evalRange(const double* points, size_t begin, size_t end, double* values) const
 	{
-		assert(m_problem);
-		assert(m_problem->objectives() > 1);
-
-		Vector x((size_t)m_problem->dimension());
-		for (size_t i=0; i<x.size(); i++) x[i] = point[i];
-		return m_problem->evalMO(x);
+		size_t dim = dimension();
+		size_t nObj = objectives();
+		if (nObj == 1) m_problem->evalSOBatch(points + begin * dim, end - begin, values + begin);
+		else m_problem->evalMOBatch(points + begin * dim, end - begin, values + begin * nObj);
 	}
 
-	void update(Vector const& value)
+	// account for n evaluations with values stored row-major in #values,
+	// the MO performance is brought up to date by performance()
+	void updateBatch(const double* values, size_t n)
 	{
-		m_evaluations++;
+		m_evaluations += n;
 		unsigned int nObj = objectives();
 		if (nObj == 1)
 		{
-			m_bestvalue = min(m_bestvalue, value[0]);
+			for (size_t k=0; k<n; k++) m_bestvalue = min(m_bestvalue, values[k]);
 		}
 		else
 		{
 			assert(nObj > 1);
-			if (m_nondominated.insert(value))
+			for (size_t k=0; k<n; k++)
 			{
-				Vector refpoint(nObj, 1.0);
-				m_bestvalue = 1.0 - hypervolume(refpoint, m_nondominated);
+				if (m_nondominated.insert(Vector(nObj, values + k * nObj))) m_frontChanged = true;
 			}
 		}
 	}
 
+	// performance achieved so far; in the MO case the hypervolume is
+	// computed from scratch when the front has changed, hence it depends
+	// only on the front, not on the order in which points were inserted
+	double performance()
+	{
+		if (m_frontChanged)
+		{
+			Vector refpoint(objectives(), 1.0);
+			if (m_hypervolumeError > 0.0 && objectives() > 3) m_bestvalue = 1.0 - hypervolumeMonteCarlo(refpoint, m_nondominated, m_hypervolumeError);
+			else m_bestvalue = 1.0 - hypervolume(refpoint, m_nondominated);
+			m_frontChanged = false;
+		}
+		return m_bestvalue;
+	}
+
 	int m_id;                                              // index within the track
 	int m_budget;                                          // maximal number of black-box queries
 	int m_evaluations;                                     // current number of black-box queries
 	double m_bestvalue;                                    // performance achieved so far (hypervolume in the MO case)
 	ParetoFront m_nondominated;                            // MO case: non-dominated points
+	bool m_frontChanged;                                   // MO case: m_bestvalue is outdated
 	string m_problemname;                                  // (pretty useless)
-	Problem* m_problem;
+	std::shared_ptr<const Problem> m_problem;              // shared with the problem cache (see problems.h)
+	double m_pointCost;                                    // estimated time per evaluation in seconds, for batch scheduling
+	double m_hypervolumeError;                             // MO case with more than three objectives: Monte Carlo error bound, 0 for exact computation
 };
 
 
@@ -136,24 +195,42 @@ struct ProblemInstance
 // library state
 //
 
-// static string buffers
-char g_errorMessage[1024] = "";
-char g_returnBuffer[1024] = "";
-
-// overall program state
-const int stateReady = 1;               // the library has started up
-const int stateLoaded = 2;              // problem and track definitions were loaded
+// state of a handle
+const int stateLoaded = 2;              // no track selected yet
 const int stateTrackSelected = 3;       // track is selected, ready for setProblem
 const int stateProblemSelected = 4;     // problem is selected, ready for optimization!
-int g_state = 1;
+
+// Shared by all handles and read-only after loadProblems,
+// together with the compiled objective functions.
+bool g_loaded = false;        // problem and track definitions were loaded
 Json j_tracks;                // array of all tracks
 
-// valid at stateTrackSelected and later:
-Json j_track;                 // current track
+// optional parallel batch evaluation, shared by all handles
+ThreadPool* g_threadPool = nullptr;
+
+// Independent optimization session. Each handle holds a deep copy of
+// its track so that handles never share mutable json data.
+struct BBCompHandle
+{
+	BBCompHandle()
+	: state(stateLoaded)
+	{
+		errorMessage[0] = 0;
+		returnBuffer[0] = 0;
+	}
+
+	int state;
+	Json track;                   // current track, valid at stateTrackSelected and later
+	Json problem;                 // json problem description, valid at stateProblemSelected
+	ProblemInstance instance;     // problem instance, valid at stateProblemSelected
 
-// valid at stateProblemSelected:
-Json j_problem;               // json problem description
-ProblemInstance g_problem;    // problem instance
+	// static string buffers
+	char errorMessage[1024];
+	char returnBuffer[1024];
+};
+
+// handle used by the handle-free functions
+BBCompHandle g_default;
 
 
 ////////////////////////////////////////////////////////////
@@ -172,13 +249,13 @@ int loadProblems(stringtype problemfile, stringtype tracksfile)
 		Json j_problems;
 		if (! j_problems.load(problemfile))
 		{
-			strcpy(g_errorMessage, "failed to load problem definitions");
+			strcpy(g_default.errorMessage, "failed to load problem definitions");
 			return 0;
 		}
 
 		if (! j_tracks.load(tracksfile))
 		{
-			strcpy(g_errorMessage, "failed to load track definitions");
+			strcpy(g_default.errorMessage, "failed to load track definitions");
 			return 0;
 		}
 
@@ -188,346 +265,483 @@ int loadProblems(stringtype problemfile, stringtype tracksfile)
 		}
 		catch (exception const& ex)
 		{
-			strcpy(g_errorMessage, "error setting up problems in the track");
+			strcpy(g_default.errorMessage, "error setting up problems in the track");
 			return 0;
 		}
 
-		g_state = stateLoaded;
+		g_loaded = true;
 		return 1;
 	}
 	catch (...)
 	{
-		g_problem.clear();
-		g_state = stateReady;
-		strcpy(g_errorMessage, "unhandled error during loadProblems");
+		g_default.instance.clear();
+		g_default.state = stateLoaded;
+		g_loaded = false;
+		strcpy(g_default.errorMessage, "unhandled error during loadProblems");
 		return 0;
 	}
 }
 
-int numberOfTracks()
+int setNumberOfThreads(int threads)
 {
 	try
 	{
-		if (g_state < stateLoaded)
+		if (threads < 1)
 		{
-			strcpy(g_errorMessage, "not ready");
+			strcpy(g_default.errorMessage, "number of threads must be positive");
+			return 0;
+		}
+		if (g_threadPool)
+		{
+			if ((int)g_threadPool->threads() == threads) return 1;
+			delete g_threadPool;
+			g_threadPool = nullptr;
+		}
+		if (threads > 1) g_threadPool = new ThreadPool(threads);
+		return 1;
+	}
+	catch (...)
+	{
+		strcpy(g_default.errorMessage, "unhandled error during setNumberOfThreads");
+		return 0;
+	}
+}
+
+handletype createHandle()
+{
+	try
+	{
+		return new BBCompHandle();
+	}
+	catch (...)
+	{
+		strcpy(g_default.errorMessage, "unhandled error during createHandle");
+		return NULL;
+	}
+}
+
+void destroyHandle(handletype handle)
+{
+	if (handle != &g_default) delete handle;
+}
+
+int hNumberOfTracks(handletype handle)
+{
+	try
+	{
+		if (! g_loaded)
+		{
+			strcpy(handle->errorMessage, "not ready");
 			return 0;
 		}
 		return j_tracks.size();
 	}
 	catch (...)
 	{
-		g_problem.clear();
-		g_state = stateReady;
-		strcpy(g_errorMessage, "unhandled error during numberOfTracks");
+		handle->instance.clear();
+		handle->state = stateLoaded;
+		strcpy(handle->errorMessage, "unhandled error during numberOfTracks");
 		return 0;
 	}
 }
 
-stringtype trackName(int trackindex)
+stringtype hTrackName(handletype handle, int trackindex)
 {
 	try
 	{
 		// sanity checks
-		if (g_state < stateLoaded)
+		if (! g_loaded)
 		{
-			strcpy(g_errorMessage, "not ready");
+			strcpy(handle->errorMessage, "not ready");
 			return 0;
 		}
-		if (trackindex < 0 || trackindex >= (int)j_tracks.size())
+		Json const& tracks = j_tracks;
+		if (trackindex < 0 || trackindex >= (int)tracks.size())
 		{
-			strcpy(g_errorMessage, "track index out of range");
+			strcpy(handle->errorMessage, "track index out of range");
 			return 0;
 		}
 
 		// extract the track name
-		string s = j_tracks[trackindex]["name"].asString();
+		string s = tracks[trackindex]["name"].asString();
 		if (s.size() >= 1024)
 		{
-			strcpy(g_errorMessage, "track name too long (>= 1024 characters)");
+			strcpy(handle->errorMessage, "track name too long (>= 1024 characters)");
 			return 0;
 		}
-		strcpy(g_returnBuffer, s.c_str());
-		return g_returnBuffer;
+		strcpy(handle->returnBuffer, s.c_str());
+		return handle->returnBuffer;
 	}
 	catch (...)
 	{
-		g_problem.clear();
-		g_state = stateReady;
-		strcpy(g_errorMessage, "unhandled error during trackName");
+		handle->instance.clear();
+		handle->state = stateLoaded;
+		strcpy(handle->errorMessage, "unhandled error during trackName");
 		return NULL;
 	}
 }
 
-int setTrack(stringtype trackname)
+int hSetTrack(handletype handle, stringtype trackname)
 {
 	try
 	{
 		// sanity check
-		if (g_state < stateLoaded)
+		if (! g_loaded)
 		{
-			strcpy(g_errorMessage, "not ready");
+			strcpy(handle->errorMessage, "not ready");
 			return 0;
 		}
 
-		g_problem.clear();
-		g_state = stateLoaded;
+		handle->instance.clear();
+		handle->state = stateLoaded;
 
 		// set the track
-		for (size_t i=0; i<j_tracks.size(); i++)
+		Json const& tracks = j_tracks;
+		for (size_t i=0; i<tracks.size(); i++)
 		{
-			Json track = j_tracks[i];
+			Json const& track = tracks[i];
 			if (track["name"] == trackname)
 			{
-				j_track = track;
-				g_state = stateTrackSelected;
+				handle->track = track.clone();
+				handle->state = stateTrackSelected;
 				return 1;
 			}
 		}
-		strcpy(g_errorMessage, "unknown track name: '");
-		strncat(g_errorMessage, trackname, sizeof(g_errorMessage) - 50);
-		strcat(g_errorMessage, "'");
+		strcpy(handle->errorMessage, "unknown track name: '");
+		strncat(handle->errorMessage, trackname, sizeof(handle->errorMessage) - 50);
+		strcat(handle->errorMessage, "'");
 		return 0;
 	}
 	catch (...)
 	{
-		g_problem.clear();
-		g_state = stateReady;
-		strcpy(g_errorMessage, "unhandled error during setTrack");
+		handle->instance.clear();
+		handle->state = stateLoaded;
+		strcpy(handle->errorMessage, "unhandled error during setTrack");
 		return 0;
 	}
 }
 
-int numberOfProblems()
+int hNumberOfProblems(handletype handle)
 {
 	try
 	{
-		if (g_state < stateTrackSelected)
+		if (handle->state < stateTrackSelected)
 		{
-			strcpy(g_errorMessage, "no track selected");
+			strcpy(handle->errorMessage, "no track selected");
 			return 0;
 		}
-		return j_track["problems"].size();
+		return handle->track["problems"].size();
 	}
 	catch (...)
 	{
-		g_problem.clear();
-		g_state = stateReady;
-		strcpy(g_errorMessage, "unhandled error during numberOfProblems");
+		handle->instance.clear();
+		handle->state = stateLoaded;
+		strcpy(handle->errorMessage, "unhandled error during numberOfProblems");
 		return 0;
 	}
 }
 
-int setProblem(int problemID)
+int hSetProblem(handletype handle, int problemID)
 {
 	try
 	{
 		// sanity check
-		if (g_state < stateTrackSelected)
+		if (handle->state < stateTrackSelected)
 		{
-			strcpy(g_errorMessage, "no track selected");
+			strcpy(handle->errorMessage, "no track selected");
 			return 0;
 		}
 
-		g_problem.clear();
-		g_state = stateTrackSelected;
+		handle->instance.clear();
+		handle->state = stateTrackSelected;
 
 		// check parameter range
-		if (problemID < 0 || problemID >= (int)j_track["problems"].size())
+		if (problemID < 0 || problemID >= (int)handle->track["problems"].size())
 		{
-			strcpy(g_errorMessage, "track index out of range");
+			strcpy(handle->errorMessage, "track index out of range");
 			return 0;
 		}
-		j_problem = j_track["problems"][problemID];
+		handle->problem = handle->track["problems"][problemID];
 
 		// create problem instance
-		if (! g_problem.set(problemID, j_problem, 0))
+		if (! handle->instance.set(problemID, handle->problem, 0))
 		{
-			strcpy(g_errorMessage, "internal error: problem instance creation failed");
+			strcpy(handle->errorMessage, "internal error: problem instance creation failed");
 			return 0;
 		}
 
 		// success
-		g_state = stateProblemSelected;
+		handle->state = stateProblemSelected;
 		return 1;
 	}
 	catch (...)
 	{
-		g_problem.clear();
-		g_state = stateReady;
-		strcpy(g_errorMessage, "unhandled error during setProblem");
+		handle->instance.clear();
+		handle->state = stateLoaded;
+		strcpy(handle->errorMessage, "unhandled error during setProblem");
 		return 0;
 	}
 }
 
-int dimension()
+int hDimension(handletype handle)
 {
 	try
 	{
-		if (g_state < stateProblemSelected)
+		if (handle->state < stateProblemSelected)
 		{
-			strcpy(g_errorMessage, "no problem selected");
+			strcpy(handle->errorMessage, "no problem selected");
 			return 0;
 		}
-		return g_problem.dimension();
+		return handle->instance.dimension();
 	}
 	catch (...)
 	{
-		g_problem.clear();
-		g_state = stateReady;
-		strcpy(g_errorMessage, "unhandled error during dimension");
+		handle->instance.clear();
+		handle->state = stateLoaded;
+		strcpy(handle->errorMessage, "unhandled error during dimension");
 		return 0;
 	}
 }
 
-int numberOfObjectives()
+int hNumberOfObjectives(handletype handle)
 {
 	try
 	{
-		if (g_state < stateProblemSelected)
+		if (handle->state < stateProblemSelected)
 		{
-			strcpy(g_errorMessage, "no problem selected");
+			strcpy(handle->errorMessage, "no problem selected");
 			return 0;
 		}
-		return g_problem.objectives();
+		return handle->instance.objectives();
 	}
 	catch (...)
 	{
-		g_problem.clear();
-		g_state = stateReady;
-		strcpy(g_errorMessage, "unhandled error during numberOfObjectives");
+		handle->instance.clear();
+		handle->state = stateLoaded;
+		strcpy(handle->errorMessage, "unhandled error during numberOfObjectives");
 		return 0;
 	}
 }
 
-int budget()
+int hBudget(handletype handle)
 {
 	try
 	{
-		if (g_state < stateProblemSelected)
+		if (handle->state < stateProblemSelected)
 		{
-			strcpy(g_errorMessage, "no problem selected");
+			strcpy(handle->errorMessage, "no problem selected");
 			return 0;
 		}
-		return g_problem.m_budget;
+		return handle->instance.m_budget;
 	}
 	catch (...)
 	{
-		g_problem.clear();
-		g_state = stateReady;
-		strcpy(g_errorMessage, "unhandled error during budget");
+		handle->instance.clear();
+		handle->state = stateLoaded;
+		strcpy(handle->errorMessage, "unhandled error during budget");
 		return 0;
 	}
 }
 
-int evaluations()
+int hEvaluations(handletype handle)
 {
 	try
 	{
-		if (g_state < stateProblemSelected)
+		if (handle->state < stateProblemSelected)
 		{
-			strcpy(g_errorMessage, "no problem selected");
+			strcpy(handle->errorMessage, "no problem selected");
 			return -1;
 		}
 
-		return g_problem.m_evaluations;
+		return handle->instance.m_evaluations;
 	}
 	catch (...)
 	{
-		g_problem.clear();
-		g_state = stateReady;
-		strcpy(g_errorMessage, "unhandled error during evaluations");
+		handle->instance.clear();
+		handle->state = stateLoaded;
+		strcpy(handle->errorMessage, "unhandled error during evaluations");
 		return -1;
 	}
 }
 
-int evaluate(double* point, double* value)
+int hEvaluate(handletype handle, double* point, double* value)
 {
+	ProblemInstance& problem = handle->instance;
 	try
 	{
 		// initialize output argument
-		for (size_t i=0; i<g_problem.objectives(); i++) value[i] = 1e100;
+		for (size_t i=0; i<problem.objectives(); i++) value[i] = 1e100;
 
 		// sanity checks
-		if (g_state < stateProblemSelected)
+		if (handle->state < stateProblemSelected)
 		{
-			strcpy(g_errorMessage, "no problem selected");
+			strcpy(handle->errorMessage, "no problem selected");
 			return 0;
 		}
-		if (g_problem.m_evaluations >= g_problem.m_budget)
+		if (problem.m_evaluations >= problem.m_budget)
 		{
-			strcpy(g_errorMessage, "evaluation budget exceeded");
+			strcpy(handle->errorMessage, "evaluation budget exceeded");
 			return 0;
 		}
 
 		// check box constraints
 		bool good = true;
-		for (int i=0; i<(int)g_problem.dimension(); i++)
+		for (int i=0; i<(int)problem.dimension(); i++)
 		{
 			if (point[i] < 0.0 || point[i] > 1.0) good = false;
 		}
 		if (! good)
 		{
-			strcpy(g_errorMessage, "attempt to evaluate an infeasible point");
+			strcpy(handle->errorMessage, "attempt to evaluate an infeasible point");
 			return 0;
 		}
 
 		// actual evaluation
-		Vector val(g_problem.objectives(), 1e100);
-		if (g_problem.objectives() == 1)
+		problem.evalRange(point, 0, 1, value);
+		problem.updateBatch(value, 1);
+
+		// success
+		return 1;
+	}
+	catch (...)
+	{
+		problem.clear();
+		handle->state = stateLoaded;
+		strcpy(handle->errorMessage, "unhandled error during evaluate");
+		return 0;
+	}
+}
+
+int hEvaluateBatch(handletype handle, double* points, int n, double* values)
+{
+	ProblemInstance& problem = handle->instance;
+	try
+	{
+		// initialize output argument
+		for (int k=0; k<n; k++)
+			for (size_t i=0; i<problem.objectives(); i++) values[k * problem.objectives() + i] = 1e100;
+
+		// sanity checks
+		if (handle->state < stateProblemSelected)
 		{
-			val[0] = g_problem.evalSO(point);
+			strcpy(handle->errorMessage, "no problem selected");
+			return 0;
 		}
-		else
+		if (n < 0)
 		{
-			val = g_problem.evalMO(point);
+			strcpy(handle->errorMessage, "negative number of points");
+			return 0;
+		}
+		if (n == 0) return 0;
+		if (problem.m_evaluations >= problem.m_budget)
+		{
+			strcpy(handle->errorMessage, "evaluation budget exceeded");
+			return 0;
 		}
 
-		// return the value(s)
-		for (size_t i=0; i<val.size(); i++) value[i] = val[i];
-		g_problem.update(val);
+		// check box constraints of all points, reject the whole batch
+		// if any point is infeasible
+		size_t dim = problem.dimension();
+		for (size_t i=0; i<(size_t)n * dim; i++)
+		{
+			if (points[i] < 0.0 || points[i] > 1.0)
+			{
+				strcpy(handle->errorMessage, "attempt to evaluate an infeasible point");
+				return 0;
+			}
+		}
 
-		// success
-		return 1;
+		// points beyond the remaining budget are not evaluated
+		int count = min(n, problem.m_budget - problem.m_evaluations);
+
+		// actual evaluation
+		problem.evalBatch(points, count, values, g_threadPool);
+		problem.updateBatch(values, count);
+
+		// partial success
+		if (count < n) strcpy(handle->errorMessage, "evaluation budget exceeded");
+		return count;
 	}
 	catch (...)
 	{
-		g_problem.clear();
-		g_state = stateReady;
-		strcpy(g_errorMessage, "unhandled error during evaluate");
+		problem.clear();
+		handle->state = stateLoaded;
+		strcpy(handle->errorMessage, "unhandled error during evaluateBatch");
 		return 0;
 	}
 }
 
-double performance()
+double hPerformance(handletype handle)
 {
 	try
 	{
-		if (g_state < stateProblemSelected)
+		if (handle->state < stateProblemSelected)
 		{
-			strcpy(g_errorMessage, "no problem selected");
+			strcpy(handle->errorMessage, "no problem selected");
 			return 1e100;
 		}
 		else
 		{
-			if (g_problem.m_evaluations == 0) strcpy(g_errorMessage, "no evaluations available");
-			return g_problem.m_bestvalue;
+			if (handle->instance.m_evaluations == 0) strcpy(handle->errorMessage, "no evaluations available");
+			return handle->instance.performance();
 		}
 	}
 	catch (...)
 	{
-		g_problem.clear();
-		g_state = stateReady;
-		strcpy(g_errorMessage, "unhandled error during performance");
+		handle->instance.clear();
+		handle->state = stateLoaded;
+		strcpy(handle->errorMessage, "unhandled error during performance");
 		return 0;
 	}
 }
 
-stringtype errorMessage()
+stringtype hErrorMessage(handletype handle)
 {
-	return g_errorMessage;
+	return handle->errorMessage;
 }
 
+
+// functions operating on the default handle
+
+int numberOfTracks()
+{ return hNumberOfTracks(&g_default); }
+
+stringtype trackName(int trackindex)
+{ return hTrackName(&g_default, trackindex); }
+
+int setTrack(stringtype trackname)
+{ return hSetTrack(&g_default, trackname); }
+
+int numberOfProblems()
+{ return hNumberOfProblems(&g_default); }
+
+int setProblem(int problemID)
+{ return hSetProblem(&g_default, problemID); }
+
+int dimension()
+{ return hDimension(&g_default); }
+
+int numberOfObjectives()
+{ return hNumberOfObjectives(&g_default); }
+
+int budget()
+{ return hBudget(&g_default); }
+
+int evaluations()
+{ return hEvaluations(&g_default); }
+
+int evaluate(double* point, double* value)
+{ return hEvaluate(&g_default, point, value); }
+
+int evaluateBatch(double* points, int n, double* values)
+{ return hEvaluateBatch(&g_default, points, n, values); }
+
+double performance()
+{ return hPerformance(&g_default); }
+
+stringtype errorMessage()
+{ return hErrorMessage(&g_default); }
+
 #ifdef __cplusplus
 } // extern "C"
 #endif
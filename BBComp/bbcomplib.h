@@ -24,9 +24,36 @@ int numberOfObjectives();
 int budget();
 int evaluations();
 int evaluate(double* point, double* value);
+int evaluateBatch(double* points, int n, double* values);
+int setNumberOfThreads(int threads);
 double performance();
 stringtype errorMessage();
 
+// Independent optimization sessions, e.g., for running several
+// optimizers in one process. Each handle has its own track, problem,
+// and error message. Track and problem definitions are shared and are
+// loaded once with loadProblems, which must not be called while other
+// threads are using handles (the same holds for setNumberOfThreads).
+// Distinct handles may be used concurrently from different threads.
+// The handle-free functions above operate on a default handle.
+#define handletype struct BBCompHandle*
+
+handletype createHandle();
+void destroyHandle(handletype handle);
+int hNumberOfTracks(handletype handle);
+stringtype hTrackName(handletype handle, int trackindex);
+int hSetTrack(handletype handle, stringtype trackname);
+int hNumberOfProblems(handletype handle);
+int hSetProblem(handletype handle, int problemID);
+int hDimension(handletype handle);
+int hNumberOfObjectives(handletype handle);
+int hBudget(handletype handle);
+int hEvaluations(handletype handle);
+int hEvaluate(handletype handle, double* point, double* value);
+int hEvaluateBatch(handletype handle, double* points, int n, double* values);
+double hPerformance(handletype handle);
+stringtype hErrorMessage(handletype handle);
+
 
 #ifdef __cplusplus
 } // extern "C"
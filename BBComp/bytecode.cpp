@@ -0,0 +1,1355 @@
+
+#include "bytecode.h"
+#include "kernels.h"
+#include "vecmath.h"
+
+#include <stdexcept>
+#include <algorithm>
+#include <limits>
+#include <cmath>
+#include <cassert>
+#include <cstring>
+#include <set>
+#include <sstream>
+
+
+using namespace std;
+
+
+// number of components processed at a time by lane execution
+static const size_t laneWidth = 64;
+
+
+////////////////////////////////////////////////////////////
+// register files
+//
+
+Registers::Registers(Program const& program)
+: s(program.scalars, 0.0)
+, vp(program.vectors, nullptr)
+, vn(program.vectors, 0)
+, vbuf(program.vectors)
+, prepared(false)
+{
+	for (size_t i=0; i<program.scalarConstant.size(); i++)
+	{
+		s[program.scalarConstant[i].first] = program.scalarConstant[i].second;
+	}
+	for (size_t i=0; i<program.vectorConstant.size(); i++)
+	{
+		Vector const& v = program.vectorConstant[i].second;
+		int r = program.vectorConstant[i].first;
+		vp[r] = v.data();
+		vn[r] = v.size();
+	}
+	for (size_t i=0; i<program.shape.size(); i++)
+	{
+		vector(program.shape[i].first, program.shape[i].second);
+	}
+	size_t n = 0;
+	for (size_t i=0; i<program.lambda.size(); i++)
+	{
+		if (program.lambda[i].vectorized) n = std::max(n, (size_t)program.lambda[i].lanes);
+	}
+	lanes.resize(n * laneWidth);
+}
+
+
+////////////////////////////////////////////////////////////
+// compiler
+//
+
+Compiler::Compiler(Program& program)
+: m_program(program)
+{
+	m_program = Program();
+	m_program.block.resize(1);
+	m_block.push_back(0);
+}
+
+int Compiler::scalar()
+{
+	return m_program.scalars++;
+}
+
+int Compiler::vector()
+{
+	return m_program.vectors++;
+}
+
+int Compiler::constant(double value)
+{
+	int r = scalar();
+	m_program.scalarConstant.push_back(make_pair(r, value));
+	return r;
+}
+
+int Compiler::constant(Vector const& value)
+{
+	int r = vector();
+	m_program.vectorConstant.push_back(make_pair(r, value.copy()));
+	return r;
+}
+
+void Compiler::emit(Opcode op, int dst, int a, int b, int c, double imm, ScalarFunction f)
+{
+	Instruction inst;
+	inst.op = op;
+	inst.dst = dst;
+	inst.a = a;
+	inst.b = b;
+	inst.c = c;
+	inst.imm = imm;
+	inst.f = f;
+	m_program.block[m_block.back()].push_back(inst);
+}
+
+int Compiler::composition(std::vector<Operand> const& operands)
+{
+	m_program.composition.push_back(operands);
+	return (int)m_program.composition.size() - 1;
+}
+
+void Compiler::beginLambda()
+{
+	m_block.push_back(m_program.block.size());
+	m_program.block.push_back(std::vector<Instruction>());
+	m_argument.push_back(scalar());
+}
+
+int Compiler::argument() const
+{
+	if (m_argument.empty()) throw runtime_error("[Compiler] lambda argument outside of apply statement");
+	return m_argument.back();
+}
+
+// Prepare the lane execution of a lambda body. Instructions depending
+// on the argument are moved to the lane code, the others to the block
+// of invariant instructions. Invariant operands of lane instructions
+// are broadcast into lanes of their own. A block of invariant
+// instructions allocated earlier (index other than 0) is reused.
+static void vectorize(Program& program, Lambda& l)
+{
+	l.vectorized = false;
+	l.laneCode.clear();
+	l.broadcast.clear();
+	l.lanes = 0;
+	l.resultLane = -1;
+
+	std::vector<Instruction> invariant;
+	std::vector<Instruction> code;
+	std::map<int, int> lane;            // scalar register -> lane
+	std::map<int, int> broadcast;       // scalar register -> lane
+	int lanes = 1;
+	lane[l.argument] = 0;
+	std::vector<Instruction> const& body = program.block[l.block];
+	for (size_t k=0; k<body.size(); k++)
+	{
+		Instruction in = body[k];
+		if (in.op >= opVNeg) return;
+		bool sa = (in.op <= opSFunc);
+		bool sb = (in.op >= opSAdd && in.op <= opSPow) || in.op == opSEntry;
+		if (! (sa && lane.count(in.a)) && ! (sb && lane.count(in.b)))
+		{
+			invariant.push_back(in);
+			continue;
+		}
+		int* operand[2] = { sa ? &in.a : nullptr, sb ? &in.b : nullptr };
+		for (int j=0; j<2; j++)
+		{
+			if (! operand[j]) continue;
+			int& r = *operand[j];
+			if (lane.count(r)) r = lane[r];
+			else
+			{
+				if (! broadcast.count(r)) broadcast[r] = lanes++;
+				r = broadcast[r];
+			}
+		}
+		lane[in.dst] = lanes;
+		in.dst = lanes++;
+		code.push_back(in);
+	}
+
+	l.vectorized = true;
+	if (l.invariant == 0)
+	{
+		l.invariant = program.block.size();
+		program.block.push_back(invariant);
+	}
+	else program.block[l.invariant] = invariant;
+	l.laneCode = code;
+	for (std::map<int, int>::const_iterator it = broadcast.begin(); it != broadcast.end(); ++it) l.broadcast.push_back(*it);
+	l.lanes = lanes;
+	if (lane.count(l.result)) l.resultLane = lane[l.result];
+}
+
+int Compiler::endLambda(int result)
+{
+	assert(m_block.size() > 1);
+	Lambda l;
+	l.block = m_block.back();
+	l.argument = m_argument.back();
+	l.result = result;
+	l.invariant = 0;
+	vectorize(m_program, l);
+	m_block.pop_back();
+	m_argument.pop_back();
+	m_program.lambda.push_back(l);
+	return (int)m_program.lambda.size() - 1;
+}
+
+void Compiler::bind(const void* variable, int reg)
+{
+	m_variable[variable] = reg;
+}
+
+int Compiler::lookup(const void* variable) const
+{
+	std::map<const void*, int>::const_iterator it = m_variable.find(variable);
+	if (it == m_variable.end()) throw runtime_error("[Compiler] unbound variable");
+	return it->second;
+}
+
+
+////////////////////////////////////////////////////////////
+// dispatch loop
+//
+
+static void run(Program const& program, Registers& reg, const Instruction* begin, const Instruction* end);
+
+static void run(Program const& program, Registers& reg, std::vector<Instruction> const& code)
+{ run(program, reg, code.data(), code.data() + code.size()); }
+
+// d[i] = lambda(a[i]) for i = 0, ..., n-1, on lanes
+static void runLanes(Program const& program, Registers& reg, Lambda const& l, double* d, const double* a, size_t n)
+{
+	if (n == 0) return;
+	run(program, reg, program.block[l.invariant]);
+	const double* s = reg.s.data();
+	reg.lanes.resize(l.lanes * laneWidth);
+	double* lane = reg.lanes.data();
+	for (size_t k=0; k<l.broadcast.size(); k++)
+	{
+		std::fill(lane + l.broadcast[k].second * laneWidth, lane + (l.broadcast[k].second + 1) * laneWidth, s[l.broadcast[k].first]);
+	}
+
+	for (size_t i=0; i<n; i+=laneWidth)
+	{
+		size_t m = std::min(laneWidth, n - i);
+		std::copy(a + i, a + i + m, lane);
+		for (size_t k=0; k<l.laneCode.size(); k++)
+		{
+			Instruction const& in = l.laneCode[k];
+			double* x = lane + in.dst * laneWidth;
+			const double* y = lane + in.a * laneWidth;
+			const double* z = lane + in.b * laneWidth;
+			switch (in.op)
+			{
+			case opSNeg:
+				kernelNeg(x, y, m);
+				break;
+			case opSAdd:
+				kernelAdd(x, y, z, m);
+				break;
+			case opSSub:
+				kernelSub(x, y, z, m);
+				break;
+			case opSMul:
+				kernelMul(x, y, z, m);
+				break;
+			case opSDiv:
+				kernelDiv(x, y, z, m);
+				break;
+			case opSPow:
+				kernelPow(x, y, z, m);
+				break;
+			case opSFunc:
+				kernelFunction(in.f, x, y, m);
+				break;
+			case opSEntry:
+			{
+				const double* v = reg.vp[in.a];
+				int size = (int)reg.vn[in.a];
+				for (size_t j=0; j<m; j++)
+				{
+					int e = (int)floor(z[j]);
+					if (e < 1 || e > size) throw runtime_error("index out of bounds");
+					x[j] = v[e - 1];
+				}
+				break;
+			}
+			default:
+				assert(false);
+			}
+		}
+		if (l.resultLane >= 0) std::copy(lane + l.resultLane * laneWidth, lane + l.resultLane * laneWidth + m, d + i);
+		else std::fill(d + i, d + i + m, s[l.result]);
+	}
+}
+
+static void run(Program const& program, Registers& reg, const Instruction* begin, const Instruction* end)
+{
+	double* s = reg.s.data();
+	for (const Instruction* it = begin; it != end; ++it)
+	{
+		Instruction const& in = *it;
+		switch (in.op)
+		{
+		case opSNeg:
+			s[in.dst] = -s[in.a];
+			break;
+		case opSAdd:
+			s[in.dst] = s[in.a] + s[in.b];
+			break;
+		case opSSub:
+			s[in.dst] = s[in.a] - s[in.b];
+			break;
+		case opSMul:
+			s[in.dst] = s[in.a] * s[in.b];
+			break;
+		case opSDiv:
+			s[in.dst] = s[in.a] / s[in.b];
+			break;
+		case opSPow:
+			s[in.dst] = mathPow(s[in.a], s[in.b]);
+			break;
+		case opSFunc:
+			s[in.dst] = in.f(s[in.a]);
+			break;
+		case opSDim:
+			s[in.dst] = (double)reg.vn[in.a];
+			break;
+		case opSEntry:
+		{
+			int i = (int)floor(s[in.b]);
+			if (i < 1 || i > (int)reg.vn[in.a]) throw runtime_error("index out of bounds");
+			s[in.dst] = reg.vp[in.a][i - 1];
+			break;
+		}
+		case opSDot:
+		{
+			const double* a = reg.vp[in.a];
+			const double* b = reg.vp[in.b];
+			s[in.dst] = kernelDot(a, b, reg.vn[in.a]);
+			break;
+		}
+		case opSSum:
+		{
+			s[in.dst] = kernelSum(reg.vp[in.a], reg.vn[in.a]);
+			break;
+		}
+		case opSProd:
+		{
+			s[in.dst] = kernelProduct(reg.vp[in.a], reg.vn[in.a]);
+			break;
+		}
+		case opSNorm:
+		case opSSqrNorm:
+		{
+			double ret = kernelSqrNorm(reg.vp[in.a], reg.vn[in.a]);
+			s[in.dst] = (in.op == opSNorm) ? std::sqrt(ret) : ret;
+			break;
+		}
+		case opSMin:
+		{
+			const double* a = reg.vp[in.a];
+			size_t n = reg.vn[in.a];
+			double ret = (n > 0) ? a[0] : numeric_limits<double>::quiet_NaN();
+			for (size_t i=1; i<n; i++) ret = std::min(ret, a[i]);
+			s[in.dst] = ret;
+			break;
+		}
+		case opSMax:
+		{
+			const double* a = reg.vp[in.a];
+			size_t n = reg.vn[in.a];
+			double ret = (n > 0) ? a[0] : numeric_limits<double>::quiet_NaN();
+			for (size_t i=1; i<n; i++) ret = std::max(ret, a[i]);
+			s[in.dst] = ret;
+			break;
+		}
+		case opVNeg:
+		{
+			size_t n = reg.vn[in.a];
+			double* d = reg.vector(in.dst, n);
+			const double* a = reg.vp[in.a];
+			kernelNeg(d, a, n);
+			break;
+		}
+		case opVAdd:
+		{
+			size_t n = reg.vn[in.a];
+			double* d = reg.vector(in.dst, n);
+			const double* a = reg.vp[in.a];
+			const double* b = reg.vp[in.b];
+			kernelAdd(d, a, b, n);
+			break;
+		}
+		case opVSub:
+		{
+			size_t n = reg.vn[in.a];
+			double* d = reg.vector(in.dst, n);
+			const double* a = reg.vp[in.a];
+			const double* b = reg.vp[in.b];
+			kernelSub(d, a, b, n);
+			break;
+		}
+		case opVScale:
+		{
+			size_t n = reg.vn[in.a];
+			double* d = reg.vector(in.dst, n);
+			const double* a = reg.vp[in.a];
+			double b = s[in.b];
+			kernelScale(d, a, b, n);
+			break;
+		}
+		case opVDiv:
+		{
+			size_t n = reg.vn[in.a];
+			double* d = reg.vector(in.dst, n);
+			const double* a = reg.vp[in.a];
+			double b = s[in.b];
+			kernelDivide(d, a, b, n);
+			break;
+		}
+		case opVEMul:
+		{
+			size_t n = reg.vn[in.a];
+			double* d = reg.vector(in.dst, n);
+			const double* a = reg.vp[in.a];
+			const double* b = reg.vp[in.b];
+			kernelMul(d, a, b, n);
+			break;
+		}
+		case opVEDiv:
+		{
+			size_t n = reg.vn[in.a];
+			double* d = reg.vector(in.dst, n);
+			const double* a = reg.vp[in.a];
+			const double* b = reg.vp[in.b];
+			kernelDiv(d, a, b, n);
+			break;
+		}
+		case opVEPowS:
+		{
+			size_t n = reg.vn[in.a];
+			double* d = reg.vector(in.dst, n);
+			const double* a = reg.vp[in.a];
+			double b = s[in.b];
+			kernelPow(d, a, b, n);
+			break;
+		}
+		case opVEPowV:
+		{
+			size_t n = reg.vn[in.a];
+			double* d = reg.vector(in.dst, n);
+			const double* a = reg.vp[in.a];
+			const double* b = reg.vp[in.b];
+			kernelPow(d, a, b, n);
+			break;
+		}
+		case opVScaleAdd:
+		case opVScaleSub:
+		{
+			size_t n = reg.vn[in.a];
+			double* d = reg.vector(in.dst, n);
+			const double* a = reg.vp[in.a];
+			double b = s[in.b];
+			const double* c = reg.vp[in.c];
+			if (in.op == opVScaleAdd) kernelScaleAdd(d, a, b, c, n);
+			else kernelScaleSub(d, a, b, c, n);
+			break;
+		}
+		case opVCompose:
+		{
+			std::vector<Operand> const& parts = program.composition[in.a];
+			size_t n = 0;
+			for (size_t k=0; k<parts.size(); k++) n += parts[k].isVector ? reg.vn[parts[k].reg] : 1;
+			double* d = reg.vector(in.dst, n);
+			for (size_t k=0; k<parts.size(); k++)
+			{
+				if (parts[k].isVector)
+				{
+					const double* a = reg.vp[parts[k].reg];
+					size_t m = reg.vn[parts[k].reg];
+					for (size_t i=0; i<m; i++) *d++ = a[i];
+				}
+				else *d++ = s[parts[k].reg];
+			}
+			break;
+		}
+		case opVRange:
+		{
+			int f = (int)floor(s[in.b]);
+			int l = (int)floor(s[in.c]);
+			int size = l - f + 1;
+			if (f < 1 || l > (int)reg.vn[in.a] || size < 0) throw runtime_error("dimension mismatch");
+			double* d = reg.vector(in.dst, (size_t)size);
+			const double* a = reg.vp[in.a] + (f - 1);
+			for (int i=0; i<size; i++) d[i] = a[i];
+			break;
+		}
+		case opVFill:
+		{
+			int sz = (int)floor(s[in.a]);
+			if (sz < 0) throw runtime_error("dimension must be non-negative");
+			double* d = reg.vector(in.dst, (size_t)sz);
+			for (int i=0; i<sz; i++) d[i] = in.imm;
+			break;
+		}
+		case opVIota:
+		{
+			int sz = (int)floor(s[in.a]);
+			if (sz < 0) throw runtime_error("dimension must be non-negative");
+			double* d = reg.vector(in.dst, (size_t)sz);
+			for (int i=0; i<sz; i++) d[i] = i + 1;
+			break;
+		}
+		case opVApply:
+		{
+			Lambda const& l = program.lambda[in.b];
+			size_t n = reg.vn[in.a];
+			double* d = reg.vector(in.dst, n);
+			const double* a = reg.vp[in.a];
+			if (l.vectorized)
+			{
+				runLanes(program, reg, l, d, a, n);
+				break;
+			}
+			for (size_t i=0; i<n; i++)
+			{
+				s[l.argument] = a[i];
+				run(program, reg, program.block[l.block]);
+				d[i] = s[l.result];
+			}
+			break;
+		}
+		}
+	}
+}
+
+void step(Program const& program, Registers& registers, Instruction const& instruction)
+{
+	run(program, registers, &instruction, &instruction + 1);
+}
+
+double execute(Program const& program, Registers& registers, Vector const& x)
+{
+	assert(registers.s.size() == (size_t)program.scalars);
+	registers.vp[0] = x.data();
+	registers.vn[0] = x.size();
+	run(program, registers, program.block[0]);
+	return registers.s[program.result];
+}
+
+
+////////////////////////////////////////////////////////////
+// specialization
+//
+
+namespace {
+
+// register operand of an instruction
+struct OperandRef
+{
+	bool isVector;
+	int* reg;
+};
+
+}
+
+// registers read by an instruction, not including those read by the
+// body of an apply statement
+static void operands(Program& program, Instruction& in, std::vector<OperandRef>& ret)
+{
+	OperandRef sa = { false, &in.a }, sb = { false, &in.b }, sc = { false, &in.c };
+	OperandRef va = { true, &in.a }, vb = { true, &in.b }, vc = { true, &in.c };
+	ret.clear();
+	switch (in.op)
+	{
+	case opSNeg:
+	case opSFunc:
+	case opVFill:
+	case opVIota:
+		ret.push_back(sa);
+		break;
+	case opSAdd:
+	case opSSub:
+	case opSMul:
+	case opSDiv:
+	case opSPow:
+		ret.push_back(sa);
+		ret.push_back(sb);
+		break;
+	case opSDim:
+	case opSSum:
+	case opSProd:
+	case opSNorm:
+	case opSSqrNorm:
+	case opSMin:
+	case opSMax:
+	case opVNeg:
+	case opVApply:
+		ret.push_back(va);
+		break;
+	case opSEntry:
+	case opVScale:
+	case opVDiv:
+	case opVEPowS:
+		ret.push_back(va);
+		ret.push_back(sb);
+		break;
+	case opSDot:
+	case opVAdd:
+	case opVSub:
+	case opVEMul:
+	case opVEDiv:
+	case opVEPowV:
+		ret.push_back(va);
+		ret.push_back(vb);
+		break;
+	case opVScaleAdd:
+	case opVScaleSub:
+		ret.push_back(va);
+		ret.push_back(sb);
+		ret.push_back(vc);
+		break;
+	case opVRange:
+		ret.push_back(va);
+		ret.push_back(sb);
+		ret.push_back(sc);
+		break;
+	case opVCompose:
+	{
+		std::vector<Operand>& parts = program.composition[in.a];
+		for (size_t k=0; k<parts.size(); k++)
+		{
+			OperandRef o = { parts[k].isVector, &parts[k].reg };
+			ret.push_back(o);
+		}
+		break;
+	}
+	}
+}
+
+// registers read by the body of a lambda and defined outside of it
+static void externals(Program& program, size_t lambda, std::vector<OperandRef>& ret)
+{
+	Lambda const& l = program.lambda[lambda];
+	std::vector<Instruction>& body = program.block[l.block];
+	std::set< std::pair<bool, int> > defined;
+	defined.insert(make_pair(false, l.argument));
+	for (size_t k=0; k<body.size(); k++) defined.insert(make_pair(body[k].op >= opVNeg, body[k].dst));
+	std::vector<OperandRef> ops;
+	for (size_t k=0; k<body.size(); k++)
+	{
+		operands(program, body[k], ops);
+		if (body[k].op == opVApply)
+		{
+			std::vector<OperandRef> inner;
+			externals(program, body[k].b, inner);
+			ops.insert(ops.end(), inner.begin(), inner.end());
+		}
+		for (size_t j=0; j<ops.size(); j++)
+		{
+			if (! defined.count(make_pair(ops[j].isVector, *ops[j].reg))) ret.push_back(ops[j]);
+		}
+	}
+	if (! defined.count(make_pair(false, l.result)))
+	{
+		OperandRef o = { false, &program.lambda[lambda].result };
+		ret.push_back(o);
+	}
+}
+
+// the instruction may throw an exception, even if its result is unused
+static bool mayThrow(Opcode op)
+{
+	return (op == opSEntry || op == opVRange || op == opVFill || op == opVIota || op == opVApply);
+}
+
+namespace {
+
+// state of the specialization of a program
+struct Specializer
+{
+	Specializer(Program const& original, size_t dimension)
+	: program(original)
+	, scratch(original)
+	, sknown(original.scalars, false)
+	, vknown(original.vectors, false)
+	, vsize(original.vectors, -1)
+	, input(dimension, std::numeric_limits<double>::quiet_NaN())
+	{
+		scratch.vp[0] = input.data();
+		scratch.vn[0] = dimension;
+		vsize[0] = (long)dimension;
+		for (size_t i=0; i<original.scalarConstant.size(); i++)
+		{
+			int r = original.scalarConstant[i].first;
+			sknown[r] = true;
+			if (! scalarConstant.count(scratch.s[r])) scalarConstant[scratch.s[r]] = r;
+			else smap[r] = scalarConstant[scratch.s[r]];
+		}
+		for (size_t i=0; i<original.vectorConstant.size(); i++)
+		{
+			int r = original.vectorConstant[i].first;
+			vknown[r] = true;
+			vsize[r] = (long)scratch.vn[r];
+			int c = findVector(r);
+			if (c >= 0) vmap[r] = c;
+			else vectorConstant.push_back(r);
+		}
+	}
+
+	// known vector register with the same content as r, or -1
+	int findVector(int r) const
+	{
+		for (size_t k=0; k<vectorConstant.size(); k++)
+		{
+			int c = vectorConstant[k];
+			if (scratch.vn[c] == scratch.vn[r] && std::equal(scratch.vp[r], scratch.vp[r] + scratch.vn[r], scratch.vp[c], identical)) return c;
+		}
+		return -1;
+	}
+
+	static bool identical(double a, double b)
+	{ return memcmp(&a, &b, sizeof(double)) == 0; }
+
+	// replace merged registers, and squares if computed by multiplication
+	void rewrite(Instruction& in)
+	{
+		operands(program, in, ops);
+		for (size_t j=0; j<ops.size(); j++)
+		{
+			std::map<int, int>& m = ops[j].isVector ? vmap : smap;
+			std::map<int, int>::const_iterator it = m.find(*ops[j].reg);
+			if (it != m.end()) *ops[j].reg = it->second;
+		}
+		if (mathMode() == VectorizedMath && (in.op == opSPow || in.op == opVEPowS) && sknown[in.b] && scratch.s[in.b] == 2.0)
+		{
+			in.op = (in.op == opSPow) ? opSMul : opVEMul;
+			in.b = in.a;
+		}
+	}
+
+	// rewrite the body of a lambda and redo its lane analysis
+	void rewriteLambda(size_t lambda)
+	{
+		Lambda& l = program.lambda[lambda];
+		std::vector<Instruction>& body = program.block[l.block];
+		for (size_t k=0; k<body.size(); k++)
+		{
+			rewrite(body[k]);
+			if (body[k].op == opVApply) rewriteLambda(body[k].b);
+		}
+		std::map<int, int>::const_iterator it = smap.find(l.result);
+		if (it != smap.end()) l.result = it->second;
+		vectorize(program, l);
+	}
+
+	// Execute the instruction if all its operands are known, and turn its
+	// result into a constant. Return false if the instruction remains.
+	bool fold(Instruction& in)
+	{
+		bool vec = (in.op >= opVNeg);
+		if (in.op == opSDim && vsize[in.a] >= 0) scratch.s[in.dst] = (double)vsize[in.a];
+		else
+		{
+			operands(program, in, ops);
+			if (in.op == opVApply) externals(program, in.b, ops);
+			for (size_t j=0; j<ops.size(); j++)
+			{
+				if (! (ops[j].isVector ? vknown[*ops[j].reg] : sknown[*ops[j].reg])) return false;
+			}
+			try
+			{
+				run(program, scratch, std::vector<Instruction>(1, in));
+			}
+			catch (std::exception const&)
+			{
+				// keep the instruction, such that the error is reported at evaluation time
+				return false;
+			}
+		}
+
+		if (vec)
+		{
+			vknown[in.dst] = true;
+			vsize[in.dst] = (long)scratch.vn[in.dst];
+			int c = findVector(in.dst);
+			if (c >= 0) vmap[in.dst] = c;
+			else
+			{
+				vectorConstant.push_back(in.dst);
+				program.vectorConstant.push_back(make_pair(in.dst, Vector(scratch.vn[in.dst], scratch.vp[in.dst])));
+			}
+		}
+		else
+		{
+			double value = scratch.s[in.dst];
+			sknown[in.dst] = true;
+			std::map<double, int, Less>::const_iterator it = scalarConstant.find(value);
+			if (it != scalarConstant.end()) smap[in.dst] = it->second;
+			else
+			{
+				scalarConstant[value] = in.dst;
+				program.scalarConstant.push_back(make_pair(in.dst, value));
+			}
+		}
+		return true;
+	}
+
+	// size of the result of a vector instruction, or -1 if unknown
+	long resultSize(Instruction& in)
+	{
+		switch (in.op)
+		{
+		case opVCompose:
+		{
+			std::vector<Operand> const& parts = program.composition[in.a];
+			long n = 0;
+			for (size_t k=0; k<parts.size(); k++)
+			{
+				if (! parts[k].isVector) n++;
+				else if (vsize[parts[k].reg] >= 0) n += vsize[parts[k].reg];
+				else return -1;
+			}
+			return n;
+		}
+		case opVRange:
+		{
+			if (vsize[in.a] < 0 || ! sknown[in.b] || ! sknown[in.c]) return -1;
+			long f = (long)floor(scratch.s[in.b]);
+			long l = (long)floor(scratch.s[in.c]);
+			if (f < 1 || l > vsize[in.a] || l - f + 1 < 0) return -1;
+			return l - f + 1;
+		}
+		case opVFill:
+		case opVIota:
+			return -1;         // folded if the size is known
+		default:
+			return vsize[in.a];
+		}
+	}
+
+	// bitwise comparison of scalar constants, distinguishing -0 and 0
+	struct Less
+	{
+		bool operator () (double a, double b) const
+		{ return memcmp(&a, &b, sizeof(double)) < 0; }
+	};
+
+	Program program;
+	Registers scratch;                         // values of known registers
+	std::vector<bool> sknown;                  // scalar register has a known value
+	std::vector<bool> vknown;                  // vector register has a known value
+	std::vector<long> vsize;                   // known vector size, or -1
+	std::vector<double> input;                 // placeholder for the input
+	std::map<int, int> smap;                   // merged scalar registers
+	std::map<int, int> vmap;                   // merged vector registers
+	std::map<double, int, Less> scalarConstant; // distinct scalar constants
+	std::vector<int> vectorConstant;            // distinct vector constants
+	std::vector<OperandRef> ops;
+};
+
+}
+
+// two instructions compute the same result
+static bool equivalent(Program const& program, Instruction const& x, Instruction const& y)
+{
+	if (x.op != y.op || x.a != y.a || x.b != y.b || x.c != y.c || x.f != y.f) return false;
+	if (memcmp(&x.imm, &y.imm, sizeof(double)) != 0) return false;
+	if (x.op == opVCompose)
+	{
+		std::vector<Operand> const& p = program.composition[x.a];
+		std::vector<Operand> const& q = program.composition[y.a];
+		if (p.size() != q.size()) return false;
+		for (size_t k=0; k<p.size(); k++) if (p[k].isVector != q[k].isVector || p[k].reg != q[k].reg) return false;
+	}
+	return true;
+}
+
+Program specialize(Program const& original, std::size_t dimension)
+{
+	Specializer sp(original, dimension);
+	Program& program = sp.program;
+
+	// constant folding and common subexpressions
+	std::vector<Instruction> code;
+	std::vector<Instruction> const& main = original.block[0];
+	for (size_t k=0; k<main.size(); k++)
+	{
+		Instruction in = main[k];
+		if (in.op == opVCompose)
+		{
+			// compositions are not shared, such that rewriting is local
+			program.composition.push_back(program.composition[in.a]);
+			in.a = (int)program.composition.size() - 1;
+		}
+		sp.rewrite(in);
+		if (in.op == opVApply) sp.rewriteLambda(in.b);
+		if (sp.fold(in)) continue;
+		size_t j = 0;
+		for (; j<code.size(); j++) if (equivalent(program, code[j], in)) break;
+		if (j < code.size())
+		{
+			(in.op >= opVNeg ? sp.vmap : sp.smap)[in.dst] = code[j].dst;
+			continue;
+		}
+		if (in.op >= opVNeg) sp.vsize[in.dst] = sp.resultSize(in);
+		code.push_back(in);
+	}
+	std::map<int, int>::const_iterator it = sp.smap.find(program.result);
+	if (it != sp.smap.end()) program.result = it->second;
+
+	// uses of vector registers
+	std::vector<OperandRef> ops;
+	std::vector<int> uses(program.vectors, 0);
+	for (size_t k=0; k<code.size(); k++)
+	{
+		operands(program, code[k], ops);
+		if (code[k].op == opVApply) externals(program, code[k].b, ops);
+		for (size_t j=0; j<ops.size(); j++) if (ops[j].isVector) uses[*ops[j].reg]++;
+	}
+
+	// fuse a * b + c and a * b - c
+	std::map<int, size_t> scale;               // vector register -> opVScale instruction
+	for (size_t k=0; k<code.size(); k++)
+	{
+		Instruction& in = code[k];
+		if (in.op == opVScale) scale[in.dst] = k;
+		else if (in.op == opVAdd || in.op == opVSub)
+		{
+			int other = in.b;
+			std::map<int, size_t>::const_iterator s = scale.find(in.a);
+			if ((s == scale.end() || uses[in.a] != 1) && in.op == opVAdd)
+			{
+				other = in.a;
+				s = scale.find(in.b);
+			}
+			if (s == scale.end() || uses[code[s->second].dst] != 1) continue;
+			Instruction const& m = code[s->second];
+			in.op = (in.op == opVAdd) ? opVScaleAdd : opVScaleSub;
+			in.c = other;
+			in.a = m.a;
+			in.b = m.b;
+		}
+	}
+
+	// drop unused results
+	std::vector<bool> slive(program.scalars, false), vlive(program.vectors, false);
+	slive[program.result] = true;
+	std::vector<Instruction> live;
+	for (size_t k=code.size(); k>0; k--)
+	{
+		Instruction& in = code[k-1];
+		bool vec = (in.op >= opVNeg);
+		if (! mayThrow(in.op) && ! (vec ? vlive[in.dst] : slive[in.dst])) continue;
+		operands(program, in, ops);
+		if (in.op == opVApply) externals(program, in.b, ops);
+		for (size_t j=0; j<ops.size(); j++) (ops[j].isVector ? vlive : slive)[*ops[j].reg] = true;
+		live.push_back(in);
+	}
+	std::reverse(live.begin(), live.end());
+	program.block[0] = live;
+
+	// static shapes
+	for (size_t k=0; k<live.size(); k++)
+	{
+		int r = live[k].dst;
+		if (live[k].op >= opVNeg && sp.vsize[r] >= 0) program.shape.push_back(make_pair(r, (size_t)sp.vsize[r]));
+	}
+
+	// drop unused constants
+	std::vector< std::pair<int, double> > sc;
+	for (size_t k=0; k<program.scalarConstant.size(); k++) if (slive[program.scalarConstant[k].first]) sc.push_back(program.scalarConstant[k]);
+	program.scalarConstant.swap(sc);
+	std::vector< std::pair<int, Vector> > vc;
+	for (size_t k=0; k<program.vectorConstant.size(); k++) if (vlive[program.vectorConstant[k].first]) vc.push_back(program.vectorConstant[k]);
+	program.vectorConstant.swap(vc);
+
+	return program;
+}
+
+
+////////////////////////////////////////////////////////////
+// ahead-of-time compilation
+//
+
+static void hashValue(uint64_t& h, long long value)
+{
+	for (int i=0; i<8; i++)
+	{
+		h ^= (uint64_t)((value >> (8 * i)) & 0xff);
+		h *= 1099511628211ull;
+	}
+}
+
+uint64_t structureHash(Program const& program)
+{
+	uint64_t h = 14695981039346656037ull;
+	hashValue(h, program.scalars);
+	hashValue(h, program.vectors);
+	hashValue(h, program.result);
+	hashValue(h, program.block.size());
+	for (size_t b=0; b<program.block.size(); b++)
+	{
+		std::vector<Instruction> const& code = program.block[b];
+		hashValue(h, code.size());
+		for (size_t k=0; k<code.size(); k++)
+		{
+			hashValue(h, code[k].op);
+			hashValue(h, code[k].dst);
+			hashValue(h, code[k].a);
+			hashValue(h, code[k].b);
+			hashValue(h, code[k].c);
+		}
+	}
+	hashValue(h, program.lambda.size());
+	for (size_t k=0; k<program.lambda.size(); k++)
+	{
+		hashValue(h, program.lambda[k].block);
+		hashValue(h, program.lambda[k].argument);
+		hashValue(h, program.lambda[k].result);
+		hashValue(h, program.lambda[k].vectorized);
+	}
+	hashValue(h, program.composition.size());
+	for (size_t k=0; k<program.composition.size(); k++)
+	{
+		hashValue(h, program.composition[k].size());
+		for (size_t j=0; j<program.composition[k].size(); j++)
+		{
+			hashValue(h, program.composition[k][j].isVector);
+			hashValue(h, program.composition[k][j].reg);
+		}
+	}
+	hashValue(h, program.scalarConstant.size());
+	for (size_t k=0; k<program.scalarConstant.size(); k++) hashValue(h, program.scalarConstant[k].first);
+	hashValue(h, program.vectorConstant.size());
+	for (size_t k=0; k<program.vectorConstant.size(); k++) hashValue(h, program.vectorConstant[k].first);
+	return h;
+}
+
+namespace {
+
+// Translation of a program into a C++ function. Instructions of the main
+// block not depending on the values of the input are executed on the
+// first call only; their results are kept in the scalar and vector
+// registers. All other scalars live in local variables. Apply statements
+// with bodies suitable for lane execution are left to the interpreter.
+struct SourceGenerator
+{
+	SourceGenerator(Program const& original)
+	: program(original)
+	, sinvariant(original.scalars, false)
+	, vinvariant(original.vectors, false)
+	, local(original.scalars, false)
+	{
+		for (size_t k=0; k<program.scalarConstant.size(); k++) sinvariant[program.scalarConstant[k].first] = true;
+		for (size_t k=0; k<program.vectorConstant.size(); k++) vinvariant[program.vectorConstant[k].first] = true;
+
+		// instructions depending on the input only through its dimension
+		std::vector<Instruction>& code = program.block[0];
+		invariant.resize(code.size(), false);
+		std::vector<OperandRef> ops;
+		for (size_t k=0; k<code.size(); k++)
+		{
+			Instruction& in = code[k];
+			operands(program, in, ops);
+			if (in.op == opVApply) externals(program, in.b, ops);
+			bool inv = true;
+			for (size_t j=0; j<ops.size(); j++)
+			{
+				int r = *ops[j].reg;
+				if (in.op == opSDim && r == 0) continue;
+				if (! (ops[j].isVector ? vinvariant[r] : sinvariant[r])) inv = false;
+			}
+			invariant[k] = inv;
+			if (inv) (in.op >= opVNeg ? vinvariant : sinvariant)[in.dst] = true;
+		}
+
+		// blocks translated into C++, bodies executed on lanes are left to the interpreter
+		std::vector<size_t> emitted(1, 0);
+		for (size_t i=0; i<emitted.size(); i++)
+		{
+			std::vector<Instruction>& block = program.block[emitted[i]];
+			for (size_t k=0; k<block.size(); k++)
+			{
+				if (block[k].op == opVApply && ! program.lambda[block[k].b].vectorized) emitted.push_back(program.lambda[block[k].b].block);
+			}
+		}
+
+		// scalars computed for every input and read afterwards are kept in locals,
+		// except for operands of apply statements executed on lanes
+		std::vector<bool> written(program.scalars, false), read(program.scalars, false), shared(program.scalars, false);
+		for (size_t i=0; i<emitted.size(); i++)
+		{
+			size_t b = emitted[i];
+			std::vector<Instruction>& block = program.block[b];
+			for (size_t k=0; k<block.size(); k++)
+			{
+				Instruction& in = block[k];
+				if (in.op < opVNeg && (b > 0 || ! invariant[k])) written[in.dst] = true;
+				operands(program, in, ops);
+				for (size_t j=0; j<ops.size(); j++) if (! ops[j].isVector) read[*ops[j].reg] = true;
+				if (in.op != opVApply) continue;
+				Lambda const& l = program.lambda[in.b];
+				if (l.vectorized)
+				{
+					ops.clear();
+					externals(program, in.b, ops);
+					for (size_t j=0; j<ops.size(); j++) if (! ops[j].isVector) shared[*ops[j].reg] = true;
+				}
+				else
+				{
+					written[l.argument] = true;
+					read[l.result] = true;
+				}
+			}
+		}
+		read[program.result] = true;
+		for (int r=0; r<program.scalars; r++) local[r] = written[r] && read[r] && ! shared[r];
+	}
+
+	std::string s(int r) const
+	{
+		std::ostringstream os;
+		if (local[r]) os << "r" << r;
+		else os << "s[" << r << "]";
+		return os.str();
+	}
+	static std::string vp(int r)
+	{
+		std::ostringstream os;
+		os << "reg.vp[" << r << "]";
+		return os.str();
+	}
+	static std::string vn(int r)
+	{
+		std::ostringstream os;
+		os << "reg.vn[" << r << "]";
+		return os.str();
+	}
+
+	// instruction k of block b, with the given indentation
+	void instruction(std::ostream& os, size_t b, size_t k, std::string const& ind) const
+	{
+		Instruction const& in = program.block[b][k];
+		std::string d = (in.op >= opVNeg) ? "" : s(in.dst);
+		switch (in.op)
+		{
+		case opSNeg:
+			os << ind << d << " = -" << s(in.a) << ";\n";
+			break;
+		case opSAdd:
+			os << ind << d << " = " << s(in.a) << " + " << s(in.b) << ";\n";
+			break;
+		case opSSub:
+			os << ind << d << " = " << s(in.a) << " - " << s(in.b) << ";\n";
+			break;
+		case opSMul:
+			os << ind << d << " = " << s(in.a) << " * " << s(in.b) << ";\n";
+			break;
+		case opSDiv:
+			os << ind << d << " = " << s(in.a) << " / " << s(in.b) << ";\n";
+			break;
+		case opSPow:
+			os << ind << d << " = mathPow(" << s(in.a) << ", " << s(in.b) << ");\n";
+			break;
+		case opSFunc:
+			os << ind << d << " = program.block[" << b << "][" << k << "].f(" << s(in.a) << ");\n";
+			break;
+		case opSDim:
+			os << ind << d << " = (double)" << vn(in.a) << ";\n";
+			break;
+		case opSEntry:
+			os << ind << "{\n";
+			os << ind << "\tint i = (int)std::floor(" << s(in.b) << ");\n";
+			os << ind << "\tif (i < 1 || i > (int)" << vn(in.a) << ") throw std::runtime_error(\"index out of bounds\");\n";
+			os << ind << "\t" << d << " = " << vp(in.a) << "[i - 1];\n";
+			os << ind << "}\n";
+			break;
+		case opSDot:
+			os << ind << d << " = kernelDot(" << vp(in.a) << ", " << vp(in.b) << ", " << vn(in.a) << ");\n";
+			break;
+		case opSSum:
+			os << ind << d << " = kernelSum(" << vp(in.a) << ", " << vn(in.a) << ");\n";
+			break;
+		case opSProd:
+			os << ind << d << " = kernelProduct(" << vp(in.a) << ", " << vn(in.a) << ");\n";
+			break;
+		case opSNorm:
+			os << ind << d << " = std::sqrt(kernelSqrNorm(" << vp(in.a) << ", " << vn(in.a) << "));\n";
+			break;
+		case opSSqrNorm:
+			os << ind << d << " = kernelSqrNorm(" << vp(in.a) << ", " << vn(in.a) << ");\n";
+			break;
+		case opSMin:
+			os << ind << d << " = minimum(" << vp(in.a) << ", " << vn(in.a) << ");\n";
+			break;
+		case opSMax:
+			os << ind << d << " = maximum(" << vp(in.a) << ", " << vn(in.a) << ");\n";
+			break;
+		case opVNeg:
+			os << ind << "kernelNeg(reg.vector(" << in.dst << ", " << vn(in.a) << "), " << vp(in.a) << ", " << vn(in.a) << ");\n";
+			break;
+		case opVAdd:
+		case opVSub:
+		case opVEMul:
+		case opVEDiv:
+		case opVEPowV:
+		{
+			const char* f = (in.op == opVAdd) ? "kernelAdd" : (in.op == opVSub) ? "kernelSub" : (in.op == opVEMul) ? "kernelMul" : (in.op == opVEDiv) ? "kernelDiv" : "kernelPow";
+			os << ind << f << "(reg.vector(" << in.dst << ", " << vn(in.a) << "), " << vp(in.a) << ", " << vp(in.b) << ", " << vn(in.a) << ");\n";
+			break;
+		}
+		case opVScale:
+		case opVDiv:
+		case opVEPowS:
+		{
+			const char* f = (in.op == opVScale) ? "kernelScale" : (in.op == opVDiv) ? "kernelDivide" : "kernelPow";
+			os << ind << f << "(reg.vector(" << in.dst << ", " << vn(in.a) << "), " << vp(in.a) << ", " << s(in.b) << ", " << vn(in.a) << ");\n";
+			break;
+		}
+		case opVScaleAdd:
+		case opVScaleSub:
+		{
+			const char* f = (in.op == opVScaleAdd) ? "kernelScaleAdd" : "kernelScaleSub";
+			os << ind << f << "(reg.vector(" << in.dst << ", " << vn(in.a) << "), " << vp(in.a) << ", " << s(in.b) << ", " << vp(in.c) << ", " << vn(in.a) << ");\n";
+			break;
+		}
+		case opVCompose:
+		{
+			std::vector<Operand> const& parts = program.composition[in.a];
+			size_t scalars = 0;
+			for (size_t j=0; j<parts.size(); j++) if (! parts[j].isVector) scalars++;
+			os << ind << "{\n";
+			os << ind << "\tdouble* d = reg.vector(" << in.dst << ", " << scalars;
+			for (size_t j=0; j<parts.size(); j++) if (parts[j].isVector) os << " + " << vn(parts[j].reg);
+			os << ");\n";
+			for (size_t j=0; j<parts.size(); j++)
+			{
+				if (parts[j].isVector) os << ind << "\tfor (size_t i=0; i<" << vn(parts[j].reg) << "; i++) *d++ = " << vp(parts[j].reg) << "[i];\n";
+				else os << ind << "\t*d++ = " << s(parts[j].reg) << ";\n";
+			}
+			os << ind << "}\n";
+			break;
+		}
+		case opVRange:
+			os << ind << "{\n";
+			os << ind << "\tint f = (int)std::floor(" << s(in.b) << ");\n";
+			os << ind << "\tint l = (int)std::floor(" << s(in.c) << ");\n";
+			os << ind << "\tint size = l - f + 1;\n";
+			os << ind << "\tif (f < 1 || l > (int)" << vn(in.a) << " || size < 0) throw std::runtime_error(\"dimension mismatch\");\n";
+			os << ind << "\tdouble* d = reg.vector(" << in.dst << ", (size_t)size);\n";
+			os << ind << "\tconst double* a = " << vp(in.a) << " + (f - 1);\n";
+			os << ind << "\tfor (int i=0; i<size; i++) d[i] = a[i];\n";
+			os << ind << "}\n";
+			break;
+		case opVFill:
+		case opVIota:
+			os << ind << "{\n";
+			os << ind << "\tint size = (int)std::floor(" << s(in.a) << ");\n";
+			os << ind << "\tif (size < 0) throw std::runtime_error(\"dimension must be non-negative\");\n";
+			os << ind << "\tdouble* d = reg.vector(" << in.dst << ", (size_t)size);\n";
+			if (in.op == opVFill) os << ind << "\tfor (int i=0; i<size; i++) d[i] = program.block[" << b << "][" << k << "].imm;\n";
+			else os << ind << "\tfor (int i=0; i<size; i++) d[i] = i + 1;\n";
+			os << ind << "}\n";
+			break;
+		case opVApply:
+		{
+			Lambda const& l = program.lambda[in.b];
+			if (l.vectorized)
+			{
+				os << ind << "step(program, reg, program.block[" << b << "][" << k << "]);\n";
+				break;
+			}
+			os << ind << "{\n";
+			os << ind << "\tsize_t n = " << vn(in.a) << ";\n";
+			os << ind << "\tdouble* d = reg.vector(" << in.dst << ", n);\n";
+			os << ind << "\tconst double* a = " << vp(in.a) << ";\n";
+			os << ind << "\tfor (size_t i=0; i<n; i++)\n";
+			os << ind << "\t{\n";
+			os << ind << "\t\t" << s(l.argument) << " = a[i];\n";
+			for (size_t j=0; j<program.block[l.block].size(); j++) instruction(os, l.block, j, ind + "\t\t");
+			os << ind << "\t\td[i] = " << s(l.result) << ";\n";
+			os << ind << "\t}\n";
+			os << ind << "}\n";
+			break;
+		}
+		}
+	}
+
+	void function(std::ostream& out, std::string const& name) const
+	{
+		std::vector<Instruction> const& code = program.block[0];
+		bool fallible = false;
+		for (size_t k=0; k<code.size(); k++) if (invariant[k] && mayThrow(code[k].op)) fallible = true;
+
+		std::ostringstream os;
+		for (int r=0; r<program.scalars; r++) if (local[r]) os << "\tdouble r" << r << " = 0.0;\n";
+		os << "\treg.vp[0] = x.data();\n";
+		os << "\treg.vn[0] = x.size();\n";
+		if (fallible)
+		{
+			os << "\tsize_t stage = 0;\n";
+			os << "\tstd::exception_ptr error;\n";
+		}
+		os << "\tif (! reg.prepared)\n";
+		os << "\t{\n";
+		std::string ind = "\t\t";
+		if (fallible)
+		{
+			os << "\t\ttry\n";
+			os << "\t\t{\n";
+			ind = "\t\t\t";
+		}
+		for (size_t k=0; k<code.size(); k++)
+		{
+			if (! invariant[k]) continue;
+			if (fallible && mayThrow(code[k].op)) os << ind << "stage = " << k + 1 << ";\n";
+			instruction(os, 0, k, ind);
+		}
+		if (fallible) os << ind << "stage = 0;\n";
+		os << ind << "reg.prepared = true;\n";
+		if (fallible)
+		{
+			os << "\t\t}\n";
+			os << "\t\tcatch (...)\n";
+			os << "\t\t{\n";
+			os << "\t\t\terror = std::current_exception();\n";
+			os << "\t\t}\n";
+		}
+		os << "\t}\n";
+		for (size_t k=0; k<code.size(); k++)
+		{
+			if (! invariant[k]) instruction(os, 0, k, "\t");
+			else if (fallible && mayThrow(code[k].op)) os << "\tif (stage == " << k + 1 << ") std::rethrow_exception(error);\n";
+		}
+		os << "\treturn " << s(program.result) << ";\n";
+
+		out << "static double " << name << "(Program const& program, Registers& reg, Vector const& x)\n";
+		out << "{\n";
+		if (os.str().find("s[") != std::string::npos) out << "\tdouble* s = reg.s.data();\n";
+		out << os.str();
+		out << "}\n";
+	}
+
+	Program program;
+	std::vector<bool> invariant;       // instructions of the main block executed on the first call only
+	std::vector<bool> sinvariant;      // scalar registers not depending on the values of the input
+	std::vector<bool> vinvariant;      // vector registers not depending on the values of the input
+	std::vector<bool> local;           // scalar registers kept in local variables
+};
+
+}
+
+std::string generateSource(Program const& program, std::string const& function)
+{
+	std::ostringstream os;
+	SourceGenerator gen(program);
+	gen.function(os, function);
+	return os.str();
+}
@@ -0,0 +1,251 @@
+
+#pragma once
+
+
+//
+// Bytecode Interpreter
+// --------------------
+//
+// The expression tree created by the parser (see interpreter.h) is
+// lowered into a flat program operating on two register files, one for
+// scalars and one for vectors. Every node of the tree is assigned its
+// own register, constants are preloaded into registers, and auxiliary
+// variables simply alias the register of their defining expression.
+// The body of an "apply" statement is compiled into a separate block
+// of instructions, which is executed once per vector component.
+//
+// Bodies consisting of scalar arithmetic, function calls, and vector
+// entries are instead executed on whole arrays of components ("lanes"):
+// instructions not depending on the component are executed once, all
+// other instructions are executed for blocks of components at a time,
+// using the array kernels of kernels.h and vecmath.h. Since these apply
+// the same operations to every component, the results coincide with
+// those of component-wise execution.
+//
+// Registers are allocated once and reused across evaluations, hence
+// in steady state the evaluation of a program does not allocate memory
+// (as long as vector dimensions do not grow). Registers of vectors with
+// sizes known at compile time (see specialize) are allocated upfront.
+// The program is executed by a single switch-based dispatch loop.
+//
+// The instructions replicate the arithmetic of the tree interpreter
+// operation by operation, hence results coincide bit for bit.
+//
+
+
+#include <vector>
+#include <map>
+#include <string>
+#include <cstddef>
+#include <cstdint>
+
+#include "vector.h"
+
+
+typedef double(*ScalarFunction)(double);
+
+
+enum Opcode
+{
+	// scalar results
+	opSNeg,        // dst = -a
+	opSAdd,        // dst = a + b
+	opSSub,        // dst = a - b
+	opSMul,        // dst = a * b
+	opSDiv,        // dst = a / b
+	opSPow,        // dst = pow(a, b)
+	opSFunc,       // dst = f(a)
+	opSDim,        // dst = dim(va)
+	opSEntry,      // dst = va[floor(b)]
+	opSDot,        // dst = va * vb
+	opSSum,        // dst = sum(va)
+	opSProd,       // dst = prod(va)
+	opSNorm,       // dst = norm(va)
+	opSSqrNorm,    // dst = sqrnorm(va)
+	opSMin,        // dst = min(va)
+	opSMax,        // dst = max(va)
+
+	// vector results
+	opVNeg,        // vdst = -va
+	opVAdd,        // vdst = va + vb
+	opVSub,        // vdst = va - vb
+	opVScale,      // vdst = va * b
+	opVDiv,        // vdst = va / b
+	opVEMul,       // vdst = va .* vb
+	opVEDiv,       // vdst = va ./ vb
+	opVEPowS,      // vdst = va .^ b
+	opVEPowV,      // vdst = va .^ vb
+	opVScaleAdd,   // vdst = va * b + vc
+	opVScaleSub,   // vdst = va * b - vc
+	opVCompose,    // vdst = [...], parts listed in composition a
+	opVRange,      // vdst = va[floor(b):floor(c)]
+	opVFill,       // vdst = imm * ones(floor(a))
+	opVIota,       // vdst = range(floor(a))
+	opVApply,      // vdst = apply(va, lambda b)
+};
+
+
+struct Instruction
+{
+	Opcode op;
+	int dst;
+	int a;
+	int b;
+	int c;
+	double imm;
+	ScalarFunction f;
+};
+
+
+// Operand of a vector composition.
+struct Operand
+{
+	bool isVector;
+	int reg;
+};
+
+
+// Body of an "apply" statement.
+struct Lambda
+{
+	std::size_t block;             // instructions of the body
+	int argument;                  // scalar register receiving the vector component
+	int result;                    // scalar register holding the result
+
+	// lane execution, see above
+	bool vectorized;                                   // body is executed on lanes
+	std::size_t invariant;                             // block of instructions independent of the component
+	std::vector<Instruction> laneCode;                 // instructions operating on lanes instead of scalar registers
+	std::vector< std::pair<int, int> > broadcast;      // lanes filled with the value of a scalar register
+	int lanes;                                         // number of lanes, lane 0 receives the components
+	int resultLane;                                    // lane holding the result, or -1 for the result register
+};
+
+
+// Compiled expression, not modified during evaluation.
+struct Program
+{
+	Program()
+	: scalars(0)
+	, vectors(1)
+	, result(-1)
+	{ }
+
+	std::vector< std::vector<Instruction> > block;         // block 0 is the main program
+	std::vector<Lambda> lambda;                            // bodies of apply statements
+	std::vector< std::vector<Operand> > composition;       // operands of vector compositions
+	std::vector< std::pair<int, double> > scalarConstant;  // preloaded scalar registers
+	std::vector< std::pair<int, Vector> > vectorConstant;  // preloaded vector registers
+	std::vector< std::pair<int, std::size_t> > shape;      // vector registers of static size
+	int scalars;                                           // number of scalar registers
+	int vectors;                                           // number of vector registers, register 0 holds the input
+	int result;                                            // scalar register holding the result
+};
+
+
+// Register files for the evaluation of a program.
+struct Registers
+{
+	Registers()
+	: prepared(false)
+	{ }
+
+	explicit Registers(Program const& program);
+
+	// prepare vector register r for holding n components
+	double* vector(int r, std::size_t n)
+	{
+		std::vector<double>& b = vbuf[r];
+		b.resize(n);
+		vp[r] = b.data();
+		vn[r] = n;
+		return b.data();
+	}
+
+	std::vector<double> s;                       // scalar registers
+	std::vector<const double*> vp;               // vector registers: data
+	std::vector<std::size_t> vn;                 // vector registers: size
+	std::vector< std::vector<double> > vbuf;     // vector registers: storage
+	std::vector<double> lanes;                   // lanes of apply statements
+	bool prepared;                               // input-independent part of compiled code is done
+};
+
+
+// Lowering of expression trees into programs. The nodes of the tree
+// call the emitter functions, which return the register holding the
+// result of the node.
+class Compiler
+{
+public:
+	Compiler(Program& program);
+
+	int scalar();
+	int vector();
+	int constant(double value);
+	int constant(Vector const& value);
+	int input() const
+	{ return 0; }
+
+	void emit(Opcode op, int dst, int a = -1, int b = -1, int c = -1, double imm = 0.0, ScalarFunction f = nullptr);
+	int composition(std::vector<Operand> const& operands);
+
+	// lambda bodies are emitted between beginLambda and endLambda
+	void beginLambda();
+	int argument() const;
+	int endLambda(int result);
+
+	// registers of auxiliary variables
+	void bind(const void* variable, int reg);
+	int lookup(const void* variable) const;
+
+private:
+	Program& m_program;
+	std::vector<std::size_t> m_block;       // stack of active blocks
+	std::vector<int> m_argument;            // stack of lambda arguments
+	std::map<const void*, int> m_variable;
+};
+
+
+// Optimize a program for inputs of the given dimension. With dim(x)
+// known, all instructions not depending on the values of x are executed
+// once, and their results become constants; this includes vectors like
+// ones(d) and range(d), and apply statements over such vectors. Repeated
+// computations are merged, multiplications by a scalar followed by an
+// addition or subtraction are fused, and unused results are dropped.
+// Squares x^2 become multiplications if the current math mode computes
+// them as such (see vecmath.h). All other transformations preserve the
+// results bit for bit. The optimized program is valid for inputs of the
+// given dimension only, and it reflects the summation and math modes at
+// the time of optimization.
+Program specialize(Program const& program, std::size_t dimension);
+
+// Evaluate a program. The registers must have been set up for the program.
+double execute(Program const& program, Registers& registers, Vector const& x);
+
+// Execute a single instruction of the main block, with the registers in
+// the state of an ongoing evaluation.
+void step(Program const& program, Registers& registers, Instruction const& instruction);
+
+// Ahead-of-time compilation: C++ source of a static function evaluating
+// the program, with the signature of CompiledProgram (see generate.cpp).
+// Instructions not depending on the values of the input are executed on
+// the first call with a given set of registers only, hence the registers
+// must not be used for inputs of different dimensions. Scalar functions,
+// fill values, and constants are taken from the program and the
+// registers at run time, hence the code applies to every program of the
+// same structure, as identified by structureHash.
+std::string generateSource(Program const& program, std::string const& function);
+std::uint64_t structureHash(Program const& program);
+
+typedef double (*CompiledProgram)(Program const& program, Registers& registers, Vector const& x);
+
+struct PrecompiledProgram
+{
+	const char* name;              // name of the function in problems.json
+	std::uint64_t structure;       // structure hash of the program
+	CompiledProgram function;
+};
+
+// table of functions generated from problems.json at build time
+extern const PrecompiledProgram precompiledPrograms[];
+extern const std::size_t precompiledProgramCount;
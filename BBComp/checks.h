@@ -0,0 +1,73 @@
+
+#pragma once
+
+
+//
+// Scaffolding of the check programs (gradcheck, jitcheck,
+// precompiledcheck), which validate all functions defined in a
+// problems.json file and report those that fail.
+//
+
+
+#include "json.h"
+#include "interpreter.h"
+
+#include <string>
+#include <iostream>
+#include <iomanip>
+#include <stdexcept>
+#include <cstring>
+
+
+// value of an evaluation, or the error it raised
+struct Result
+{
+	double value;
+	std::string error;
+
+	bool operator == (Result const& other) const
+	{ return std::memcmp(&value, &other.value, sizeof(double)) == 0 && error == other.error; }
+	bool operator != (Result const& other) const
+	{ return ! (*this == other); }
+};
+
+template <typename F>
+Result result(F f)
+{
+	Result ret;
+	ret.value = 0.0;
+	try { ret.value = f(); }
+	catch (std::exception const& e) { ret.error = e.what(); }
+	return ret;
+}
+
+// Call check(name, expression, info) for every function in the file.
+// It returns a description of the problem, or an empty string if the
+// function passes; info is reported for functions that pass. Prints
+// one line per reported function and a summary, and returns the exit
+// code of the program.
+template <typename F>
+int checkFunctions(const char* filename, F check)
+{
+	Json dict;
+	if (! dict.load(filename)) { std::cerr << "failed to load " << filename << std::endl; return 1; }
+
+	std::size_t functions = 0, failed = 0;
+	for (Json::object_iterator it = dict.object_begin(); it != dict.object_end(); ++it)
+	{
+		std::string name = it->first;
+		std::string info;
+		std::string problem = check(name, parse(it->second.asString()), info);
+		functions++;
+
+		if (! problem.empty())
+		{
+			failed++;
+			std::cout << std::setw(36) << std::left << name << problem << std::endl;
+		}
+		else if (! info.empty()) std::cout << std::setw(36) << std::left << name << info << std::endl;
+	}
+
+	std::cout << functions << " functions, " << failed << " failed" << std::endl;
+	return (failed == 0) ? 0 : 1;
+}
@@ -0,0 +1,103 @@
+
+#include "json.h"
+#include "interpreter.h"
+#include <iostream>
+#include <sstream>
+#include <iomanip>
+#include <stdexcept>
+#include <vector>
+#include <string>
+
+
+using namespace std;
+
+
+// This program translates the functions defined in a problems.json
+// file into C++ source, one function per entry, and writes the source
+// together with the table precompiledPrograms (see bytecode.h) to the
+// standard output. The makefile compiles the result into the library.
+//
+// usage: generate problems.json > precompiled.cpp
+
+
+// C++ string literal
+string literal(string const& s)
+{
+	string ret = "\"";
+	for (size_t i=0; i<s.size(); i++)
+	{
+		if (s[i] == '"' || s[i] == '\\') ret += '\\';
+		ret += s[i];
+	}
+	return ret + "\"";
+}
+
+int main(int argc, char** argv)
+{
+	if (argc != 2) { cerr << "usage: " << argv[0] << " problems.json" << endl; return 1; }
+
+	Json dict;
+	if (! dict.load(argv[1])) { cerr << "failed to load " << argv[1] << endl; return 1; }
+
+	cout << "// generated from " << argv[1] << " by generate.cpp, do not edit\n";
+	cout << "\n";
+	cout << "#include \"bytecode.h\"\n";
+	cout << "#include \"kernels.h\"\n";
+	cout << "#include \"vecmath.h\"\n";
+	cout << "#include <stdexcept>\n";
+	cout << "#include <exception>\n";
+	cout << "#include <algorithm>\n";
+	cout << "#include <limits>\n";
+	cout << "#include <cmath>\n";
+	cout << "\n";
+	cout << "\n";
+	cout << "static inline double minimum(const double* a, std::size_t n)\n";
+	cout << "{\n";
+	cout << "\tdouble ret = (n > 0) ? a[0] : std::numeric_limits<double>::quiet_NaN();\n";
+	cout << "\tfor (std::size_t i=1; i<n; i++) ret = std::min(ret, a[i]);\n";
+	cout << "\treturn ret;\n";
+	cout << "}\n";
+	cout << "\n";
+	cout << "static inline double maximum(const double* a, std::size_t n)\n";
+	cout << "{\n";
+	cout << "\tdouble ret = (n > 0) ? a[0] : std::numeric_limits<double>::quiet_NaN();\n";
+	cout << "\tfor (std::size_t i=1; i<n; i++) ret = std::max(ret, a[i]);\n";
+	cout << "\treturn ret;\n";
+	cout << "}\n";
+
+	vector<string> table;
+	for (Json::object_iterator it = dict.object_begin(); it != dict.object_end(); ++it)
+	{
+		string name = it->first;
+		ExpressionPtr ex;
+		try
+		{
+			ex = parse(it->second.asString());
+		}
+		catch (exception const& e)
+		{
+			cerr << "error while compiling function '" << name << "': " << e.what() << endl;
+			return 1;
+		}
+		ostringstream function;
+		function << "function" << table.size();
+		uint64_t structure = 0;
+		cout << "\n";
+		cout << "// " << name << "\n";
+		cout << generateSource(ex, function.str(), structure);
+
+		ostringstream entry;
+		entry << "\t{ " << literal(name) << ", 0x" << hex << setw(16) << setfill('0') << structure << "ull, " << function.str() << " },\n";
+		table.push_back(entry.str());
+	}
+
+	cout << "\n";
+	cout << "const PrecompiledProgram precompiledPrograms[] =\n";
+	cout << "{\n";
+	for (size_t i=0; i<table.size(); i++) cout << table[i];
+	cout << "\t{ nullptr, 0, nullptr },\n";
+	cout << "};\n";
+	cout << "\n";
+	cout << "const std::size_t precompiledProgramCount = " << table.size() << ";\n";
+	return 0;
+}
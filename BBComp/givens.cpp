@@ -0,0 +1,73 @@
+
+#include "givens.h"
+#include "kernels.h"
+
+#include <algorithm>
+#include <cassert>
+
+
+using namespace std;
+
+
+GivensRotations::GivensRotations(size_t dimension, vector<unsigned int> const& axis1, vector<unsigned int> const& axis2, vector<double> const& sin, vector<double> const& cos)
+: m_dimension(dimension)
+{
+	size_t n = axis1.size();
+	assert(axis2.size() == n && sin.size() == n && cos.size() == n);
+
+	// earliest layer of every rotation
+	vector<size_t> free(dimension, 0), layer(n);
+	size_t layers = 0;
+	for (size_t k=0; k<n; k++)
+	{
+		assert(axis1[k] < dimension && axis2[k] < dimension && axis1[k] != axis2[k]);
+		size_t l = std::max(free[axis1[k]], free[axis2[k]]);
+		layer[k] = l;
+		free[axis1[k]] = free[axis2[k]] = l + 1;
+		layers = std::max(layers, l + 1);
+	}
+
+	// sort the rotations by layer, keeping their order within layers
+	m_layer.assign(layers + 1, 0);
+	for (size_t k=0; k<n; k++) m_layer[layer[k] + 1]++;
+	for (size_t l=0; l<layers; l++) m_layer[l + 1] += m_layer[l];
+	vector<size_t> pos(m_layer.begin(), m_layer.end() - 1);
+	m_axis1.resize(n);
+	m_axis2.resize(n);
+	m_sin.resize(n);
+	m_cos.resize(n);
+	for (size_t k=0; k<n; k++)
+	{
+		size_t p = pos[layer[k]]++;
+		m_axis1[p] = axis1[k];
+		m_axis2[p] = axis2[k];
+		m_sin[p] = sin[k];
+		m_cos[p] = cos[k];
+	}
+}
+
+void GivensRotations::apply(double* x) const
+{
+	// short layers do not pay off, the plain loop is faster then
+	if (m_axis1.size() < 8 * layers())
+	{
+		for (size_t k=0; k<m_axis1.size(); k++)
+		{
+			double a = x[m_axis1[k]];
+			double b = x[m_axis2[k]];
+			x[m_axis1[k]] = m_cos[k] * a - m_sin[k] * b;
+			x[m_axis2[k]] = m_sin[k] * a + m_cos[k] * b;
+		}
+		return;
+	}
+	for (size_t l=0; l+1<m_layer.size(); l++)
+	{
+		size_t b = m_layer[l], e = m_layer[l + 1];
+		kernelGivens(x, &m_axis1[b], &m_axis2[b], &m_sin[b], &m_cos[b], e - b);
+	}
+}
+
+void GivensRotations::applyBatch(double* x, size_t stride, size_t count) const
+{
+	for (size_t k=0; k<m_axis1.size(); k++) kernelRotate(x + m_axis1[k] * stride, x + m_axis2[k] * stride, m_sin[k], m_cos[k], count);
+}
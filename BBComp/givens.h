@@ -0,0 +1,65 @@
+
+#pragma once
+
+
+//
+// Givens Rotations
+// ----------------
+//
+// A sequence of Givens rotations, each acting on two coordinates:
+//     x[i] = cos * x[i] - sin * x[j]
+//     x[j] = sin * x[i] + cos * x[j]
+// (with the old values on the right hand sides). Applied one by one,
+// every rotation depends on its predecessor through scattered indices.
+//
+// The sequence is precompiled into layers: every rotation is placed in
+// the first layer after those of all earlier rotations sharing one of
+// its coordinates. The rotations of a layer act on pairwise distinct
+// coordinates, hence they are independent and can be applied at once,
+// with gather/scatter instructions (see kernels.h). Rotations sharing a
+// coordinate keep their order and every rotation performs the same
+// operations, hence the results coincide bit for bit with those of
+// applying the sequence in its original order.
+//
+// Blocks of points are rotated in structure-of-arrays layout: every
+// coordinate is a row holding one value per point, and each rotation
+// combines two rows with contiguous SIMD operations.
+//
+
+
+#include <vector>
+#include <cstddef>
+
+
+class GivensRotations
+{
+public:
+	GivensRotations()
+	: m_dimension(0)
+	{ }
+
+	// the rotation k acts on coordinates axis1[k] and axis2[k]
+	GivensRotations(std::size_t dimension, std::vector<unsigned int> const& axis1, std::vector<unsigned int> const& axis2, std::vector<double> const& sin, std::vector<double> const& cos);
+
+	std::size_t dimension() const
+	{ return m_dimension; }
+	std::size_t rotations() const
+	{ return m_axis1.size(); }
+	std::size_t layers() const
+	{ return m_layer.size() - 1; }
+
+	// apply all rotations to x, layer by layer
+	void apply(double* x) const;
+
+	// apply all rotations to count points stored in structure-of-arrays
+	// layout, coordinate i of point k at x[i * stride + k]
+	void applyBatch(double* x, std::size_t stride, std::size_t count) const;
+
+private:
+	std::size_t m_dimension;
+	std::vector<unsigned int> m_axis1;           // rotations in the order of the layers
+	std::vector<unsigned int> m_axis2;
+	std::vector<double> m_sin;
+	std::vector<double> m_cos;
+	std::vector<std::size_t> m_layer;            // rotations of layer l: m_layer[l] to m_layer[l+1]-1
+};
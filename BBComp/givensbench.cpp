@@ -0,0 +1,108 @@
+
+#include "givens.h"
+#include "kernels.h"
+#include "rng.h"
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <chrono>
+#include <cstring>
+#include <cmath>
+
+
+using namespace std;
+
+
+// This program compares the layered application of Givens rotations
+// (see givens.h) with the serial loop of the ShiftAndRotateSparse point
+// transformation, for 2d random rotations in dimension d, as generated
+// by that transformation. It reports the number of layers, the time per
+// point of the serial loop, of the layered rotations, and of rotations
+// of blocks of 64 points, and it checks that all results coincide bit
+// for bit.
+//
+// usage: givensbench
+
+
+// the loop of ShiftAndRotateSparse::apply in earlier versions
+void serial(double* x, vector<unsigned int> const& axis1, vector<unsigned int> const& axis2, vector<double> const& sin, vector<double> const& cos)
+{
+	for (size_t i=0; i<axis1.size(); i++)
+	{
+		double a = x[axis1[i]];
+		double b = x[axis2[i]];
+		x[axis1[i]] = cos[i] * a - sin[i] * b;
+		x[axis2[i]] = sin[i] * a + cos[i] * b;
+	}
+}
+
+// seconds per call of f, averaged over at least 0.1 seconds
+template <typename F>
+double measure(F f)
+{
+	size_t calls = 0;
+	chrono::steady_clock::time_point t0 = chrono::steady_clock::now();
+	double elapsed = 0.0;
+	do
+	{
+		f();
+		calls++;
+		elapsed = chrono::duration<double>(chrono::steady_clock::now() - t0).count();
+	}
+	while (elapsed < 0.1);
+	return elapsed / calls;
+}
+
+int main(int argc, char** argv)
+{
+	if (argc != 1) { cerr << "usage: " << argv[0] << endl; return 1; }
+
+	const size_t dimensions[] = { 10, 30, 100, 300, 1000, 3000, 10000 };
+	const size_t count = 64;
+
+	RNG rng(1);
+	bool identical = true;
+	cout << setw(8) << "d" << setw(10) << "layers" << setw(14) << "serial [us]" << setw(14) << "layered [us]" << setw(14) << "batch [us]" << endl;
+	for (size_t k=0; k<sizeof(dimensions)/sizeof(dimensions[0]); k++)
+	{
+		size_t d = dimensions[k];
+		vector<unsigned int> axis1(2 * d), axis2(2 * d);
+		vector<double> sin(2 * d), cos(2 * d);
+		for (size_t i=0; i<2 * d; i++)
+		{
+			axis1[i] = rng.discrete(0, d - 1);
+			axis2[i] = rng.discrete(0, d - 2);
+			if (axis2[i] >= axis1[i]) axis2[i]++;
+			double angle = 2.0 * M_PI * rng.uniform();
+			sin[i] = std::sin(angle);
+			cos[i] = std::cos(angle);
+		}
+		GivensRotations rotations(d, axis1, axis2, sin, cos);
+
+		// points, row-major and in structure-of-arrays layout
+		vector<double> points(count * d), soa(count * d);
+		for (size_t p=0; p<count; p++)
+			for (size_t i=0; i<d; i++) soa[i * count + p] = points[p * d + i] = rng.gauss();
+
+		vector<double> x1(points), x2(points), x3(soa);
+		for (size_t p=0; p<count; p++)
+		{
+			serial(&x1[p * d], axis1, axis2, sin, cos);
+			rotations.apply(&x2[p * d]);
+		}
+		rotations.applyBatch(x3.data(), count, count);
+		if (memcmp(x1.data(), x2.data(), x1.size() * sizeof(double)) != 0) identical = false;
+		for (size_t p=0; p<count; p++)
+			for (size_t i=0; i<d; i++) if (memcmp(&x1[p * d + i], &x3[i * count + p], sizeof(double)) != 0) identical = false;
+
+		// the rotations are repeated on the same data, which stays bounded
+		double ts = measure([&]() { serial(x1.data(), axis1, axis2, sin, cos); });
+		double tl = measure([&]() { rotations.apply(x2.data()); });
+		double tb = measure([&]() { rotations.applyBatch(x3.data(), count, count); }) / count;
+		cout << setw(8) << d << setw(10) << rotations.layers()
+			<< fixed << setprecision(3) << setw(14) << 1e6 * ts << setw(14) << 1e6 * tl << setw(14) << 1e6 * tb << endl;
+	}
+
+	cout << (identical ? "results are identical" : "RESULTS DIFFER") << endl;
+	return identical ? 0 : 1;
+}
@@ -0,0 +1,104 @@
+
+#include "checks.h"
+#include "rng.h"
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <algorithm>
+#include <string>
+#include <cmath>
+#include <cfloat>
+
+
+using namespace std;
+
+
+// This program validates the gradients computed by automatic
+// differentiation (see gradient.h) against central finite differences,
+// for all functions defined in a problems.json file, in several
+// dimensions and at random points of the unit hypercube. The error of
+// a partial derivative is taken relative to its magnitude, after
+// subtracting the rounding error of the difference quotient, estimated
+// from machine precision and the function values. Partial derivatives
+// for which difference quotients with two step sizes disagree (due to
+// kinks or rapid oscillation) are not checked. Functions with an error
+// above the tolerance are reported, and so are functions whose value or
+// error differs from plain evaluation.
+//
+// usage: gradcheck problems.json [forward]
+
+
+// central difference quotient in direction i, with an estimate of its
+// rounding error, which is dominated by the cancellation in fp - fm
+double difference(ExpressionPtr ex, Vector const& x, size_t i, double h, double& noise)
+{
+	Vector xp = x.copy(), xm = x.copy();
+	xp[i] += h;
+	xm[i] -= h;
+	double fp = evaluate(ex, xp), fm = evaluate(ex, xm);
+	noise = DBL_EPSILON * max(fabs(fp), fabs(fm)) / h;
+	return (fp - fm) / (2.0 * h);
+}
+
+int main(int argc, char** argv)
+{
+	if (argc < 2 || argc > 3 || (argc == 3 && string(argv[2]) != "forward")) { cerr << "usage: " << argv[0] << " problems.json [forward]" << endl; return 1; }
+	setDifferentiationMode((argc == 3) ? ForwardMode : ReverseMode);
+
+	const size_t dimensions[] = { 1, 2, 5, 10, 100 };
+	const unsigned int points = 3;
+	const double h = 1e-6;
+	const double tolerance = 1e-4;
+
+	RNG rng(1);
+	return checkFunctions(argv[1], [&](string const& name, ExpressionPtr generic, string& info) -> string
+	{
+		double worst = 0.0;
+		size_t evaluated = 0, unreliable = 0;
+		string problem;
+		for (size_t k=0; k<sizeof(dimensions)/sizeof(dimensions[0]); k++)
+		{
+			size_t d = dimensions[k];
+			ExpressionPtr ex = specialize(generic, d);
+			for (unsigned int p=0; p<points; p++)
+			{
+				Vector x(d);
+				for (size_t i=0; i<d; i++) x[i] = 0.05 + 0.9 * rng.uniform();
+
+				Vector gradient;
+				double value = 0.0, reference = 0.0;
+				string error, referenceError;
+				try { value = evaluateWithGradient(ex, x, gradient); }
+				catch (exception const& e) { error = e.what(); }
+				try { reference = evaluate(ex, x); }
+				catch (exception const& e) { referenceError = e.what(); }
+				if (error != referenceError) { problem = "error differs from evaluation"; continue; }
+				if (! error.empty()) continue;
+				if (! (value == reference || (std::isnan(value) && std::isnan(reference)))) { problem = "value differs from evaluation"; continue; }
+				if (! std::isfinite(value)) continue;
+				evaluated++;
+
+				for (size_t i=0; i<d; i++)
+				{
+					double noise, noise2;
+					double fd = difference(ex, x, i, h, noise);
+					double fd2 = difference(ex, x, i, 10.0 * h, noise2);
+					if (! (fabs(fd - fd2) <= tolerance * max(1.0, max(fabs(fd), fabs(fd2))) + max(noise, noise2))) { unreliable++; continue; }
+					double err = max(0.0, fabs(fd - gradient[i]) - noise) / max(1.0, max(fabs(fd), fabs(gradient[i])));
+					if (! (err <= worst)) worst = err;
+				}
+			}
+		}
+
+		if (problem.empty() && ! (worst <= tolerance)) problem = "gradient differs from finite differences";
+		if (! problem.empty())
+		{
+			ostringstream report;
+			report << problem << " (relative error " << worst << ")";
+			return report.str();
+		}
+		if (evaluated == 0) info = "not evaluated";
+		else if (unreliable > 0) info = to_string(unreliable) + " partial derivatives not checked, finite differences unreliable";
+		return string();
+	});
+}
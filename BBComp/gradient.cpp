@@ -0,0 +1,778 @@
+#include "gradient.h"
+#include "vecmath.h"
+
+#include <stdexcept>
+#include <algorithm>
+#include <cmath>
+#include <cassert>
+
+
+using namespace std;
+
+
+////////////////////////////////////////////////////////////
+// activity analysis
+//
+
+static void activity(Program const& program, std::vector<Instruction> const& code, std::vector<bool>& sa, std::vector<bool>& va)
+{
+	for (size_t k=0; k<code.size(); k++)
+	{
+		Instruction const& in = code[k];
+		bool active = false;
+		switch (in.op)
+		{
+		case opSNeg:
+		case opSFunc:
+			active = sa[in.a];
+			break;
+		case opSAdd:
+		case opSSub:
+		case opSMul:
+		case opSDiv:
+		case opSPow:
+			active = sa[in.a] || sa[in.b];
+			break;
+		case opSDim:
+		case opVFill:
+		case opVIota:
+			active = false;
+			break;
+		case opSEntry:
+		case opSSum:
+		case opSProd:
+		case opSNorm:
+		case opSSqrNorm:
+		case opSMin:
+		case opSMax:
+		case opVNeg:
+		case opVRange:
+			active = va[in.a];
+			break;
+		case opSDot:
+		case opVAdd:
+		case opVSub:
+		case opVEMul:
+		case opVEDiv:
+		case opVEPowV:
+			active = va[in.a] || va[in.b];
+			break;
+		case opVScale:
+		case opVDiv:
+		case opVEPowS:
+			active = va[in.a] || sa[in.b];
+			break;
+		case opVScaleAdd:
+		case opVScaleSub:
+			active = va[in.a] || sa[in.b] || va[in.c];
+			break;
+		case opVCompose:
+		{
+			std::vector<Operand> const& parts = program.composition[in.a];
+			for (size_t j=0; j<parts.size(); j++) if ((parts[j].isVector ? va : sa)[parts[j].reg]) active = true;
+			break;
+		}
+		case opVApply:
+		{
+			Lambda const& l = program.lambda[in.b];
+			sa[l.argument] = va[in.a];
+			activity(program, program.block[l.block], sa, va);
+			active = sa[l.result];
+			break;
+		}
+		}
+		(in.op >= opVNeg ? va : sa)[in.dst] = active;
+	}
+}
+
+Tangents::Tangents(Program const& program)
+: sactive(program.scalars, false)
+, vactive(program.vectors, false)
+, dimension(0)
+, v(program.vectors)
+{
+	vactive[0] = true;
+	activity(program, program.block[0], sactive, vactive);
+}
+
+
+////////////////////////////////////////////////////////////
+// tangent propagation
+//
+
+namespace {
+
+// propagation of tangents through the instructions of a program
+struct Forward
+{
+	Forward(Program const& program_, Registers& reg_, Tangents& t_)
+	: program(program_)
+	, reg(reg_)
+	, t(t_)
+	, n(t_.dimension)
+	{ }
+
+	// scalar tangents, or nullptr for registers not depending on the input
+	double* ts(int r)
+	{ return t.sactive[r] ? &t.s[r * n] : nullptr; }
+	// vector tangents, or nullptr for registers not depending on the input
+	const double* tv(int r)
+	{ return t.vactive[r] ? t.v[r].data() : nullptr; }
+	// tangents of the result of an instruction with m components
+	double* result(int r, size_t m)
+	{
+		std::vector<double>& b = t.v[r];
+		b.resize(m * n);
+		return b.data();
+	}
+
+	void zero(double* d)
+	{ std::fill(d, d + n, 0.0); }
+	void copy(double* d, const double* a)
+	{ std::copy(a, a + n, d); }
+	// d += alpha * a, if a is present
+	void axpy(double* d, double alpha, const double* a)
+	{ if (a) for (size_t j=0; j<n; j++) d[j] += alpha * a[j]; }
+
+	void run(std::vector<Instruction> const& code)
+	{
+		for (size_t k=0; k<code.size(); k++)
+		{
+			Instruction const& in = code[k];
+			step(program, reg, in);
+			if ((in.op >= opVNeg ? t.vactive : t.sactive)[in.dst]) tangent(in);
+		}
+	}
+
+	void tangent(Instruction const& in)
+	{
+		double* s = reg.s.data();
+		switch (in.op)
+		{
+		case opSNeg:
+		{
+			double* d = ts(in.dst);
+			zero(d);
+			axpy(d, -1.0, ts(in.a));
+			break;
+		}
+		case opSAdd:
+		case opSSub:
+		{
+			double* d = ts(in.dst);
+			zero(d);
+			axpy(d, 1.0, ts(in.a));
+			axpy(d, (in.op == opSAdd) ? 1.0 : -1.0, ts(in.b));
+			break;
+		}
+		case opSMul:
+		{
+			double* d = ts(in.dst);
+			zero(d);
+			axpy(d, s[in.b], ts(in.a));
+			axpy(d, s[in.a], ts(in.b));
+			break;
+		}
+		case opSDiv:
+		{
+			double* d = ts(in.dst);
+			zero(d);
+			axpy(d, 1.0 / s[in.b], ts(in.a));
+			axpy(d, -s[in.dst] / s[in.b], ts(in.b));
+			break;
+		}
+		case opSPow:
+		{
+			double* d = ts(in.dst);
+			double a = s[in.a], b = s[in.b];
+			zero(d);
+			if (t.sactive[in.a]) axpy(d, b * mathPow(a, b - 1.0), ts(in.a));
+			if (t.sactive[in.b]) axpy(d, s[in.dst] * std::log(a), ts(in.b));
+			break;
+		}
+		case opSFunc:
+		{
+			ScalarFunction df = derivative(in.f);
+			if (! df) throw runtime_error("function cannot be differentiated");
+			double* d = ts(in.dst);
+			zero(d);
+			axpy(d, df(s[in.a]), ts(in.a));
+			break;
+		}
+		case opSEntry:
+		{
+			int i = (int)floor(s[in.b]);
+			copy(ts(in.dst), tv(in.a) + (i - 1) * n);
+			break;
+		}
+		case opSDot:
+		{
+			double* d = ts(in.dst);
+			const double* ta = tv(in.a);
+			const double* tb = tv(in.b);
+			const double* a = reg.vp[in.a];
+			const double* b = reg.vp[in.b];
+			zero(d);
+			for (size_t i=0; i<reg.vn[in.a]; i++)
+			{
+				if (ta) axpy(d, b[i], ta + i * n);
+				if (tb) axpy(d, a[i], tb + i * n);
+			}
+			break;
+		}
+		case opSSum:
+		case opSNorm:
+		case opSSqrNorm:
+		{
+			double* d = ts(in.dst);
+			const double* ta = tv(in.a);
+			const double* a = reg.vp[in.a];
+			double v = s[in.dst];
+			zero(d);
+			for (size_t i=0; i<reg.vn[in.a]; i++)
+			{
+				double c = (in.op == opSSum) ? 1.0 : (in.op == opSSqrNorm) ? 2.0 * a[i] : (v > 0.0) ? a[i] / v : 0.0;
+				axpy(d, c, ta + i * n);
+			}
+			break;
+		}
+		case opSProd:
+		{
+			// product of all other components, by prefix and suffix products
+			double* d = ts(in.dst);
+			const double* ta = tv(in.a);
+			const double* a = reg.vp[in.a];
+			size_t m = reg.vn[in.a];
+			t.scratch.resize(m);
+			double p = 1.0;
+			for (size_t i=0; i<m; i++) { t.scratch[i] = p; p *= a[i]; }
+			p = 1.0;
+			zero(d);
+			for (size_t i=m; i>0; i--)
+			{
+				axpy(d, t.scratch[i-1] * p, ta + (i-1) * n);
+				p *= a[i-1];
+			}
+			break;
+		}
+		case opSMin:
+		case opSMax:
+		{
+			// the component selected by the interpreter
+			double* d = ts(in.dst);
+			const double* a = reg.vp[in.a];
+			size_t m = reg.vn[in.a];
+			zero(d);
+			if (m == 0) break;
+			size_t best = 0;
+			for (size_t i=1; i<m; i++)
+			{
+				if (in.op == opSMin ? (a[i] < a[best]) : (a[best] < a[i])) best = i;
+			}
+			copy(d, tv(in.a) + best * n);
+			break;
+		}
+		case opVNeg:
+		case opVAdd:
+		case opVSub:
+		case opVEMul:
+		case opVEDiv:
+		case opVEPowV:
+		{
+			size_t m = reg.vn[in.dst];
+			double* td = result(in.dst, m);
+			const double* ta = tv(in.a);
+			const double* tb = (in.op == opVNeg) ? nullptr : tv(in.b);
+			const double* a = reg.vp[in.a];
+			const double* b = reg.vp[in.b];
+			const double* v = reg.vp[in.dst];
+			for (size_t i=0; i<m; i++)
+			{
+				double* d = td + i * n;
+				const double* ai = ta ? ta + i * n : nullptr;
+				const double* bi = tb ? tb + i * n : nullptr;
+				zero(d);
+				switch (in.op)
+				{
+				case opVNeg:
+					axpy(d, -1.0, ai);
+					break;
+				case opVAdd:
+				case opVSub:
+					axpy(d, 1.0, ai);
+					axpy(d, (in.op == opVAdd) ? 1.0 : -1.0, bi);
+					break;
+				case opVEMul:
+					axpy(d, b[i], ai);
+					axpy(d, a[i], bi);
+					break;
+				case opVEDiv:
+					axpy(d, 1.0 / b[i], ai);
+					axpy(d, -v[i] / b[i], bi);
+					break;
+				default:
+					if (ai) axpy(d, b[i] * mathPow(a[i], b[i] - 1.0), ai);
+					if (bi) axpy(d, v[i] * std::log(a[i]), bi);
+					break;
+				}
+			}
+			break;
+		}
+		case opVScale:
+		case opVDiv:
+		case opVEPowS:
+		case opVScaleAdd:
+		case opVScaleSub:
+		{
+			size_t m = reg.vn[in.dst];
+			double* td = result(in.dst, m);
+			const double* ta = tv(in.a);
+			const double* tb = ts(in.b);
+			const double* tc = (in.op == opVScaleAdd || in.op == opVScaleSub) ? tv(in.c) : nullptr;
+			const double* a = reg.vp[in.a];
+			double b = s[in.b];
+			const double* v = reg.vp[in.dst];
+			for (size_t i=0; i<m; i++)
+			{
+				double* d = td + i * n;
+				const double* ai = ta ? ta + i * n : nullptr;
+				zero(d);
+				switch (in.op)
+				{
+				case opVDiv:
+					axpy(d, 1.0 / b, ai);
+					axpy(d, -v[i] / b, tb);
+					break;
+				case opVEPowS:
+					if (ai) axpy(d, b * mathPow(a[i], b - 1.0), ai);
+					if (tb) axpy(d, v[i] * std::log(a[i]), tb);
+					break;
+				default:
+					axpy(d, b, ai);
+					axpy(d, a[i], tb);
+					if (tc) axpy(d, (in.op == opVScaleSub) ? -1.0 : 1.0, tc + i * n);
+					break;
+				}
+			}
+			break;
+		}
+		case opVCompose:
+		{
+			std::vector<Operand> const& parts = program.composition[in.a];
+			double* d = result(in.dst, reg.vn[in.dst]);
+			for (size_t k=0; k<parts.size(); k++)
+			{
+				int r = parts[k].reg;
+				size_t m = parts[k].isVector ? reg.vn[r] : 1;
+				const double* src = parts[k].isVector ? tv(r) : ts(r);
+				if (src) std::copy(src, src + m * n, d);
+				else std::fill(d, d + m * n, 0.0);
+				d += m * n;
+			}
+			break;
+		}
+		case opVRange:
+		{
+			int f = (int)floor(s[in.b]);
+			size_t m = reg.vn[in.dst];
+			double* d = result(in.dst, m);
+			const double* a = tv(in.a) + (f - 1) * n;
+			std::copy(a, a + m * n, d);
+			break;
+		}
+		case opVApply:
+		{
+			// the body once per component, the values of the result are already in place
+			Lambda const& l = program.lambda[in.b];
+			size_t m = reg.vn[in.dst];
+			double* td = result(in.dst, m);
+			const double* ta = tv(in.a);
+			const double* a = reg.vp[in.a];
+			for (size_t i=0; i<m; i++)
+			{
+				s[l.argument] = a[i];
+				if (ta) copy(ts(l.argument), ta + i * n);
+				run(program.block[l.block]);
+				copy(td + i * n, ts(l.result));
+			}
+			break;
+		}
+		default:
+			assert(false);
+			break;
+		}
+	}
+
+	Program const& program;
+	Registers& reg;
+	Tangents& t;
+	size_t n;
+};
+
+}
+
+double differentiate(Program const& program, Registers& registers, Tangents& tangents, Vector const& x, double* gradient)
+{
+	assert(registers.s.size() == (size_t)program.scalars);
+	size_t n = x.size();
+	if (tangents.dimension != n)
+	{
+		tangents.dimension = n;
+		tangents.s.assign(program.scalars * n, 0.0);
+		std::vector<double>& id = tangents.v[0];
+		id.assign(n * n, 0.0);
+		for (size_t i=0; i<n; i++) id[i * n + i] = 1.0;
+	}
+	registers.vp[0] = x.data();
+	registers.vn[0] = n;
+	Forward(program, registers, tangents).run(program.block[0]);
+	const double* g = tangents.sactive[program.result] ? &tangents.s[program.result * n] : nullptr;
+	for (size_t i=0; i<n; i++) gradient[i] = g ? g[i] : 0.0;
+	return registers.s[program.result];
+}
+
+
+////////////////////////////////////////////////////////////
+// reverse mode
+//
+
+Tape::Tape(Program const& program)
+: sactive(program.scalars, false)
+, vactive(program.vectors, false)
+, dimension(0)
+, sid(program.scalars, -1)
+, vid(program.vectors)
+{
+	vactive[0] = true;
+	activity(program, program.block[0], sactive, vactive);
+}
+
+namespace {
+
+// recording of the tape while executing the instructions of a program
+struct Recorder
+{
+	Recorder(Program const& program_, Registers& reg_, Tape& t_)
+	: program(program_)
+	, reg(reg_)
+	, t(t_)
+	{ }
+
+	// nodes of the components of a vector register, or nullptr for registers not depending on the input
+	const int* va(int r)
+	{ return t.vactive[r] ? t.vid[r].data() : nullptr; }
+	static int at(const int* ids, size_t i)
+	{ return ids ? ids[i] : -1; }
+
+	// add an argument to the node under construction
+	void edge(int id, double partial)
+	{
+		if (id < 0) return;
+		t.arg.push_back(id);
+		t.partial.push_back(partial);
+	}
+	// complete the node with the arguments added since first,
+	// without arguments the value does not depend on the input
+	int node(size_t first)
+	{
+		if (t.arg.size() == first) return -1;
+		t.end.push_back(t.arg.size());
+		return t.end.size() - 1;
+	}
+
+	void run(std::vector<Instruction> const& code)
+	{
+		for (size_t k=0; k<code.size(); k++)
+		{
+			Instruction const& in = code[k];
+			step(program, reg, in);
+			if ((in.op >= opVNeg ? t.vactive : t.sactive)[in.dst]) record(in);
+		}
+	}
+
+	void record(Instruction const& in)
+	{
+		double* s = reg.s.data();
+		std::vector<int>& sid = t.sid;
+		size_t first = t.arg.size();
+		switch (in.op)
+		{
+		case opSNeg:
+			edge(sid[in.a], -1.0);
+			sid[in.dst] = node(first);
+			break;
+		case opSAdd:
+		case opSSub:
+			edge(sid[in.a], 1.0);
+			edge(sid[in.b], (in.op == opSAdd) ? 1.0 : -1.0);
+			sid[in.dst] = node(first);
+			break;
+		case opSMul:
+			edge(sid[in.a], s[in.b]);
+			edge(sid[in.b], s[in.a]);
+			sid[in.dst] = node(first);
+			break;
+		case opSDiv:
+			edge(sid[in.a], 1.0 / s[in.b]);
+			edge(sid[in.b], -s[in.dst] / s[in.b]);
+			sid[in.dst] = node(first);
+			break;
+		case opSPow:
+		{
+			double a = s[in.a], b = s[in.b];
+			if (sid[in.a] >= 0) edge(sid[in.a], b * mathPow(a, b - 1.0));
+			if (sid[in.b] >= 0) edge(sid[in.b], s[in.dst] * std::log(a));
+			sid[in.dst] = node(first);
+			break;
+		}
+		case opSFunc:
+		{
+			if (sid[in.a] >= 0)
+			{
+				ScalarFunction df = derivative(in.f);
+				if (! df) throw runtime_error("function cannot be differentiated");
+				edge(sid[in.a], df(s[in.a]));
+			}
+			sid[in.dst] = node(first);
+			break;
+		}
+		case opSEntry:
+		{
+			int i = (int)floor(s[in.b]);
+			sid[in.dst] = va(in.a)[i - 1];
+			break;
+		}
+		case opSDot:
+		{
+			const int* ia = va(in.a);
+			const int* ib = va(in.b);
+			const double* a = reg.vp[in.a];
+			const double* b = reg.vp[in.b];
+			for (size_t i=0; i<reg.vn[in.a]; i++)
+			{
+				edge(at(ia, i), b[i]);
+				edge(at(ib, i), a[i]);
+			}
+			sid[in.dst] = node(first);
+			break;
+		}
+		case opSSum:
+		case opSNorm:
+		case opSSqrNorm:
+		{
+			const int* ia = va(in.a);
+			const double* a = reg.vp[in.a];
+			double v = s[in.dst];
+			for (size_t i=0; i<reg.vn[in.a]; i++)
+			{
+				double c = (in.op == opSSum) ? 1.0 : (in.op == opSSqrNorm) ? 2.0 * a[i] : (v > 0.0) ? a[i] / v : 0.0;
+				edge(ia[i], c);
+			}
+			sid[in.dst] = node(first);
+			break;
+		}
+		case opSProd:
+		{
+			// product of all other components, by prefix and suffix products
+			const int* ia = va(in.a);
+			const double* a = reg.vp[in.a];
+			size_t m = reg.vn[in.a];
+			t.scratch.resize(m);
+			double p = 1.0;
+			for (size_t i=0; i<m; i++) { t.scratch[i] = p; p *= a[i]; }
+			p = 1.0;
+			for (size_t i=m; i>0; i--)
+			{
+				edge(ia[i-1], t.scratch[i-1] * p);
+				p *= a[i-1];
+			}
+			sid[in.dst] = node(first);
+			break;
+		}
+		case opSMin:
+		case opSMax:
+		{
+			// the component selected by the interpreter
+			const double* a = reg.vp[in.a];
+			size_t m = reg.vn[in.a];
+			if (m == 0) { sid[in.dst] = -1; break; }
+			size_t best = 0;
+			for (size_t i=1; i<m; i++)
+			{
+				if (in.op == opSMin ? (a[i] < a[best]) : (a[best] < a[i])) best = i;
+			}
+			sid[in.dst] = va(in.a)[best];
+			break;
+		}
+		case opVNeg:
+		case opVAdd:
+		case opVSub:
+		case opVEMul:
+		case opVEDiv:
+		case opVEPowV:
+		{
+			size_t m = reg.vn[in.dst];
+			std::vector<int>& d = t.vid[in.dst];
+			d.resize(m);
+			const int* ia = va(in.a);
+			const int* ib = (in.op == opVNeg) ? nullptr : va(in.b);
+			const double* a = reg.vp[in.a];
+			const double* b = reg.vp[in.b];
+			const double* v = reg.vp[in.dst];
+			for (size_t i=0; i<m; i++)
+			{
+				size_t first = t.arg.size();
+				int ai = at(ia, i), bi = at(ib, i);
+				switch (in.op)
+				{
+				case opVNeg:
+					edge(ai, -1.0);
+					break;
+				case opVAdd:
+				case opVSub:
+					edge(ai, 1.0);
+					edge(bi, (in.op == opVAdd) ? 1.0 : -1.0);
+					break;
+				case opVEMul:
+					edge(ai, b[i]);
+					edge(bi, a[i]);
+					break;
+				case opVEDiv:
+					edge(ai, 1.0 / b[i]);
+					edge(bi, -v[i] / b[i]);
+					break;
+				default:
+					if (ai >= 0) edge(ai, b[i] * mathPow(a[i], b[i] - 1.0));
+					if (bi >= 0) edge(bi, v[i] * std::log(a[i]));
+					break;
+				}
+				d[i] = node(first);
+			}
+			break;
+		}
+		case opVScale:
+		case opVDiv:
+		case opVEPowS:
+		case opVScaleAdd:
+		case opVScaleSub:
+		{
+			size_t m = reg.vn[in.dst];
+			std::vector<int>& d = t.vid[in.dst];
+			d.resize(m);
+			const int* ia = va(in.a);
+			int bi = sid[in.b];
+			const int* ic = (in.op == opVScaleAdd || in.op == opVScaleSub) ? va(in.c) : nullptr;
+			const double* a = reg.vp[in.a];
+			double b = s[in.b];
+			const double* v = reg.vp[in.dst];
+			for (size_t i=0; i<m; i++)
+			{
+				size_t first = t.arg.size();
+				int ai = at(ia, i);
+				switch (in.op)
+				{
+				case opVDiv:
+					edge(ai, 1.0 / b);
+					edge(bi, -v[i] / b);
+					break;
+				case opVEPowS:
+					if (ai >= 0) edge(ai, b * mathPow(a[i], b - 1.0));
+					if (bi >= 0) edge(bi, v[i] * std::log(a[i]));
+					break;
+				default:
+					edge(ai, b);
+					edge(bi, a[i]);
+					edge(at(ic, i), (in.op == opVScaleSub) ? -1.0 : 1.0);
+					break;
+				}
+				d[i] = node(first);
+			}
+			break;
+		}
+		case opVCompose:
+		{
+			std::vector<Operand> const& parts = program.composition[in.a];
+			std::vector<int>& d = t.vid[in.dst];
+			d.clear();
+			for (size_t k=0; k<parts.size(); k++)
+			{
+				int r = parts[k].reg;
+				if (! parts[k].isVector) d.push_back(sid[r]);
+				else if (t.vactive[r]) d.insert(d.end(), t.vid[r].begin(), t.vid[r].end());
+				else d.insert(d.end(), reg.vn[r], -1);
+			}
+			break;
+		}
+		case opVRange:
+		{
+			int f = (int)floor(s[in.b]);
+			const int* ia = va(in.a) + (f - 1);
+			t.vid[in.dst].assign(ia, ia + reg.vn[in.dst]);
+			break;
+		}
+		case opVApply:
+		{
+			// the body once per component, the values of the result are already in place
+			Lambda const& l = program.lambda[in.b];
+			size_t m = reg.vn[in.dst];
+			std::vector<int>& d = t.vid[in.dst];
+			d.resize(m);
+			const int* ia = va(in.a);
+			const double* a = reg.vp[in.a];
+			for (size_t i=0; i<m; i++)
+			{
+				s[l.argument] = a[i];
+				sid[l.argument] = at(ia, i);
+				run(program.block[l.block]);
+				d[i] = sid[l.result];
+			}
+			break;
+		}
+		default:
+			assert(false);
+			break;
+		}
+	}
+
+	Program const& program;
+	Registers& reg;
+	Tape& t;
+};
+
+}
+
+double differentiate(Program const& program, Registers& registers, Tape& tape, Vector const& x, double* gradient)
+{
+	assert(registers.s.size() == (size_t)program.scalars);
+	size_t n = x.size();
+	if (tape.dimension != n)
+	{
+		tape.dimension = n;
+		std::vector<int>& id = tape.vid[0];
+		id.resize(n);
+		for (size_t i=0; i<n; i++) id[i] = i;
+	}
+
+	// forward sweep: the components of x are the first n nodes
+	tape.end.assign(n, 0);
+	tape.arg.clear();
+	tape.partial.clear();
+	registers.vp[0] = x.data();
+	registers.vn[0] = n;
+	Recorder(program, registers, tape).run(program.block[0]);
+
+	// backward sweep
+	size_t nodes = tape.end.size();
+	std::vector<double>& adjoint = tape.adjoint;
+	adjoint.assign(nodes, 0.0);
+	int r = tape.sactive[program.result] ? tape.sid[program.result] : -1;
+	if (r >= 0) adjoint[r] = 1.0;
+	for (size_t k=nodes; k>n; k--)
+	{
+		double a = adjoint[k-1];
+		if (a == 0.0) continue;
+		for (size_t e=(k > 1) ? tape.end[k-2] : 0; e<tape.end[k-1]; e++) adjoint[tape.arg[e]] += tape.partial[e] * a;
+	}
+	for (size_t i=0; i<n; i++) gradient[i] = adjoint[i];
+	return registers.s[program.result];
+}
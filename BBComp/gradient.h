@@ -0,0 +1,98 @@
+
+#pragma once
+
+
+//
+// Automatic Differentiation
+// -------------------------
+//
+// Gradients of programs (see bytecode.h) are computed in forward or in
+// reverse mode.
+//
+// In forward mode, every register depending on the input is accompanied by its tangents,
+// i.e., by its partial derivatives with respect to all components of
+// the input, which are propagated alongside the values, instruction by
+// instruction. Apply statements propagate tangents through their body
+// once per component. Values are computed by the interpreter itself,
+// hence they coincide bit for bit with plain evaluation, and so do the
+// errors raised.
+//
+// Piecewise constant operations (floor, ceil, round, and indices of
+// vector entries and ranges) have zero derivatives. abs, min, and max
+// are differentiated on the selected branch, with zero derivative of
+// abs at zero. Registers not depending on the input carry no tangents;
+// for the others, the cost of an instruction is multiplied by the
+// dimension of the input.
+//
+// In reverse mode, the evaluation records a tape: every scalar value
+// depending on the input (including every such vector component) is a
+// node, listing the nodes it was computed from together with the local
+// partial derivatives. Copies (vector entries and ranges, compositions,
+// the selected component of min and max) refer to existing nodes. The
+// tape is then swept once backwards, accumulating the derivative of the
+// result with respect to every node. Hence the gradient costs a small
+// constant multiple of an evaluation, independent of the dimension. The
+// arrays holding the tape are reused across evaluations.
+//
+
+
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+#include "bytecode.h"
+
+
+// Derivative of a scalar function of the expression language (defined
+// in interpreter.cpp), or nullptr for unknown functions.
+ScalarFunction derivative(ScalarFunction f);
+
+
+// Tangent registers for the differentiation of a program.
+struct Tangents
+{
+	Tangents()
+	: dimension(0)
+	{ }
+
+	explicit Tangents(Program const& program);
+
+	std::vector<bool> sactive;                   // scalar registers depending on the input
+	std::vector<bool> vactive;                   // vector registers depending on the input
+	std::size_t dimension;                       // number of partial derivatives per value
+	std::vector<double> s;                       // scalar registers: dimension entries each
+	std::vector< std::vector<double> > v;        // vector registers: dimension entries per component
+	std::vector<double> scratch;
+};
+
+
+// Evaluate a program and its gradient, which is stored in gradient[0]
+// to gradient[x.size()-1]. The registers and tangents must have been
+// set up for the program.
+double differentiate(Program const& program, Registers& registers, Tangents& tangents, Vector const& x, double* gradient);
+
+
+// Tape for the differentiation of a program in reverse mode.
+struct Tape
+{
+	Tape()
+	: dimension(0)
+	{ }
+
+	explicit Tape(Program const& program);
+
+	std::vector<bool> sactive;                   // scalar registers depending on the input
+	std::vector<bool> vactive;                   // vector registers depending on the input
+	std::size_t dimension;                       // number of input nodes
+	std::vector<int> sid;                        // scalar registers: node, or -1
+	std::vector< std::vector<int> > vid;         // vector registers: node per component, or -1
+	std::vector<std::uint32_t> end;              // per node: end of its arguments
+	std::vector<std::uint32_t> arg;              // arguments of all nodes, consecutively
+	std::vector<double> partial;                 // partial derivatives with respect to the arguments
+	std::vector<double> adjoint;                 // per node: derivative of the result
+	std::vector<double> scratch;
+};
+
+
+// Same as above, in reverse mode.
+double differentiate(Program const& program, Registers& registers, Tape& tape, Vector const& x, double* gradient);
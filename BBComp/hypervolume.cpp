@@ -1,8 +1,11 @@
 
 #include "hypervolume.h"
 
+#include "rng.h"
+
 #include <map>
 #include <algorithm>
+#include <cmath>
 #include <stdexcept>
 #include <cassert>
 
@@ -38,31 +41,187 @@ struct ComparatorIndicesLast
 
 
 ////////////////////////////////////////////////////////////
-// 2D and 3D hypervolume computation in N log(N) operations.
-// The algorithm assumes that points don't dominate each other,
-// and that they all dominate the reference point.
+// 3D sweep in N log(N) operations over points sorted by the
+// last objective, stored consecutively. Dominated points are
+// skipped.
+//
+static double sweep3D(const double* points, size_t N, const double* reference)
+{
+	double volume = 0.0;
+	double area = 0.0;
+	map<double, double> front2D;
+	double prev_z = 0.0;
+	for (size_t i=0; i<N; i++)
+	{
+		const double* x = points + 3 * i;
+		if (i > 0) volume += area * (x[2] - prev_z);
+
+		// check whether x is dominated
+		map<double, double>::iterator worse = front2D.upper_bound(x[0]);
+		double b = reference[1];
+		if (worse != front2D.begin())
+		{
+			map<double, double>::iterator better = worse;
+			if (better == front2D.end() || better->first > x[0]) --better;
+			if (better->second <= x[1]) continue;
+			b = better->second;
+		}
+
+		// remove dominated points
+		while (worse != front2D.end())
+		{
+			if (worse->second < x[1]) break;
+			map<double, double>::iterator it = worse;
+			++worse;
+			double r = (worse == front2D.end()) ? reference[0]: worse->first;
+			area -= (r - it->first) * (b - it->second);
+			front2D.erase(it);
+		}
+
+		// insert x
+		front2D[x[0]] = x[1];
+		double r = (worse == front2D.end()) ? reference[0] : worse->first;
+		area += (r - x[0]) * (b - x[1]);
+
+		prev_z = x[2];
+	}
+	volume += area * (reference[2] - prev_z);
+	return volume;
+}
+
+
+////////////////////////////////////////////////////////////
+// WFG algorithm for four and more objectives
+// (While, Bradstreet, and Barone, IEEE TEVC 2012).
+// Points are stored consecutively with m objectives each.
+// The points are processed in the order of decreasing last
+// objective. The slice between a point and the reference point
+// in the last objective contributes the exclusive hypervolume of
+// the point in the remaining objectives, which is its box minus
+// the hypervolume of the later points bounded by the point (the
+// limit set). The recursion ends in the 3D sweep.
+//
+
+static double boxVolume(const double* point, size_t m, const double* reference)
+{
+	double v = 1.0;
+	for (size_t k=0; k<m; k++) v *= reference[k] - point[k];
+	return v;
+}
+
+// remove weakly dominated points in place, return the new number of points
+static size_t nondominated(vector<double>& points, size_t n, size_t m)
+{
+	vector<bool> removed(n, false);
+	for (size_t i=0; i<n; i++)
+	{
+		if (removed[i]) continue;
+		const double* a = &points[i * m];
+		for (size_t j=i+1; j<n; j++)
+		{
+			if (removed[j]) continue;
+			const double* b = &points[j * m];
+			bool ab = true, ba = true;
+			for (size_t k=0; k<m && (ab || ba); k++)
+			{
+				if (a[k] > b[k]) ab = false;
+				else if (b[k] > a[k]) ba = false;
+			}
+			if (ab) removed[j] = true;
+			else if (ba) { removed[i] = true; break; }
+		}
+	}
+	size_t count = 0;
+	for (size_t i=0; i<n; i++)
+	{
+		if (removed[i]) continue;
+		if (count != i) copy(points.begin() + i * m, points.begin() + (i + 1) * m, points.begin() + count * m);
+		count++;
+	}
+	return count;
+}
+
+static double wfg(vector<double> const& points, size_t n, size_t m, const double* reference)
+{
+	if (n == 0) return 0.0;
+	if (n == 1) return boxVolume(points.data(), m, reference);
+
+	// sort by the last objective, lexicographically from right to
+	// left for the 3D sweep, in reverse order for slicing
+	vector<size_t> order(n);
+	for (size_t i=0; i<n; i++) order[i] = i;
+	sort(order.begin(), order.end(), [&points, m](size_t i, size_t j)
+	{
+		for (int k=(int)m-1; k>=0; k--)
+		{
+			if (points[i * m + k] < points[j * m + k]) return true;
+			if (points[i * m + k] > points[j * m + k]) return false;
+		}
+		return false;
+	});
+	if (m == 3)
+	{
+		vector<double> sorted(3 * n);
+		for (size_t i=0; i<n; i++) copy(points.begin() + 3 * order[i], points.begin() + 3 * order[i] + 3, sorted.begin() + 3 * i);
+		return sweep3D(sorted.data(), n, reference);
+	}
+	reverse(order.begin(), order.end());
+
+	double volume = 0.0;
+	vector<double> limit;
+	limit.reserve((n - 1) * (m - 1));
+	for (size_t i=0; i<n; i++)
+	{
+		const double* p = &points[order[i] * m];
+		limit.clear();
+		for (size_t j=i+1; j<n; j++)
+		{
+			const double* q = &points[order[j] * m];
+			for (size_t k=0; k+1<m; k++) limit.push_back(max(p[k], q[k]));
+		}
+		size_t l = nondominated(limit, n - i - 1, m - 1);
+		volume += (reference[m - 1] - p[m - 1]) * (boxVolume(p, m - 1, reference) - wfg(limit, l, m - 1, reference));
+	}
+	return volume;
+}
+
+
+////////////////////////////////////////////////////////////
+// Exact hypervolume computation.
+// The algorithms assume that points don't dominate each other.
+// Points not strictly dominating the reference point are ignored.
 //
 double hypervolume(Vector const& reference, ParetoFront const& front)
 {
-	size_t N = front.size();
+	size_t m = reference.size();
+	vector<size_t> order;
+	order.reserve(front.size());
+	for (size_t i=0; i<front.size(); i++)
+	{
+		Vector const& x = front[i];
+		size_t k = 0;
+		while (k < m && x[k] < reference[k]) k++;
+		if (k == m) order.push_back(i);
+	}
+	size_t N = order.size();
 	if (N == 0) return 0.0;
 
+	if (m >= 4)
+	{
+		vector<double> points;
+		points.reserve(N * m);
+		for (size_t i=0; i<N; i++) points.insert(points.end(), front[order[i]].begin(), front[order[i]].end());
+		return wfg(points, N, m, reference.data());
+	}
+
 	// sort index array by last objective
 	ComparatorIndicesLast comparator_last(front);
-	vector<size_t> order(N);
-	for (size_t i=0; i<N; i++) order[i] = i;
 	sort(order.begin(), order.end(), comparator_last);
 
 	if (reference.size() == 2)
 	{
-		// Instead of recomputing the hypervolume from scratch each
-		// time we could update it rather cheaply by computing the
-		// contribution of the new point. However, this won't safe us
-		// in the 3D case, at least with the current algorithm.
-		// Therefore I see no point in changing the interfaces
-		// accordingly.
 		double area = (reference[0] - front[order[0]][0]) * (reference[1] - front[order[0]][1]);
-		for (size_t i=1; i<front.size(); i++)
+		for (size_t i=1; i<N; i++)
 		{
 			area += (front[order[i-1]][0] - front[order[i]][0]) * (reference[1] - front[order[i]][1]);
 		}
@@ -77,46 +236,51 @@ double hypervolume(Vector const& reference, ParetoFront const& front)
 		// seconds (5 hours) for the full competition, which is okay
 		// as an upper bound. Therefore iterative computation of the
 		// hypervolume is not a top priority right now.
-		double volume = 0.0;
-		double area = 0.0;
-		map<double, double> front2D;
-		double prev_z = 0.0;
+		vector<double> points(3 * N);
 		for (size_t i=0; i<N; i++)
 		{
 			Vector const& x = front[order[i]];
-			if (i > 0) volume += area * (x[2] - prev_z);
+			for (size_t k=0; k<3; k++) points[3 * i + k] = x[k];
+		}
+		return sweep3D(points.data(), N, reference.data());
+	}
+	else throw runtime_error("[hypervolume] number of objectives must be at least 2");
+}
 
-			// check whether x is dominated
-			map<double, double>::iterator worse = front2D.upper_bound(x[0]);
-			double b = reference[1];
-			if (worse != front2D.begin())
-			{
-				map<double, double>::iterator better = worse;
-				if (better == front2D.end() || better->first > x[0]) --better;
-				if (better->second <= x[1]) continue;
-				b = better->second;
-			}
 
-			// remove dominated points
-			while (worse != front2D.end())
-			{
-				if (worse->second < x[1]) break;
-				map<double, double>::iterator it = worse;
-				++worse;
-				double r = (worse == front2D.end()) ? reference[0]: worse->first;
-				area -= (r - it->first) * (b - it->second);
-				front2D.erase(it);
-			}
+////////////////////////////////////////////////////////////
+// Monte Carlo estimation of the hypervolume.
+//
+double hypervolumeMonteCarlo(Vector const& reference, ParetoFront const& front, double error, unsigned int seed)
+{
+	if (error <= 0.0) throw runtime_error("[hypervolumeMonteCarlo] error bound must be positive");
+	size_t m = reference.size();
+	if (front.empty()) return 0.0;
 
-			// insert x
-			front2D[x[0]] = x[1];
-			double r = (worse == front2D.end()) ? reference[0] : worse->first;
-			area += (r - x[0]) * (b - x[1]);
+	// bounding box of the dominated region
+	Vector lower = reference.copy();
+	for (size_t i=0; i<front.size(); i++)
+	{
+		for (size_t k=0; k<m; k++) lower[k] = min(lower[k], front[i][k]);
+	}
+	double box = 1.0;
+	for (size_t k=0; k<m; k++) box *= reference[k] - lower[k];
+	if (box <= 0.0) return 0.0;
 
-			prev_z = x[2];
-		}
-		volume += area * (reference[2] - prev_z);
-		return volume;
+	// The standard error of the estimate is bounded by
+	// box * 0.5 / sqrt(samples). The number of samples is capped,
+	// which also keeps the conversion to size_t defined.
+	const double maxSamples = 1e8;
+	double s = 0.5 * box / error;
+	size_t samples = (size_t)std::ceil(std::min(s * s, maxSamples));
+	RNG rng(seed);
+	Vector x(m);
+	size_t hits = 0;
+	for (size_t i=0; i<samples; i++)
+	{
+		for (size_t k=0; k<m; k++) x[k] = rng.uniform(lower[k], reference[k]);
+		if (front.dominates(x)) hits++;
 	}
-	else throw runtime_error("[hypervolume] number of objectives must be 2 or 3");
+	return box * (double)hits / (double)samples;
 }
+
@@ -6,6 +6,19 @@
 
 
 ////////////////////////////////////////////////////////////
-// 2D and 3D hypervolume computation in N log(N) operations.
+// Exact hypervolume computation, in N log(N) operations for 2D
+// and 3D, with the WFG algorithm for four and more objectives.
 //
 double hypervolume(Vector const& reference, ParetoFront const& front);
+
+
+////////////////////////////////////////////////////////////
+// Monte Carlo estimate of the hypervolume. Samples are drawn
+// uniformly from the bounding box of the front and the reference
+// point. Their number is chosen such that the standard error of
+// the estimate does not exceed #error, up to a cap of 1e8
+// samples. The samples depend only on the seed, hence the
+// estimate is reproducible.
+//
+double hypervolumeMonteCarlo(Vector const& reference, ParetoFront const& front, double error, unsigned int seed = 1);
+
@@ -1,6 +1,12 @@
 
 #include "interpreter.h"
 #include "parser.h"
+#include "bytecode.h"
+#include "jit.h"
+#include "gradient.h"
+#include "batch.h"
+#include "kernels.h"
+#include "vecmath.h"
 #include <sstream>
 #include <stdexcept>
 #include <cmath>
@@ -8,6 +14,9 @@
 #include <cassert>
 #include <vector>
 #include <algorithm>
+#include <mutex>
+#include <functional>
+#include <cstdint>
 
 
 #ifndef M_PI
@@ -24,10 +33,76 @@ using namespace std;
 ////////////////////////////////////////////////////////////
 
 
+// values of auxiliary variables during the evaluation of a tree
+struct Frame
+{
+	Frame(size_t n = 0)
+	: scalars(n)
+	, vectors(n)
+	{ }
+
+	template <typename T>
+	T& get(size_t index);
+	template <typename T>
+	T const& get(size_t index) const
+	{ return const_cast<Frame*>(this)->get<T>(index); }
+
+	vector<double> scalars;
+	vector<Vector> vectors;
+};
+template <>
+double& Frame::get<double>(size_t index)
+{ return scalars[index]; }
+template <>
+Vector& Frame::get<Vector>(size_t index)
+{ return vectors[index]; }
+
+// frame for the evaluation of constant sub-expressions
+const Frame noframe;
+
+// Frames of the tree interpreter are reused across evaluations, one
+// per nesting level, hence steady-state evaluation does not allocate.
+// Vectors are released after each evaluation, since they may live in
+// the arena of an ArenaScope.
+struct FramePool
+{
+	FramePool()
+	: depth(0)
+	{ }
+
+	vector< unique_ptr<Frame> > frames;
+	size_t depth;
+};
+thread_local FramePool t_framePool;
+
+struct PooledFrame
+{
+	explicit PooledFrame(size_t n)
+	{
+		FramePool& pool = t_framePool;
+		if (pool.depth == pool.frames.size()) pool.frames.push_back(unique_ptr<Frame>(new Frame()));
+		frame = pool.frames[pool.depth++].get();
+		frame->scalars.resize(n);
+		frame->vectors.resize(n);
+	}
+
+	~PooledFrame()
+	{
+		for (size_t i=0; i<frame->vectors.size(); i++) frame->vectors[i] = Vector();
+		t_framePool.depth--;
+	}
+
+	Frame* frame;
+};
+
+
 struct ExpressionBase
 {
 	virtual ~ExpressionBase()
 	{ }
+
+	// lower the node into bytecode, return the result register
+	virtual int emit(Compiler& comp) const = 0;
 };
 typedef shared_ptr< ExpressionBase > BaseExPtr;
 
@@ -63,7 +138,7 @@ struct ExPtr {
 template <typename T, typename VAR>
 struct ExpressionT : public ExpressionU<VAR>
 {
-	virtual T eval(VAR const& x) const = 0;
+	virtual T eval(VAR const& x, Frame const& frame) const = 0;
 };
 
 template <typename T, typename VAR>
@@ -92,9 +167,12 @@ struct Constant : public ExpressionT<T, VAR>
 	: value(v)
 	{ }
 
-	T eval(VAR const& x) const
+	T eval(VAR const& x, Frame const& frame) const
 	{ return value; }
 
+	int emit(Compiler& comp) const
+	{ return comp.constant(value); }
+
 	T value;
 };
 typedef Constant<double, double> SSConstant;
@@ -112,40 +190,48 @@ struct Variable : public ExpressionT<T, T>
 	Variable()
 	{ }
 
-	T eval(T const& x) const
+	T eval(T const& x, Frame const& frame) const
 	{ return x; }
+
+	int emit(Compiler& comp) const
+	{ return ParameterTraits<T>::isVector ? comp.input() : comp.argument(); }
 };
 
 struct AuxiliaryVariableBase
 {
-	AuxiliaryVariableBase(string name_)
+	AuxiliaryVariableBase(string name_, size_t index_)
 	: name(name_)
+	, index(index_)
 	{ }
 
 	virtual ~AuxiliaryVariableBase()
 	{ }
 
-	virtual void preeval(Vector const& x) = 0;
+	virtual void preeval(Vector const& x, Frame& frame) const = 0;
+	virtual void emit(Compiler& comp) const = 0;
 
 	string name;
+	size_t index;                  // position of the value in the frame
 };
 
 template <typename T>
 struct AuxiliaryVariable : public AuxiliaryVariableBase
 {
-	AuxiliaryVariable(string name_, typename ExPtrT<T, Vector>::type ex_)
-	: AuxiliaryVariableBase(name_)
+	AuxiliaryVariable(string name_, size_t index_, typename ExPtrT<T, Vector>::type ex_)
+	: AuxiliaryVariableBase(name_, index_)
 	, ex(ex_)
 	{ }
 
-	void preeval(Vector const& x)
-	{ value = ex->eval(x); }
+	void preeval(Vector const& x, Frame& frame) const
+	{ frame.get<T>(index) = ex->eval(x, frame); }
 
-	T eval() const
-	{ return value; }
+	void emit(Compiler& comp) const
+	{ comp.bind(this, ex->emit(comp)); }
+
+	T eval(Frame const& frame) const
+	{ return frame.get<T>(index); }
 
 	typename ExPtrT<T, Vector>::type ex;
-	T value;
 };
 typedef AuxiliaryVariable<double> SAuxiliaryVariable;
 typedef AuxiliaryVariable<Vector> VAuxiliaryVariable;
@@ -162,8 +248,11 @@ struct VariableReference : public ExpressionT<T, VAR>
 	: aux(aux_)
 	{ }
 
-	T eval(VAR const& x) const
-	{ return aux->eval(); }
+	T eval(VAR const& x, Frame const& frame) const
+	{ return aux->eval(frame); }
+
+	int emit(Compiler& comp) const
+	{ return comp.lookup(aux.get()); }
 
 	shared_ptr< AuxiliaryVariable<T> > aux;
 };
@@ -175,8 +264,16 @@ struct Negation : public ExpressionT<T, VAR>
 	: ex(ex_)
 	{ }
 
-	T eval(VAR const& x) const
-	{ return -ex->eval(x); }
+	T eval(VAR const& x, Frame const& frame) const
+	{ return -ex->eval(x, frame); }
+
+	int emit(Compiler& comp) const
+	{
+		int a = ex->emit(comp);
+		int r = ParameterTraits<T>::isVector ? comp.vector() : comp.scalar();
+		comp.emit(ParameterTraits<T>::isVector ? opVNeg : opSNeg, r, a);
+		return r;
+	}
 
 	typename ExPtrT<T, VAR>::type ex;
 };
@@ -193,6 +290,15 @@ struct BinaryOperator : public ExpressionT<RET, VAR>
 	, rhs(rhs_)
 	{ }
 
+	int emitBinary(Compiler& comp, Opcode op) const
+	{
+		int a = lhs->emit(comp);
+		int b = rhs->emit(comp);
+		int r = ParameterTraits<RET>::isVector ? comp.vector() : comp.scalar();
+		comp.emit(op, r, a, b);
+		return r;
+	}
+
 	typename ExPtrT<LHS, VAR>::type lhs;
 	typename ExPtrT<RHS, VAR>::type rhs;
 };
@@ -206,8 +312,11 @@ struct Sum : public BinaryOperator<T, T, T, VAR>
 	: BaseType(l, r)
 	{ }
 
-	T eval(VAR const& x) const
-	{ return BaseType::lhs->eval(x) + BaseType::rhs->eval(x); }
+	T eval(VAR const& x, Frame const& frame) const
+	{ return BaseType::lhs->eval(x, frame) + BaseType::rhs->eval(x, frame); }
+
+	int emit(Compiler& comp) const
+	{ return BaseType::emitBinary(comp, ParameterTraits<T>::isVector ? opVAdd : opSAdd); }
 };
 
 template <typename T, typename VAR>
@@ -219,8 +328,11 @@ struct Difference : public BinaryOperator<T, T, T, VAR>
 	: BaseType(l, r)
 	{ }
 
-	T eval(VAR const& x) const
-	{ return BaseType::lhs->eval(x) - BaseType::rhs->eval(x); }
+	T eval(VAR const& x, Frame const& frame) const
+	{ return BaseType::lhs->eval(x, frame) - BaseType::rhs->eval(x, frame); }
+
+	int emit(Compiler& comp) const
+	{ return BaseType::emitBinary(comp, ParameterTraits<T>::isVector ? opVSub : opSSub); }
 };
 
 template <typename LHS, typename RHS, typename RET, typename VAR>
@@ -232,7 +344,10 @@ struct Product : public BinaryOperator<LHS, RHS, RET, VAR>
 	: BaseType(l, r)
 	{ throw runtime_error("invalid specialization"); }
 
-	RET eval(VAR const& x) const
+	RET eval(VAR const& x, Frame const& frame) const
+	{ throw runtime_error("invalid specialization"); }
+
+	int emit(Compiler& comp) const
 	{ throw runtime_error("invalid specialization"); }
 };
 
@@ -245,8 +360,11 @@ struct Product<Vector, Vector, double, VAR> : public BinaryOperator<Vector, Vect
 	: BaseType(l, r)
 	{ }
 
-	double eval(VAR const& x) const
-	{ return BaseType::lhs->eval(x) * BaseType::rhs->eval(x); }
+	double eval(VAR const& x, Frame const& frame) const
+	{ return BaseType::lhs->eval(x, frame) * BaseType::rhs->eval(x, frame); }
+
+	int emit(Compiler& comp) const
+	{ return BaseType::emitBinary(comp, opSDot); }
 };
 
 template <typename VAR>
@@ -258,8 +376,11 @@ struct Product<Vector, double, Vector, VAR> : public BinaryOperator<Vector, doub
 	: BaseType(l, r)
 	{ }
 
-	Vector eval(VAR const& x) const
-	{ return BaseType::lhs->eval(x) * BaseType::rhs->eval(x); }
+	Vector eval(VAR const& x, Frame const& frame) const
+	{ return BaseType::lhs->eval(x, frame) * BaseType::rhs->eval(x, frame); }
+
+	int emit(Compiler& comp) const
+	{ return BaseType::emitBinary(comp, opVScale); }
 };
 
 template <typename VAR>
@@ -271,8 +392,18 @@ struct Product<double, Vector, Vector, VAR> : public BinaryOperator<double, Vect
 	: BaseType(l, r)
 	{ }
 
-	Vector eval(VAR const& x) const
-	{ return BaseType::lhs->eval(x) * BaseType::rhs->eval(x); }
+	Vector eval(VAR const& x, Frame const& frame) const
+	{ return BaseType::lhs->eval(x, frame) * BaseType::rhs->eval(x, frame); }
+
+	// scalar times vector is computed as vector times scalar
+	int emit(Compiler& comp) const
+	{
+		int a = BaseType::lhs->emit(comp);
+		int b = BaseType::rhs->emit(comp);
+		int r = comp.vector();
+		comp.emit(opVScale, r, b, a);
+		return r;
+	}
 };
 
 template <typename VAR>
@@ -284,8 +415,11 @@ struct Product<double, double, double, VAR> : public BinaryOperator<double, doub
 	: BaseType(l, r)
 	{ }
 
-	double eval(VAR const& x) const
-	{ return BaseType::lhs->eval(x) * BaseType::rhs->eval(x); }
+	double eval(VAR const& x, Frame const& frame) const
+	{ return BaseType::lhs->eval(x, frame) * BaseType::rhs->eval(x, frame); }
+
+	int emit(Compiler& comp) const
+	{ return BaseType::emitBinary(comp, opSMul); }
 };
 
 template <typename T, typename VAR>
@@ -297,8 +431,11 @@ struct Quotient : public BinaryOperator<T, double, T, VAR>
 	: BaseType(l, r)
 	{ }
 
-	T eval(VAR const& x) const
-	{ return BaseType::lhs->eval(x) / BaseType::rhs->eval(x); }
+	T eval(VAR const& x, Frame const& frame) const
+	{ return BaseType::lhs->eval(x, frame) / BaseType::rhs->eval(x, frame); }
+
+	int emit(Compiler& comp) const
+	{ return BaseType::emitBinary(comp, ParameterTraits<T>::isVector ? opVDiv : opSDiv); }
 };
 
 template <typename VAR>
@@ -310,8 +447,11 @@ struct Power : public BinaryOperator<double, double, double, VAR>
 	: BaseType(l, r)
 	{ }
 
-	double eval(VAR const& x) const
-	{ return pow(BaseType::lhs->eval(x), BaseType::rhs->eval(x)); }
+	double eval(VAR const& x, Frame const& frame) const
+	{ return mathPow(BaseType::lhs->eval(x, frame), BaseType::rhs->eval(x, frame)); }
+
+	int emit(Compiler& comp) const
+	{ return BaseType::emitBinary(comp, opSPow); }
 };
 
 template <typename VAR>
@@ -323,10 +463,13 @@ struct ElemProduct : public BinaryOperator<Vector, Vector, Vector, VAR>
 	: BaseType(l, r)
 	{ }
 
-	Vector eval(VAR const& x) const
+	Vector eval(VAR const& x, Frame const& frame) const
 	{
-		return BaseType::lhs->eval(x).elemProduct(BaseType::rhs->eval(x));
+		return BaseType::lhs->eval(x, frame).elemProduct(BaseType::rhs->eval(x, frame));
 	}
+
+	int emit(Compiler& comp) const
+	{ return BaseType::emitBinary(comp, opVEMul); }
 };
 
 template <typename VAR>
@@ -338,10 +481,13 @@ struct ElemQuotient : public BinaryOperator<Vector, Vector, Vector, VAR>
 	: BaseType(l, r)
 	{ }
 
-	Vector eval(VAR const& x) const
+	Vector eval(VAR const& x, Frame const& frame) const
 	{
-		return BaseType::lhs->eval(x).elemQuotient(BaseType::rhs->eval(x));
+		return BaseType::lhs->eval(x, frame).elemQuotient(BaseType::rhs->eval(x, frame));
 	}
+
+	int emit(Compiler& comp) const
+	{ return BaseType::emitBinary(comp, opVEDiv); }
 };
 
 template <typename RHS, typename VAR>
@@ -353,10 +499,13 @@ struct ElemPower : public BinaryOperator<Vector, RHS, Vector, VAR>
 	: BaseType(l, r)
 	{ }
 
-	Vector eval(VAR const& x) const
+	Vector eval(VAR const& x, Frame const& frame) const
 	{
-		return BaseType::lhs->eval(x).elemPower(BaseType::rhs->eval(x));
+		return BaseType::lhs->eval(x, frame).elemPower(BaseType::rhs->eval(x, frame));
 	}
+
+	int emit(Compiler& comp) const
+	{ return BaseType::emitBinary(comp, ParameterTraits<RHS>::isVector ? opVEPowV : opVEPowS); }
 };
 
 template <typename VAR>
@@ -366,8 +515,16 @@ struct Dimension : public ExpressionT<double, VAR>
 	: arg(arg_)
 	{ }
 
-	double eval(VAR const& x) const
-	{ return (double)arg->eval(x).size(); }
+	double eval(VAR const& x, Frame const& frame) const
+	{ return (double)arg->eval(x, frame).size(); }
+
+	int emit(Compiler& comp) const
+	{
+		int a = arg->emit(comp);
+		int r = comp.scalar();
+		comp.emit(opSDim, r, a);
+		return r;
+	}
 
 	typename ExPtrT<Vector, VAR>::type arg;
 };
@@ -381,7 +538,7 @@ struct VectorComposition : public ExpressionT<Vector, VAR>
 		isV.push_back(isVector<VAR>(ex));
 	}
 
-	Vector eval(VAR const& x) const
+	Vector eval(VAR const& x, Frame const& frame) const
 	{
 		vector<Vector> subvec(sub.size());
 		size_t total = 0;
@@ -390,7 +547,7 @@ struct VectorComposition : public ExpressionT<Vector, VAR>
 			if (isV[i])
 			{
 				typename ExPtrT<Vector, VAR>::type ex = static_pointer_cast< ExpressionT<Vector, VAR> >(sub[i]);
-				subvec[i] = ex->eval(x);
+				subvec[i] = ex->eval(x, frame);
 				total += subvec[i].size();
 			}
 			else total++;
@@ -407,7 +564,7 @@ struct VectorComposition : public ExpressionT<Vector, VAR>
 			else
 			{
 				typename ExPtrT<double, VAR>::type ex = static_pointer_cast< ExpressionT<double, VAR> >(sub[i]);
-				double v = ex->eval(x);
+				double v = ex->eval(x, frame);
 				ret[pos] = v;
 				pos++;
 			}
@@ -415,6 +572,19 @@ struct VectorComposition : public ExpressionT<Vector, VAR>
 		return ret;
 	}
 
+	int emit(Compiler& comp) const
+	{
+		vector<Operand> operands(sub.size());
+		for (size_t i=0; i<sub.size(); i++)
+		{
+			operands[i].isVector = isV[i];
+			operands[i].reg = sub[i]->emit(comp);
+		}
+		int r = comp.vector();
+		comp.emit(opVCompose, r, comp.composition(operands));
+		return r;
+	}
+
 	vector< typename ExPtr<VAR>::type > sub;
 	vector< bool > isV;
 };
@@ -429,15 +599,24 @@ struct VectorEntry : public ExpressionT<double, VAR>
 	, index(index_)
 	{ }
 
-	double eval(VAR const& x) const
+	double eval(VAR const& x, Frame const& frame) const
 	{
-		Vector tmp = base->eval(x);
-		int i = (int)floor(index->eval(x));
+		Vector tmp = base->eval(x, frame);
+		int i = (int)floor(index->eval(x, frame));
 		if (i < 1 || i > (int)tmp.size()) throw runtime_error("index out of bounds");
 		i--;
 		return tmp[i];
 	}
 
+	int emit(Compiler& comp) const
+	{
+		int a = base->emit(comp);
+		int b = index->emit(comp);
+		int r = comp.scalar();
+		comp.emit(opSEntry, r, a, b);
+		return r;
+	}
+
 	typename ExPtrT<Vector, VAR>::type base;
 	typename ExPtrT<double, VAR>::type index;
 };
@@ -454,11 +633,11 @@ struct VectorRange : public ExpressionT<Vector, VAR>
 	, last(last_)
 	{ }
 
-	Vector eval(VAR const& x) const
+	Vector eval(VAR const& x, Frame const& frame) const
 	{
-		Vector tmp = base->eval(x);
-		int f = (int)floor(first->eval(x));
-		int l = (int)floor(last->eval(x));
+		Vector tmp = base->eval(x, frame);
+		int f = (int)floor(first->eval(x, frame));
+		int l = (int)floor(last->eval(x, frame));
 		int size = l - f + 1;
 		if (f < 1 || l > (int)tmp.size() || size < 0) throw runtime_error("dimension mismatch");
 		int b = f - 1;
@@ -468,6 +647,16 @@ struct VectorRange : public ExpressionT<Vector, VAR>
 		return ret;
 	}
 
+	int emit(Compiler& comp) const
+	{
+		int a = base->emit(comp);
+		int b = first->emit(comp);
+		int c = last->emit(comp);
+		int r = comp.vector();
+		comp.emit(opVRange, r, a, b, c);
+		return r;
+	}
+
 	typename ExPtrT<Vector, VAR>::type base;
 	typename ExPtrT<double, VAR>::type first;
 	typename ExPtrT<double, VAR>::type last;
@@ -483,13 +672,21 @@ struct ConstVect : public ExpressionT<Vector, VAR>
 	, value(value_)
 	{ }
 
-	Vector eval(VAR const& x) const
+	Vector eval(VAR const& x, Frame const& frame) const
 	{
-		int sz = (int)floor(size->eval(x));
+		int sz = (int)floor(size->eval(x, frame));
 		if (sz < 0) throw runtime_error("dimension must be non-negative");
 		return Vector(sz, value);
 	}
 
+	int emit(Compiler& comp) const
+	{
+		int a = size->emit(comp);
+		int r = comp.vector();
+		comp.emit(opVFill, r, a, -1, -1, value);
+		return r;
+	}
+
 	typename ExPtrT<double, VAR>::type size;
 	double value;
 };
@@ -501,15 +698,23 @@ struct RangeVect : public ExpressionT<Vector, VAR>
 	: size(size_)
 	{ }
 
-	Vector eval(VAR const& x) const
+	Vector eval(VAR const& x, Frame const& frame) const
 	{
-		int sz = (int)floor(size->eval(x));
+		int sz = (int)floor(size->eval(x, frame));
 		if (sz < 0) throw runtime_error("dimension must be non-negative");
 		Vector ret((size_t)sz);
 		for (int i=0; i<sz; i++) ret[i] = i + 1;
 		return ret;
 	}
 
+	int emit(Compiler& comp) const
+	{
+		int a = size->emit(comp);
+		int r = comp.vector();
+		comp.emit(opVIota, r, a);
+		return r;
+	}
+
 	typename ExPtrT<double, VAR>::type size;
 };
 
@@ -523,16 +728,26 @@ struct ComponentWiseOperation : public ExpressionT<Vector, VAR>
 	, func(func_)
 	{ }
 
-	Vector eval(VAR const& x) const
+	Vector eval(VAR const& x, Frame const& frame) const
 	{
-		Vector tmp = base->eval(x);
+		Vector tmp = base->eval(x, frame);
 		for (size_t i=0; i<tmp.size(); i++)
 		{
-			tmp[i] = func->eval(tmp[i]);
+			tmp[i] = func->eval(tmp[i], frame);
 		}
 		return tmp;
 	}
 
+	int emit(Compiler& comp) const
+	{
+		int a = base->emit(comp);
+		comp.beginLambda();
+		int l = comp.endLambda(func->emit(comp));
+		int r = comp.vector();
+		comp.emit(opVApply, r, a, l);
+		return r;
+	}
+
 	typename ExPtrT<Vector, VAR>::type base;
 	ExPtrT<double, double>::type func;
 };
@@ -544,12 +759,18 @@ struct SumAggregation : public ExpressionT<double, VAR>
 	: base(base_)
 	{ }
 
-	double eval(VAR const& x) const
+	double eval(VAR const& x, Frame const& frame) const
 	{
-		Vector tmp = base->eval(x);
-		double ret = 0.0;
-		for (size_t i=0; i<tmp.size(); i++) ret += tmp[i];
-		return ret;
+		Vector tmp = base->eval(x, frame);
+		return kernelSum(tmp.begin(), tmp.size());
+	}
+
+	int emit(Compiler& comp) const
+	{
+		int a = base->emit(comp);
+		int r = comp.scalar();
+		comp.emit(opSSum, r, a);
+		return r;
 	}
 
 	typename ExPtrT<Vector, VAR>::type base;
@@ -562,12 +783,18 @@ struct ProductAggregation : public ExpressionT<double, VAR>
 	: base(base_)
 	{ }
 
-	double eval(VAR const& x) const
+	double eval(VAR const& x, Frame const& frame) const
 	{
-		Vector tmp = base->eval(x);
-		double ret = 1.0;
-		for (size_t i=0; i<tmp.size(); i++) ret *= tmp[i];
-		return ret;
+		Vector tmp = base->eval(x, frame);
+		return kernelProduct(tmp.begin(), tmp.size());
+	}
+
+	int emit(Compiler& comp) const
+	{
+		int a = base->emit(comp);
+		int r = comp.scalar();
+		comp.emit(opSProd, r, a);
+		return r;
 	}
 
 	typename ExPtrT<Vector, VAR>::type base;
@@ -580,12 +807,18 @@ struct TwoNorm : public ExpressionT<double, VAR>
 	: base(base_)
 	{ }
 
-	double eval(VAR const& x) const
+	double eval(VAR const& x, Frame const& frame) const
+	{
+		Vector tmp = base->eval(x, frame);
+		return std::sqrt(kernelSqrNorm(tmp.begin(), tmp.size()));
+	}
+
+	int emit(Compiler& comp) const
 	{
-		Vector tmp = base->eval(x);
-		double norm2 = 0.0;
-		for (size_t i=0; i<tmp.size(); i++) norm2 += tmp[i] * tmp[i];
-		return std::sqrt(norm2);
+		int a = base->emit(comp);
+		int r = comp.scalar();
+		comp.emit(opSNorm, r, a);
+		return r;
 	}
 
 	typename ExPtrT<Vector, VAR>::type base;
@@ -598,12 +831,18 @@ struct TwoNorm2 : public ExpressionT<double, VAR>
 	: base(base_)
 	{ }
 
-	double eval(VAR const& x) const
+	double eval(VAR const& x, Frame const& frame) const
+	{
+		Vector tmp = base->eval(x, frame);
+		return kernelSqrNorm(tmp.begin(), tmp.size());
+	}
+
+	int emit(Compiler& comp) const
 	{
-		Vector tmp = base->eval(x);
-		double norm2 = 0.0;
-		for (size_t i=0; i<tmp.size(); i++) norm2 += tmp[i] * tmp[i];
-		return norm2;
+		int a = base->emit(comp);
+		int r = comp.scalar();
+		comp.emit(opSSqrNorm, r, a);
+		return r;
 	}
 
 	typename ExPtrT<Vector, VAR>::type base;
@@ -616,14 +855,22 @@ struct MinAggregation : public ExpressionT<double, VAR>
 	: base(base_)
 	{ }
 
-	double eval(VAR const& x) const
+	double eval(VAR const& x, Frame const& frame) const
 	{
-		Vector tmp = base->eval(x);
+		Vector tmp = base->eval(x, frame);
 		double ret = tmp[0];
 		for (size_t i=1; i<tmp.size(); i++) ret = std::min(ret, tmp[i]);
 		return ret;
 	}
 
+	int emit(Compiler& comp) const
+	{
+		int a = base->emit(comp);
+		int r = comp.scalar();
+		comp.emit(opSMin, r, a);
+		return r;
+	}
+
 	typename ExPtrT<Vector, VAR>::type base;
 };
 
@@ -634,14 +881,22 @@ struct MaxAggregation : public ExpressionT<double, VAR>
 	: base(base_)
 	{ }
 
-	double eval(VAR const& x) const
+	double eval(VAR const& x, Frame const& frame) const
 	{
-		Vector tmp = base->eval(x);
+		Vector tmp = base->eval(x, frame);
 		double ret = tmp[0];
 		for (size_t i=1; i<tmp.size(); i++) ret = std::max(ret, tmp[i]);
 		return ret;
 	}
 
+	int emit(Compiler& comp) const
+	{
+		int a = base->emit(comp);
+		int r = comp.scalar();
+		comp.emit(opSMax, r, a);
+		return r;
+	}
+
 	typename ExPtrT<Vector, VAR>::type base;
 };
 
@@ -653,6 +908,60 @@ double round(double t)
 double sqr(double t)
 { return (t * t); }
 
+// derivatives of the scalar functions, for automatic differentiation
+static double dZero(double)
+{ return 0.0; }
+static double dAbs(double t)
+{ return (t > 0.0) ? 1.0 : (t < 0.0) ? -1.0 : 0.0; }
+static double dSqr(double t)
+{ return 2.0 * t; }
+static double dSqrt(double t)
+{ return 0.5 / sqrt(t); }
+static double dLog(double t)
+{ return 1.0 / t; }
+static double dLog10(double t)
+{ return 1.0 / (t * log(10.0)); }
+static double dCos(double t)
+{ return -mathSin(t); }
+static double dTan(double t)
+{ double c = cos(t); return 1.0 / (c * c); }
+static double dTanh(double t)
+{ double h = tanh(t); return 1.0 - h * h; }
+static double dAsin(double t)
+{ return 1.0 / sqrt(1.0 - t * t); }
+static double dAcos(double t)
+{ return -1.0 / sqrt(1.0 - t * t); }
+static double dAtan(double t)
+{ return 1.0 / (1.0 + t * t); }
+
+ScalarFunction derivative(ScalarFunction f)
+{
+	static const func table[][2] =
+	{
+		{ abs, dAbs }, { floor, dZero }, { ceil, dZero }, { round, dZero },
+		{ sqr, dSqr }, { sqrt, dSqrt }, { mathExp, mathExp }, { mathLog, dLog },
+		{ log10, dLog10 }, { mathSin, mathCos }, { mathCos, dCos }, { tan, dTan },
+		{ sinh, cosh }, { cosh, sinh }, { tanh, dTanh }, { asin, dAsin },
+		{ acos, dAcos }, { atan, dAtan },
+	};
+	for (size_t i=0; i<sizeof(table) / sizeof(table[0]); i++) if (table[i][0] == f) return table[i][1];
+	return nullptr;
+}
+
+IntervalFunction enclosure(ScalarFunction f)
+{
+	static const struct { func f; IntervalFunction g; } table[] =
+	{
+		{ abs, intervalAbs }, { floor, intervalFloor }, { ceil, intervalCeil }, { round, intervalRound },
+		{ sqr, intervalSqr }, { sqrt, intervalSqrt }, { mathExp, intervalExp }, { mathLog, intervalLog },
+		{ log10, intervalLog10 }, { mathSin, intervalSin }, { mathCos, intervalCos }, { tan, intervalTan },
+		{ sinh, intervalSinh }, { cosh, intervalCosh }, { tanh, intervalTanh }, { asin, intervalAsin },
+		{ acos, intervalAcos }, { atan, intervalAtan },
+	};
+	for (size_t i=0; i<sizeof(table) / sizeof(table[0]); i++) if (table[i].f == f) return table[i].g;
+	return nullptr;
+}
+
 template <typename VAR>
 struct Function : public ExpressionT<double, VAR>
 {
@@ -661,8 +970,16 @@ struct Function : public ExpressionT<double, VAR>
 	, inner(inner_)
 	{ }
 
-	double eval(VAR const& x) const
-	{ return f(inner->eval(x)); }
+	double eval(VAR const& x, Frame const& frame) const
+	{ return f(inner->eval(x, frame)); }
+
+	int emit(Compiler& comp) const
+	{
+		int a = inner->emit(comp);
+		int r = comp.scalar();
+		comp.emit(opSFunc, r, a, -1, -1, 0.0, f);
+		return r;
+	}
 
 	func f;
 	typename ExPtrT<double, VAR>::type inner;
@@ -824,7 +1141,7 @@ typename ExPtr<VAR>::type createExpression(const Node* node, Variables& aux)
 				typename ExPtr<VAR>::type rhs = expression[i + 1];
 				if (! isScalar<VAR>(lhs) || ! isScalar<VAR>(rhs)) throw runtime_error("operator ^ requires scalar operands");
 				typename ExPtrT<double, VAR>::type p(new Power<VAR>(asScalar<VAR>(lhs), asScalar<VAR>(rhs)));
-				if (isConstant<VAR>(lhs) && isConstant<VAR>(rhs)) p = typename ExPtrT<double, VAR>::type(new Constant<double, VAR>(p->eval(0.0)));
+				if (isConstant<VAR>(lhs) && isConstant<VAR>(rhs)) p = typename ExPtrT<double, VAR>::type(new Constant<double, VAR>(p->eval(0.0, noframe)));
 				symbol.erase(symbol.begin() + i);
 				expression.erase(expression.begin() + i);
 				expression[i] = p;
@@ -838,7 +1155,7 @@ typename ExPtr<VAR>::type createExpression(const Node* node, Variables& aux)
 				if (isScalar<VAR>(rhs))
 				{
 					typename ExPtrT<Vector, VAR>::type p(new ElemPower<double, VAR>(asVector<VAR>(lhs), asScalar<VAR>(rhs)));
-					if (isConstant<VAR>(lhs) && isConstant<VAR>(rhs)) p = typename ExPtrT<Vector, VAR>::type(new Constant<Vector, VAR>(p->eval(0.0)));
+					if (isConstant<VAR>(lhs) && isConstant<VAR>(rhs)) p = typename ExPtrT<Vector, VAR>::type(new Constant<Vector, VAR>(p->eval(0.0, noframe)));
 					symbol.erase(symbol.begin() + i);
 					expression.erase(expression.begin() + i);
 					expression[i] = p;
@@ -847,7 +1164,7 @@ typename ExPtr<VAR>::type createExpression(const Node* node, Variables& aux)
 				else
 				{
 					typename ExPtrT<Vector, VAR>::type p(new ElemPower<Vector, VAR>(asVector<VAR>(lhs), asVector<VAR>(rhs)));
-					if (isConstant<VAR>(lhs) && isConstant<VAR>(rhs)) p = typename ExPtrT<Vector, VAR>::type(new Constant<Vector, VAR>(p->eval(0.0)));
+					if (isConstant<VAR>(lhs) && isConstant<VAR>(rhs)) p = typename ExPtrT<Vector, VAR>::type(new Constant<Vector, VAR>(p->eval(0.0, noframe)));
 					symbol.erase(symbol.begin() + i);
 					expression.erase(expression.begin() + i);
 					expression[i] = p;
@@ -866,7 +1183,7 @@ typename ExPtr<VAR>::type createExpression(const Node* node, Variables& aux)
 					if (isScalar<VAR>(rhs))
 					{
 						typename ExPtrT<double, VAR>::type p(new Product<double, double, double, VAR>(asScalar<VAR>(lhs), asScalar<VAR>(rhs)));
-						if (isConstant<VAR>(lhs) && isConstant<VAR>(rhs)) p = typename ExPtrT<double, VAR>::type(new Constant<double, VAR>(p->eval(0.0)));
+						if (isConstant<VAR>(lhs) && isConstant<VAR>(rhs)) p = typename ExPtrT<double, VAR>::type(new Constant<double, VAR>(p->eval(0.0, noframe)));
 						symbol.erase(symbol.begin() + i);
 						expression.erase(expression.begin() + i);
 						expression[i] = p;
@@ -875,7 +1192,7 @@ typename ExPtr<VAR>::type createExpression(const Node* node, Variables& aux)
 					else
 					{
 						typename ExPtrT<Vector, VAR>::type p(new Product<double, Vector, Vector, VAR>(asScalar<VAR>(lhs), asVector<VAR>(rhs)));
-						if (isConstant<VAR>(lhs) && isConstant<VAR>(rhs)) p = typename ExPtrT<Vector, VAR>::type(new Constant<Vector, VAR>(p->eval(0.0)));
+						if (isConstant<VAR>(lhs) && isConstant<VAR>(rhs)) p = typename ExPtrT<Vector, VAR>::type(new Constant<Vector, VAR>(p->eval(0.0, noframe)));
 						symbol.erase(symbol.begin() + i);
 						expression.erase(expression.begin() + i);
 						expression[i] = p;
@@ -887,7 +1204,7 @@ typename ExPtr<VAR>::type createExpression(const Node* node, Variables& aux)
 					if (isScalar<VAR>(rhs))
 					{
 						typename ExPtrT<Vector, VAR>::type p(new Product<Vector, double, Vector, VAR>(asVector<VAR>(lhs), asScalar<VAR>(rhs)));
-						if (isConstant<VAR>(lhs) && isConstant<VAR>(rhs)) p = typename ExPtrT<Vector, VAR>::type(new Constant<Vector, VAR>(p->eval(0.0)));
+						if (isConstant<VAR>(lhs) && isConstant<VAR>(rhs)) p = typename ExPtrT<Vector, VAR>::type(new Constant<Vector, VAR>(p->eval(0.0, noframe)));
 						symbol.erase(symbol.begin() + i);
 						expression.erase(expression.begin() + i);
 						expression[i] = p;
@@ -896,7 +1213,7 @@ typename ExPtr<VAR>::type createExpression(const Node* node, Variables& aux)
 					else
 					{
 						typename ExPtrT<double, VAR>::type p(new Product<Vector, Vector, double, VAR>(asVector<VAR>(lhs), asVector<VAR>(rhs)));
-						if (isConstant<VAR>(lhs) && isConstant<VAR>(rhs)) p = typename ExPtrT<double, VAR>::type(new Constant<double, VAR>(p->eval(0.0)));
+						if (isConstant<VAR>(lhs) && isConstant<VAR>(rhs)) p = typename ExPtrT<double, VAR>::type(new Constant<double, VAR>(p->eval(0.0, noframe)));
 						symbol.erase(symbol.begin() + i);
 						expression.erase(expression.begin() + i);
 						expression[i] = p;
@@ -910,7 +1227,7 @@ typename ExPtr<VAR>::type createExpression(const Node* node, Variables& aux)
 				typename ExPtr<VAR>::type rhs = expression[i + 1];
 				if (! isVector<VAR>(lhs) || ! isVector<VAR>(rhs)) throw runtime_error("operator .* requires vectorial operands");
 				typename ExPtrT<Vector, VAR>::type p(new ElemProduct<VAR>(asVector<VAR>(lhs), asVector<VAR>(rhs)));
-				if (isConstant<VAR>(lhs) && isConstant<VAR>(rhs)) p = typename ExPtrT<Vector, VAR>::type(new Constant<Vector, VAR>(p->eval(0.0)));
+				if (isConstant<VAR>(lhs) && isConstant<VAR>(rhs)) p = typename ExPtrT<Vector, VAR>::type(new Constant<Vector, VAR>(p->eval(0.0, noframe)));
 				symbol.erase(symbol.begin() + i);
 				expression.erase(expression.begin() + i);
 				expression[i] = p;
@@ -924,7 +1241,7 @@ typename ExPtr<VAR>::type createExpression(const Node* node, Variables& aux)
 				if (isScalar<VAR>(lhs))
 				{
 					typename ExPtrT<double, VAR>::type p(new Quotient<double, VAR>(asScalar<VAR>(lhs), asScalar<VAR>(rhs)));
-					if (isConstant<VAR>(lhs) && isConstant<VAR>(rhs)) p = typename ExPtrT<double, VAR>::type(new Constant<double, VAR>(p->eval(0.0)));
+					if (isConstant<VAR>(lhs) && isConstant<VAR>(rhs)) p = typename ExPtrT<double, VAR>::type(new Constant<double, VAR>(p->eval(0.0, noframe)));
 					symbol.erase(symbol.begin() + i);
 					expression.erase(expression.begin() + i);
 					expression[i] = p;
@@ -933,7 +1250,7 @@ typename ExPtr<VAR>::type createExpression(const Node* node, Variables& aux)
 				else
 				{
 					typename ExPtrT<Vector, VAR>::type p(new Quotient<Vector, VAR>(asVector<VAR>(lhs), asScalar<VAR>(rhs)));
-					if (isConstant<VAR>(lhs) && isConstant<VAR>(rhs)) p = typename ExPtrT<Vector, VAR>::type(new Constant<Vector, VAR>(p->eval(0.0)));
+					if (isConstant<VAR>(lhs) && isConstant<VAR>(rhs)) p = typename ExPtrT<Vector, VAR>::type(new Constant<Vector, VAR>(p->eval(0.0, noframe)));
 					symbol.erase(symbol.begin() + i);
 					expression.erase(expression.begin() + i);
 					expression[i] = p;
@@ -946,7 +1263,7 @@ typename ExPtr<VAR>::type createExpression(const Node* node, Variables& aux)
 				typename ExPtr<VAR>::type rhs = expression[i + 1];
 				if (! isVector<VAR>(lhs) || ! isScalar<VAR>(rhs)) throw runtime_error("operator .* requires vectorial operands");
 				typename ExPtrT<Vector, VAR>::type p(new ElemQuotient<VAR>(asVector<VAR>(lhs), asVector<VAR>(rhs)));
-				if (isConstant<VAR>(lhs) && isConstant<VAR>(rhs)) p = typename ExPtrT<Vector, VAR>::type(new Constant<Vector, VAR>(p->eval(0.0)));
+				if (isConstant<VAR>(lhs) && isConstant<VAR>(rhs)) p = typename ExPtrT<Vector, VAR>::type(new Constant<Vector, VAR>(p->eval(0.0, noframe)));
 				symbol.erase(symbol.begin() + i);
 				expression.erase(expression.begin() + i);
 				expression[i] = p;
@@ -963,7 +1280,7 @@ typename ExPtr<VAR>::type createExpression(const Node* node, Variables& aux)
 				if (isScalar<VAR>(lhs))
 				{
 					typename ExPtrT<double, VAR>::type p(new Sum<double, VAR>(asScalar<VAR>(lhs), asScalar<VAR>(rhs)));
-					if (isConstant<VAR>(lhs) && isConstant<VAR>(rhs)) p = typename ExPtrT<double, VAR>::type(new Constant<double, VAR>(p->eval(0.0)));
+					if (isConstant<VAR>(lhs) && isConstant<VAR>(rhs)) p = typename ExPtrT<double, VAR>::type(new Constant<double, VAR>(p->eval(0.0, noframe)));
 					symbol.erase(symbol.begin() + i);
 					expression.erase(expression.begin() + i);
 					expression[i] = p;
@@ -972,7 +1289,7 @@ typename ExPtr<VAR>::type createExpression(const Node* node, Variables& aux)
 				else
 				{
 					typename ExPtrT<Vector, VAR>::type p(new Sum<Vector, VAR>(asVector<VAR>(lhs), asVector<VAR>(rhs)));
-					if (isConstant<VAR>(lhs) && isConstant<VAR>(rhs)) p = typename ExPtrT<Vector, VAR>::type(new Constant<Vector, VAR>(p->eval(0.0)));
+					if (isConstant<VAR>(lhs) && isConstant<VAR>(rhs)) p = typename ExPtrT<Vector, VAR>::type(new Constant<Vector, VAR>(p->eval(0.0, noframe)));
 					symbol.erase(symbol.begin() + i);
 					expression.erase(expression.begin() + i);
 					expression[i] = p;
@@ -987,7 +1304,7 @@ typename ExPtr<VAR>::type createExpression(const Node* node, Variables& aux)
 				if (isScalar<VAR>(lhs))
 				{
 					typename ExPtrT<double, VAR>::type p(new Difference<double, VAR>(asScalar<VAR>(lhs), asScalar<VAR>(rhs)));
-					if (isConstant<VAR>(lhs) && isConstant<VAR>(rhs)) p = typename ExPtrT<double, VAR>::type(new Constant<double, VAR>(p->eval(0.0)));
+					if (isConstant<VAR>(lhs) && isConstant<VAR>(rhs)) p = typename ExPtrT<double, VAR>::type(new Constant<double, VAR>(p->eval(0.0, noframe)));
 					symbol.erase(symbol.begin() + i);
 					expression.erase(expression.begin() + i);
 					expression[i] = p;
@@ -996,7 +1313,7 @@ typename ExPtr<VAR>::type createExpression(const Node* node, Variables& aux)
 				else
 				{
 					typename ExPtrT<Vector, VAR>::type p(new Difference<Vector, VAR>(asVector<VAR>(lhs), asVector<VAR>(rhs)));
-					if (isConstant<VAR>(lhs) && isConstant<VAR>(rhs)) p = typename ExPtrT<Vector, VAR>::type(new Constant<Vector, VAR>(p->eval(0.0)));
+					if (isConstant<VAR>(lhs) && isConstant<VAR>(rhs)) p = typename ExPtrT<Vector, VAR>::type(new Constant<Vector, VAR>(p->eval(0.0, noframe)));
 					symbol.erase(symbol.begin() + i);
 					expression.erase(expression.begin() + i);
 					expression[i] = p;
@@ -1016,13 +1333,13 @@ typename ExPtr<VAR>::type createExpression(const Node* node, Variables& aux)
 		if (isScalar<VAR>(rhs))
 		{
 			typename ExPtrT<double, VAR>::type p = typename ExPtrT<double, VAR>::type(new Negation<double, VAR>(asScalar<VAR>(rhs)));
-			if (isConstant<VAR>(rhs)) return typename ExPtrT<double, VAR>::type(new Constant<double, VAR>(p->eval(0.0)));
+			if (isConstant<VAR>(rhs)) return typename ExPtrT<double, VAR>::type(new Constant<double, VAR>(p->eval(0.0, noframe)));
 			else return p;
 		}
 		else
 		{
 			typename ExPtrT<Vector, VAR>::type p = typename ExPtrT<Vector, VAR>::type(new Negation<Vector, VAR>(asVector<VAR>(rhs)));
-			if (isConstant<VAR>(rhs)) return typename ExPtrT<Vector, VAR>::type(new Constant<Vector, VAR>(p->eval(0.0)));
+			if (isConstant<VAR>(rhs)) return typename ExPtrT<Vector, VAR>::type(new Constant<Vector, VAR>(p->eval(0.0, noframe)));
 			else return p;
 		}
 	}
@@ -1036,7 +1353,7 @@ typename ExPtr<VAR>::type createExpression(const Node* node, Variables& aux)
 		bool ex_const = isConstant<VAR>(ex);
 		if (ex_const)
 		{
-			ex = typename ExPtrT<Vector, VAR>::type(new Constant<Vector, VAR>(ex->eval(0.0)));
+			ex = typename ExPtrT<Vector, VAR>::type(new Constant<Vector, VAR>(ex->eval(0.0, noframe)));
 		}
 		for (size_t i=1; i<node->size(); i++)
 		{
@@ -1050,7 +1367,7 @@ typename ExPtr<VAR>::type createExpression(const Node* node, Variables& aux)
 				typename ExPtrT<double, VAR>::type p(new VectorEntry<VAR>(ex, asScalar<VAR>(index)));
 				if (ex_const && isConstant<VAR>(index))
 				{
-					return typename ExPtr<VAR>::type(new Constant<double, VAR>(p->eval(0.0)));
+					return typename ExPtr<VAR>::type(new Constant<double, VAR>(p->eval(0.0, noframe)));
 				}
 				else
 				{
@@ -1068,7 +1385,7 @@ typename ExPtr<VAR>::type createExpression(const Node* node, Variables& aux)
 				typename ExPtrT<Vector, VAR>::type p(new VectorRange<VAR>(ex, asScalar<VAR>(begin), asScalar<VAR>(end)));
 				if (ex_const && isConstant<VAR>(begin) && isConstant<VAR>(end))
 				{
-					ex = typename ExPtrT<Vector, VAR>::type(new Constant<Vector, VAR>(p->eval(0.0)));
+					ex = typename ExPtrT<Vector, VAR>::type(new Constant<Vector, VAR>(p->eval(0.0, noframe)));
 				}
 				else
 				{
@@ -1103,7 +1420,7 @@ typename ExPtr<VAR>::type createExpression(const Node* node, Variables& aux)
 				else if (funcname == "ones") f = new ConstVect<VAR>(sarg, 1.0);
 				else if (funcname == "range") f = new RangeVect<VAR>(sarg);
 				typename ExPtrT<Vector, VAR>::type p(f);
-				if (isConstant<VAR>(sarg)) return typename ExPtrT<Vector, VAR>::type(new Constant<Vector, VAR>(p->eval(0.0)));
+				if (isConstant<VAR>(sarg)) return typename ExPtrT<Vector, VAR>::type(new Constant<Vector, VAR>(p->eval(0.0, noframe)));
 				else return p;
 			}
 			else
@@ -1115,11 +1432,11 @@ typename ExPtr<VAR>::type createExpression(const Node* node, Variables& aux)
 				else if (funcname == "round") f = new Function<VAR>(round, sarg);
 				else if (funcname == "sqr") f = new Function<VAR>(sqr, sarg);
 				else if (funcname == "sqrt") f = new Function<VAR>(sqrt, sarg);
-				else if (funcname == "exp") f = new Function<VAR>(exp, sarg);
-				else if (funcname == "log") f = new Function<VAR>(log, sarg);
+				else if (funcname == "exp") f = new Function<VAR>(mathExp, sarg);
+				else if (funcname == "log") f = new Function<VAR>(mathLog, sarg);
 				else if (funcname == "log10") f = new Function<VAR>(log10, sarg);
-				else if (funcname == "sin") f = new Function<VAR>(sin, sarg);
-				else if (funcname == "cos") f = new Function<VAR>(cos, sarg);
+				else if (funcname == "sin") f = new Function<VAR>(mathSin, sarg);
+				else if (funcname == "cos") f = new Function<VAR>(mathCos, sarg);
 				else if (funcname == "tan") f = new Function<VAR>(tan, sarg);
 				else if (funcname == "sinh") f = new Function<VAR>(sinh, sarg);
 				else if (funcname == "cosh") f = new Function<VAR>(cosh, sarg);
@@ -1129,7 +1446,7 @@ typename ExPtr<VAR>::type createExpression(const Node* node, Variables& aux)
 				else if (funcname == "atan") f = new Function<VAR>(atan, sarg);
 				else throw runtime_error("function " + funcname + " cannot be applied to scalar argument");
 				typename ExPtrT<double, VAR>::type p(f);
-				if (isConstant<VAR>(sarg)) return typename ExPtrT<double, VAR>::type(new Constant<double, VAR>(p->eval(0.0)));
+				if (isConstant<VAR>(sarg)) return typename ExPtrT<double, VAR>::type(new Constant<double, VAR>(p->eval(0.0, noframe)));
 				else return p;
 			}
 		}
@@ -1146,7 +1463,7 @@ typename ExPtr<VAR>::type createExpression(const Node* node, Variables& aux)
 			else if (funcname == "max") f = new MaxAggregation<VAR>(varg);
 			else throw runtime_error("function " + funcname + " cannot be applied to vector argument");
 			typename ExPtrT<double, VAR>::type p(f);
-			if (isConstant<VAR>(varg)) return typename ExPtrT<double, VAR>::type(new Constant<double, VAR>(p->eval(0.0)));
+			if (isConstant<VAR>(varg)) return typename ExPtrT<double, VAR>::type(new Constant<double, VAR>(p->eval(0.0, noframe)));
 			else return p;
 		}
 	}
@@ -1196,38 +1513,188 @@ typename ExPtr<VAR>::type createExpression(const Node* node, Variables& aux)
 	}
 }
 
+// Slots identify the state of an expression in evaluation contexts.
+// Slots of destroyed expressions are reused, lowest first, hence contexts
+// grow with the number of live expressions only. Serial numbers are never
+// reused, they tell a context that a slot has changed hands. The allocator
+// is never destroyed, since expressions may outlive static objects.
+class SlotAllocator
+{
+public:
+	SlotAllocator()
+	: m_slots(0)
+	, m_serial(0)
+	{ }
+
+	static SlotAllocator& instance()
+	{
+		static SlotAllocator* allocator = new SlotAllocator();
+		return *allocator;
+	}
+
+	void acquire(size_t& slot, uint64_t& serial)
+	{
+		lock_guard<mutex> lock(m_mutex);
+		serial = ++m_serial;
+		if (m_free.empty()) slot = m_slots++;
+		else
+		{
+			pop_heap(m_free.begin(), m_free.end(), greater<size_t>());
+			slot = m_free.back();
+			m_free.pop_back();
+		}
+	}
+
+	void release(size_t slot)
+	{
+		lock_guard<mutex> lock(m_mutex);
+		m_free.push_back(slot);
+		push_heap(m_free.begin(), m_free.end(), greater<size_t>());
+	}
+
+private:
+	mutex m_mutex;
+	size_t m_slots;
+	uint64_t m_serial;
+	vector<size_t> m_free;                       // min-heap of released slots
+};
+
 struct Expression : public ExpressionT<double, Vector>
 {
 	Expression(ExPtrT<double, Vector>::type ex_, Variables& aux_)
 	: ex(ex_)
 	, aux(aux_)
-	{ }
+	, dimension(0)
+	, compiled(nullptr)
+	{ SlotAllocator::instance().acquire(slot, serial); }
+
+	~Expression()
+	{ SlotAllocator::instance().release(slot); }
 
+	// tree evaluation, the frame holding the auxiliary variables is local
 	double eval(Vector const& x) const
 	{
+		PooledFrame pooled(aux.size());
+		Frame& frame = *pooled.frame;
 		for (size_t i=0; i<aux.size(); i++)
 		{
-			aux[i]->preeval(x);
+			aux[i]->preeval(x, frame);
 		}
-		for (size_t i=0; i<aux.size(); i++)
-		{
-			shared_ptr<AuxiliaryVariableBase> var = aux[i];
-			if (isScalar(var)) asScalar(var)->eval();
-			else asVector(var)->eval();
-		}
-		return ex->eval(x);
+		return ex->eval(x, frame);
+	}
+
+	double eval(Vector const& x, Frame const&) const
+	{ return eval(x); }
+
+	int emit(Compiler& comp) const
+	{
+		for (size_t i=0; i<aux.size(); i++) aux[i]->emit(comp);
+		return ex->emit(comp);
+	}
+
+	// lower the tree into bytecode
+	void compile()
+	{
+		Compiler comp(program);
+		program.result = emit(comp);
 	}
 
 	ExPtrT<double, Vector>::type ex;
 	Variables aux;
+	size_t slot;                     // state in evaluation contexts, reused after destruction
+	uint64_t serial;                 // unique, tells apart the expressions using a slot
+	Program program;
+	size_t dimension;                // input dimension of specialized expressions
+	NativeCodePtr native;            // machine code of specialized expressions, if available
+	CompiledProgram compiled;        // code generated ahead of time for the program, if available
+	ExpressionPtr generic;           // unspecialized expression, or nullptr
+	ExpressionPtr precompiled;       // generic program with code generated ahead of time, own registers for the specialized dimension
+};
+
+// state of one expression within an evaluation context, set up on first use
+struct ContextSlot
+{
+	ContextSlot()
+	: serial(0)
+	{ }
+
+	uint64_t serial;                 // expression the state belongs to, 0 if none
+	Registers registers;
+	BatchRegisters batch;
+	Tangents tangents;
+	Tape tape;
+	IntervalRegisters intervals;
 };
 
+struct EvaluationContext
+{
+	// state of the given expression, cleared if the slot belonged to a
+	// destroyed expression before
+	ContextSlot& slot(Expression const& ex)
+	{
+		if (ex.slot >= m_slots.size()) m_slots.resize(ex.slot + 1);
+		ContextSlot& s = m_slots[ex.slot];
+		if (s.serial != ex.serial)
+		{
+			s = ContextSlot();
+			s.serial = ex.serial;
+		}
+		return s;
+	}
+
+	// registers for the given expression, set up on first use
+	Registers& registers(Expression const& ex)
+	{
+		Registers& reg = slot(ex).registers;
+		if (reg.vp.empty()) reg = Registers(ex.program);
+		return reg;
+	}
+
+	// tangents for the differentiation of the given expression, set up on first use
+	Tangents& tangents(Expression const& ex)
+	{
+		Tangents& t = slot(ex).tangents;
+		if (t.v.empty()) t = Tangents(ex.program);
+		return t;
+	}
+
+	// tape for the differentiation of the given expression, set up on first use
+	Tape& tape(Expression const& ex)
+	{
+		Tape& t = slot(ex).tape;
+		if (t.vid.empty()) t = Tape(ex.program);
+		return t;
+	}
+
+	// interval registers for the given expression, set up on first use
+	IntervalRegisters& intervals(Expression const& ex)
+	{
+		IntervalRegisters& reg = slot(ex).intervals;
+		if (reg.v.empty()) reg = IntervalRegisters(ex.program);
+		return reg;
+	}
+
+	// registers for the evaluation of the given expression on blocks of points, set up on first use
+	BatchRegisters& batch(Expression const& ex)
+	{
+		BatchRegisters& reg = slot(ex).batch;
+		if (reg.v.empty()) reg = BatchRegisters(ex.program);
+		return reg;
+	}
+
+	vector<ContextSlot> m_slots;
+};
+
+// default context of the calling thread
+thread_local EvaluationContext t_context;
+
 // interface function
 ExpressionPtr parse(string str)
 {
 	// scan and parse
 	ExpressionParser parser;
-	const Node* node = parser.parse(str);
+	unique_ptr<Node> tree(parser.parse(str));
+	const Node* node = tree.get();
 	assert(node->size() == 1 && node->child(0)->type() == "root");
 	node = node->child(0);
 
@@ -1244,9 +1711,9 @@ ExpressionPtr parse(string str)
 		}
 		ExPtr<Vector>::type ex = createExpression<Vector>(sub->child(1), aux);
 		if (isScalar<Vector>(ex))
-			aux.push_back(shared_ptr<AuxiliaryVariableBase>(new SAuxiliaryVariable(varname, asScalar<Vector>(ex))));
+			aux.push_back(shared_ptr<AuxiliaryVariableBase>(new SAuxiliaryVariable(varname, aux.size(), asScalar<Vector>(ex))));
 		else
-			aux.push_back(shared_ptr<AuxiliaryVariableBase>(new VAuxiliaryVariable(varname, asVector<Vector>(ex))));
+			aux.push_back(shared_ptr<AuxiliaryVariableBase>(new VAuxiliaryVariable(varname, aux.size(), asVector<Vector>(ex))));
 	}
 
 	// create final expression
@@ -1256,12 +1723,165 @@ ExpressionPtr parse(string str)
 
 	// create encapsulation
 	ExpressionPtr ret(new Expression(asScalar<Vector>(ex), aux));
+	ret->compile();
+
+	return ret;
+}
 
+// interface function
+ExpressionPtr specialize(ExpressionPtr ex, size_t dimension)
+{
+	if (! ex) return ex;
+	if (ex->generic) ex = ex->generic;
+	ExpressionPtr ret(new Expression(ex->ex, ex->aux));
+	ret->program = specialize(ex->program, dimension);
+	ret->native = compileNative(ret->program, dimension);
+	ret->dimension = dimension;
+	ret->generic = ex;
 	return ret;
 }
 
+// interface function
+ExpressionPtr specialize(ExpressionPtr ex, size_t dimension, PrecompiledProgram const& code)
+{
+	if (! ex) return ex;
+	if (ex->generic) ex = ex->generic;
+	ExpressionPtr ret = specialize(ex, dimension);
+	if (structureHash(ex->program) != code.structure) return ret;
+	ExpressionPtr pre(new Expression(ex->ex, ex->aux));
+	pre->program = ex->program;
+	pre->dimension = dimension;
+	pre->compiled = code.function;
+	ret->precompiled = pre;
+	return ret;
+}
+
+// interface function
+string generateSource(ExpressionPtr ex, string const& function, uint64_t& structure)
+{
+	structure = structureHash(ex->program);
+	return generateSource(ex->program, function);
+}
+
+// interface function
+bool hasNativeCode(ExpressionPtr ex)
+{
+	return ex && ex->native;
+}
+
+InterpreterMode g_interpreterMode = BytecodeInterpreter;
+
+// interface function
+void setInterpreterMode(InterpreterMode mode)
+{
+	g_interpreterMode = mode;
+}
+
+// interface function
+InterpreterMode interpreterMode()
+{
+	return g_interpreterMode;
+}
+
+DifferentiationMode g_differentiationMode = ReverseMode;
+
+// interface function
+void setDifferentiationMode(DifferentiationMode mode)
+{
+	g_differentiationMode = mode;
+}
+
+// interface function
+DifferentiationMode differentiationMode()
+{
+	return g_differentiationMode;
+}
+
+// interface function
+EvaluationContextPtr createEvaluationContext()
+{
+	return EvaluationContextPtr(new EvaluationContext());
+}
+
+// interface function
+double evaluate(ExpressionPtr ex, Vector const& x, EvaluationContext& context)
+{
+	if (g_interpreterMode == TreeInterpreter) return ex->eval(x);
+	if (ex->generic && x.size() != ex->dimension) ex = ex->generic;
+	if (g_interpreterMode == NativeInterpreter && ex->native) return executeNative(*ex->native, ex->program, context.registers(*ex), x);
+	if (ex->precompiled) return ex->precompiled->compiled(ex->precompiled->program, context.registers(*ex->precompiled), x);
+	return execute(ex->program, context.registers(*ex), x);
+}
+
 // interface function
 double evaluate(ExpressionPtr ex, Vector const& x)
+{
+	return evaluate(ex, x, t_context);
+}
+
+// interface function
+void evaluateBatch(ExpressionPtr ex, size_t dimension, const double* points, size_t count, double* values, EvaluationContext& context)
+{
+	if (g_interpreterMode == TreeInterpreter || dimension > maxBatchDimension)
+	{
+		for (size_t k=0; k<count; k++) values[k] = evaluate(ex, Vector(dimension, points + k * dimension), context);
+		return;
+	}
+	if (ex->generic && dimension != ex->dimension) ex = ex->generic;
+	executeBatch(ex->program, context.batch(*ex), context.registers(*ex), points, dimension, count, values);
+}
+
+// interface function
+void evaluateBatch(ExpressionPtr ex, size_t dimension, const double* points, size_t count, double* values)
+{
+	evaluateBatch(ex, dimension, points, count, values, t_context);
+}
+
+// interface function
+double evaluateWithGradient(ExpressionPtr ex, Vector const& x, Vector& gradient, EvaluationContext& context)
+{
+	if (ex->generic && x.size() != ex->dimension) ex = ex->generic;
+	gradient = Vector(x.size());
+	if (g_differentiationMode == ForwardMode) return differentiate(ex->program, context.registers(*ex), context.tangents(*ex), x, gradient.data());
+	return differentiate(ex->program, context.registers(*ex), context.tape(*ex), x, gradient.data());
+}
+
+// interface function
+double evaluateWithGradient(ExpressionPtr ex, Vector const& x, Vector& gradient)
+{
+	return evaluateWithGradient(ex, x, gradient, t_context);
+}
+
+// interface function
+Interval evaluateInterval(ExpressionPtr ex, Vector const& lower, Vector const& upper, EvaluationContext& context)
+{
+	if (lower.size() != upper.size()) throw runtime_error("dimension mismatch");
+	if (ex->generic && lower.size() != ex->dimension) ex = ex->generic;
+	return enclose(ex->program, context.intervals(*ex), lower.data(), upper.data(), lower.size());
+}
+
+// interface function
+Interval evaluateInterval(ExpressionPtr ex, Vector const& lower, Vector const& upper)
+{
+	return evaluateInterval(ex, lower, upper, t_context);
+}
+
+// interface function
+void evaluateIntervals(ExpressionPtr ex, size_t dimension, const double* lower, const double* upper, size_t boxes, Interval* result, EvaluationContext& context)
+{
+	if (ex->generic && dimension != ex->dimension) ex = ex->generic;
+	IntervalRegisters& reg = context.intervals(*ex);
+	for (size_t k=0; k<boxes; k++) result[k] = enclose(ex->program, reg, lower + k * dimension, upper + k * dimension, dimension);
+}
+
+// interface function
+void evaluateIntervals(ExpressionPtr ex, size_t dimension, const double* lower, const double* upper, size_t boxes, Interval* result)
+{
+	evaluateIntervals(ex, dimension, lower, upper, boxes, result, t_context);
+}
+
+// interface function
+double evaluateTree(ExpressionPtr ex, Vector const& x)
 {
 	return ex->eval(x);
 }
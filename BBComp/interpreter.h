@@ -79,19 +79,115 @@
 //		var xm = x[1:d-1];
 //		sqrnorm(ones(d-1) - xm) + 100 * sqrnorm(x[2:d] - xm .* xm)
 //
+// By default, parsed expressions are lowered into a flat bytecode
+// program (see bytecode.h) that is executed on preallocated registers.
+// The tree of expression objects remains available as a reference
+// implementation; both modes yield bit-identical results.
+//
+// An expression can be specialized for a fixed input dimension. Its
+// program is then optimized with dim(x) known: everything not depending
+// on the values of x (like ones(d), range(d), and apply statements over
+// such vectors) is computed once, and repeated sub-expressions are
+// merged. Inputs of other dimensions are evaluated with the generic
+// program.
+//
+// On x86-64, specialized expressions are additionally translated into
+// machine code (see jit.h), which is used in NativeInterpreter mode.
+// Otherwise this mode behaves like the bytecode interpreter.
+// hasNativeCode tells whether machine code is available.
+//
+// The functions in problems.json are also compiled ahead of time: at
+// build time, generate.cpp translates their generic programs into C++
+// source, which becomes part of the library. An expression specialized
+// with such code uses it in BytecodeInterpreter mode, provided the
+// generic program still has the structure the code was generated for;
+// otherwise the code is ignored. In NativeInterpreter mode the machine
+// code of the specialized program takes precedence, the precompiled
+// code serves where no machine code is available. Batches, gradients
+// and intervals are computed from the specialized program.
+//
+// evaluateBatch evaluates an expression on many points, stored row-major,
+// processing blocks of points per instruction (see batch.h). The values
+// coincide bit for bit with those of evaluate.
+//
+// evaluateWithGradient computes the gradient with respect to x along
+// with the value, by automatic differentiation of the program (see
+// gradient.h), independent of the interpreter mode. The value coincides
+// bit for bit with that of evaluate. Reverse mode (default) costs a
+// small multiple of an evaluation, forward mode costs a multiple
+// proportional to the dimension; the gradients agree up to rounding.
+//
+// evaluateInterval maps a box [lower, upper] to an interval enclosing
+// the values of the expression at all points of the box, by interval
+// arithmetic on the program (see interval.h). evaluateIntervals does the
+// same for a batch of boxes with corners stored row-major, reusing the
+// interval registers of the context.
+//
+// Parsed expressions are immutable. All state arising during evaluation
+// is kept in an evaluation context owned by the caller, hence a single
+// expression can be evaluated by many threads concurrently, as long as
+// each thread uses its own context. The evaluate function without
+// context argument uses a default context local to the calling thread.
+// The size of a context is bounded by the largest number of expressions
+// alive at a time; state of destroyed expressions is recycled.
+//
 
 
 #include <string>
 #include <memory>
+#include <cstdint>
 
 #include "vector.h"
+#include "interval.h"
 
 
 // expression types
 struct Expression;
 typedef std::shared_ptr<Expression> ExpressionPtr;
 
+// per-thread evaluation state
+struct EvaluationContext;
+typedef std::shared_ptr<EvaluationContext> EvaluationContextPtr;
+
+// code generated ahead of time, see bytecode.h
+struct PrecompiledProgram;
+
+
+// evaluation engines
+enum InterpreterMode
+{
+	BytecodeInterpreter,      // compiled bytecode (default)
+	TreeInterpreter,          // recursive evaluation of the expression tree (reference)
+	NativeInterpreter,        // machine code for specialized expressions, bytecode otherwise
+};
+
+// automatic differentiation modes
+enum DifferentiationMode
+{
+	ReverseMode,              // adjoints propagated backwards through a tape (default)
+	ForwardMode,              // tangents propagated alongside the values
+};
+
 
 // actual interface
 ExpressionPtr parse(std::string str);
+ExpressionPtr specialize(ExpressionPtr ex, std::size_t dimension);
+ExpressionPtr specialize(ExpressionPtr ex, std::size_t dimension, PrecompiledProgram const& code);
+std::string generateSource(ExpressionPtr ex, std::string const& function, std::uint64_t& structure);
+bool hasNativeCode(ExpressionPtr ex);
+EvaluationContextPtr createEvaluationContext();
+double evaluate(ExpressionPtr ex, Vector const& x, EvaluationContext& context);
 double evaluate(ExpressionPtr ex, Vector const& x);
+void evaluateBatch(ExpressionPtr ex, std::size_t dimension, const double* points, std::size_t count, double* values, EvaluationContext& context);
+void evaluateBatch(ExpressionPtr ex, std::size_t dimension, const double* points, std::size_t count, double* values);
+double evaluateWithGradient(ExpressionPtr ex, Vector const& x, Vector& gradient, EvaluationContext& context);
+double evaluateWithGradient(ExpressionPtr ex, Vector const& x, Vector& gradient);
+Interval evaluateInterval(ExpressionPtr ex, Vector const& lower, Vector const& upper, EvaluationContext& context);
+Interval evaluateInterval(ExpressionPtr ex, Vector const& lower, Vector const& upper);
+void evaluateIntervals(ExpressionPtr ex, std::size_t dimension, const double* lower, const double* upper, std::size_t boxes, Interval* result, EvaluationContext& context);
+void evaluateIntervals(ExpressionPtr ex, std::size_t dimension, const double* lower, const double* upper, std::size_t boxes, Interval* result);
+double evaluateTree(ExpressionPtr ex, Vector const& x);
+void setInterpreterMode(InterpreterMode mode);
+InterpreterMode interpreterMode();
+void setDifferentiationMode(DifferentiationMode mode);
+DifferentiationMode differentiationMode();
@@ -0,0 +1,555 @@
+
+#include "interval.h"
+#include "bytecode.h"
+#include "vecmath.h"
+
+#include <stdexcept>
+#include <algorithm>
+#include <limits>
+#include <cmath>
+#include <cassert>
+
+
+using namespace std;
+
+
+////////////////////////////////////////////////////////////
+// rounding
+//
+
+static const double infinity = numeric_limits<double>::infinity();
+static const double pi = 3.14159265358979323846;
+
+// widening of the bounds of elementary functions, in units in the last place
+static const int slack = 4;
+
+static double down(double x, int ulps = 1)
+{
+	for (int i=0; i<ulps; i++) x = nextafter(x, -infinity);
+	return x;
+}
+
+static double up(double x, int ulps = 1)
+{
+	for (int i=0; i<ulps; i++) x = nextafter(x, infinity);
+	return x;
+}
+
+static Interval make(double lower, double upper)
+{
+	if (std::isnan(lower) || std::isnan(upper)) { lower = -infinity; upper = infinity; }
+	Interval ret = { lower, upper };
+	return ret;
+}
+
+static Interval point(double x)
+{
+	return make(x, x);
+}
+
+static Interval entire()
+{
+	return make(-infinity, infinity);
+}
+
+// bounds computed by an elementary function
+static Interval widen(double lower, double upper)
+{
+	return make(down(lower, slack), up(upper, slack));
+}
+
+static Interval hull(Interval a, Interval b)
+{
+	return make(min(a.lower, b.lower), max(a.upper, b.upper));
+}
+
+static Interval clamp(Interval x, double lower, double upper)
+{
+	return make(max(x.lower, lower), min(x.upper, upper));
+}
+
+// rounded sum a + b, with the exact rounding error determined by TwoSum
+static double sumDown(double a, double b)
+{
+	double s = a + b;
+	if (! std::isfinite(s)) return (std::isfinite(a) && std::isfinite(b)) ? down(s) : s;
+	double bb = s - a;
+	double e = (a - (s - bb)) + (b - bb);
+	return (e < 0.0) ? down(s) : s;
+}
+
+static double sumUp(double a, double b)
+{
+	double s = a + b;
+	if (! std::isfinite(s)) return (std::isfinite(a) && std::isfinite(b)) ? up(s) : s;
+	double bb = s - a;
+	double e = (a - (s - bb)) + (b - bb);
+	return (e > 0.0) ? up(s) : s;
+}
+
+// bounds of products with 0 * inf = 0, and of quotients,
+// exact if an argument is zero
+static double productDown(double a, double b)
+{
+	return (a == 0.0 || b == 0.0) ? 0.0 : down(a * b);
+}
+
+static double productUp(double a, double b)
+{
+	return (a == 0.0 || b == 0.0) ? 0.0 : up(a * b);
+}
+
+static double quotientDown(double a, double b)
+{
+	return (a == 0.0) ? 0.0 : down(a / b);
+}
+
+static double quotientUp(double a, double b)
+{
+	return (a == 0.0) ? 0.0 : up(a / b);
+}
+
+
+////////////////////////////////////////////////////////////
+// arithmetic
+//
+
+static Interval neg(Interval a)
+{
+	return make(-a.upper, -a.lower);
+}
+
+static Interval add(Interval a, Interval b)
+{
+	return make(sumDown(a.lower, b.lower), sumUp(a.upper, b.upper));
+}
+
+static Interval sub(Interval a, Interval b)
+{
+	return make(sumDown(a.lower, -b.upper), sumUp(a.upper, -b.lower));
+}
+
+static Interval mul(Interval a, Interval b)
+{
+	double lower = min(min(productDown(a.lower, b.lower), productDown(a.lower, b.upper)), min(productDown(a.upper, b.lower), productDown(a.upper, b.upper)));
+	double upper = max(max(productUp(a.lower, b.lower), productUp(a.lower, b.upper)), max(productUp(a.upper, b.lower), productUp(a.upper, b.upper)));
+	return make(lower, upper);
+}
+
+static Interval div(Interval a, Interval b)
+{
+	if (b.lower <= 0.0 && b.upper >= 0.0) return entire();
+	if ((std::isinf(a.lower) || std::isinf(a.upper)) && (std::isinf(b.lower) || std::isinf(b.upper))) return entire();
+	double lower = min(min(quotientDown(a.lower, b.lower), quotientDown(a.lower, b.upper)), min(quotientDown(a.upper, b.lower), quotientDown(a.upper, b.upper)));
+	double upper = max(max(quotientUp(a.lower, b.lower), quotientUp(a.lower, b.upper)), max(quotientUp(a.upper, b.lower), quotientUp(a.upper, b.upper)));
+	return make(lower, upper);
+}
+
+static Interval power(Interval a, Interval b)
+{
+	if (b.lower == b.upper && b.lower == floor(b.lower) && fabs(b.lower) < 9007199254740992.0)
+	{
+		// integral exponent: monotonic on both sides of zero
+		double n = b.lower;
+		if (n == 0.0) return point(1.0);
+		bool zero = (a.lower <= 0.0 && a.upper >= 0.0);
+		if (n < 0.0 && zero) return entire();
+		double p = mathPow(a.lower, n), q = mathPow(a.upper, n);
+		Interval ret = widen(min(p, q), max(p, q));
+		if (zero) ret = hull(ret, point(0.0));
+		if (fmod(n, 2.0) == 0.0) ret.lower = max(ret.lower, 0.0);
+		return ret;
+	}
+
+	// non-integral powers of negative numbers are undefined, otherwise
+	// pow is monotonic in each argument, with extrema at the corners
+	if (a.lower < 0.0) return entire();
+	double p[4] = { mathPow(a.lower, b.lower), mathPow(a.lower, b.upper), mathPow(a.upper, b.lower), mathPow(a.upper, b.upper) };
+	for (int i=0; i<4; i++) if (std::isnan(p[i])) return entire();
+	Interval ret = widen(min(min(p[0], p[1]), min(p[2], p[3])), max(max(p[0], p[1]), max(p[2], p[3])));
+	return clamp(ret, 0.0, infinity);
+}
+
+
+////////////////////////////////////////////////////////////
+// elementary functions
+//
+
+// whether x contains offset + k * period for an integer k,
+// conservatively in the presence of rounding errors
+static bool containsPeriodic(Interval x, double offset, double period)
+{
+	double t0 = (x.lower - offset) / period;
+	double t1 = (x.upper - offset) / period;
+	double tolerance = 1e-9 + 1e-14 * max(fabs(t0), fabs(t1));
+	return floor(t1 + tolerance) >= ceil(t0 - tolerance);
+}
+
+Interval intervalAbs(Interval x)
+{
+	if (x.lower >= 0.0) return x;
+	if (x.upper <= 0.0) return neg(x);
+	return make(0.0, max(-x.lower, x.upper));
+}
+
+Interval intervalSqr(Interval x)
+{
+	Interval a = intervalAbs(x);
+	return make(max(0.0, down(a.lower * a.lower)), up(a.upper * a.upper));
+}
+
+Interval intervalSqrt(Interval x)
+{
+	// correctly rounded
+	if (x.lower < 0.0) return entire();
+	return make((x.lower == 0.0) ? 0.0 : down(std::sqrt(x.lower)), up(std::sqrt(x.upper)));
+}
+
+Interval intervalExp(Interval x)
+{
+	return clamp(widen(mathExp(x.lower), mathExp(x.upper)), 0.0, infinity);
+}
+
+Interval intervalLog(Interval x)
+{
+	if (x.lower < 0.0) return entire();
+	return widen(mathLog(x.lower), mathLog(x.upper));
+}
+
+Interval intervalLog10(Interval x)
+{
+	if (x.lower < 0.0) return entire();
+	return widen(log10(x.lower), log10(x.upper));
+}
+
+Interval intervalSin(Interval x)
+{
+	if (! (x.upper - x.lower < 2.0 * pi)) return make(-1.0, 1.0);
+	double a = mathSin(x.lower), b = mathSin(x.upper);
+	Interval ret = widen(min(a, b), max(a, b));
+	if (containsPeriodic(x, 0.5 * pi, 2.0 * pi)) ret.upper = 1.0;
+	if (containsPeriodic(x, -0.5 * pi, 2.0 * pi)) ret.lower = -1.0;
+	return clamp(ret, -1.0, 1.0);
+}
+
+Interval intervalCos(Interval x)
+{
+	if (! (x.upper - x.lower < 2.0 * pi)) return make(-1.0, 1.0);
+	double a = mathCos(x.lower), b = mathCos(x.upper);
+	Interval ret = widen(min(a, b), max(a, b));
+	if (containsPeriodic(x, 0.0, 2.0 * pi)) ret.upper = 1.0;
+	if (containsPeriodic(x, pi, 2.0 * pi)) ret.lower = -1.0;
+	return clamp(ret, -1.0, 1.0);
+}
+
+Interval intervalTan(Interval x)
+{
+	if (! (x.upper - x.lower < pi) || containsPeriodic(x, 0.5 * pi, pi)) return entire();
+	return widen(tan(x.lower), tan(x.upper));
+}
+
+Interval intervalSinh(Interval x)
+{
+	return widen(sinh(x.lower), sinh(x.upper));
+}
+
+Interval intervalCosh(Interval x)
+{
+	Interval a = intervalAbs(x);
+	return clamp(widen(cosh(a.lower), cosh(a.upper)), 1.0, infinity);
+}
+
+Interval intervalTanh(Interval x)
+{
+	return clamp(widen(tanh(x.lower), tanh(x.upper)), -1.0, 1.0);
+}
+
+Interval intervalAsin(Interval x)
+{
+	if (x.lower < -1.0 || x.upper > 1.0) return entire();
+	return widen(asin(x.lower), asin(x.upper));
+}
+
+Interval intervalAcos(Interval x)
+{
+	if (x.lower < -1.0 || x.upper > 1.0) return entire();
+	return clamp(widen(acos(x.upper), acos(x.lower)), 0.0, infinity);
+}
+
+Interval intervalAtan(Interval x)
+{
+	return widen(atan(x.lower), atan(x.upper));
+}
+
+Interval intervalFloor(Interval x)
+{
+	return make(floor(x.lower), floor(x.upper));
+}
+
+Interval intervalCeil(Interval x)
+{
+	return make(ceil(x.lower), ceil(x.upper));
+}
+
+Interval intervalRound(Interval x)
+{
+	// round(t) = floor(t + 0.5)
+	return make(floor(down(x.lower + 0.5)), floor(up(x.upper + 0.5)));
+}
+
+
+////////////////////////////////////////////////////////////
+// interval evaluation of programs
+//
+
+IntervalRegisters::IntervalRegisters(Program const& program)
+: s(program.scalars, point(0.0))
+, v(program.vectors)
+{
+	for (size_t i=0; i<program.scalarConstant.size(); i++) s[program.scalarConstant[i].first] = point(program.scalarConstant[i].second);
+	for (size_t i=0; i<program.vectorConstant.size(); i++)
+	{
+		Vector const& c = program.vectorConstant[i].second;
+		std::vector<Interval>& d = v[program.vectorConstant[i].first];
+		d.resize(c.size());
+		for (size_t j=0; j<c.size(); j++) d[j] = point(c[j]);
+	}
+}
+
+// integer part of an interval that must not depend on the input
+static int integer(Interval x)
+{
+	double f = floor(x.lower);
+	if (f != floor(x.upper)) throw runtime_error("vector size depends on the input");
+	if (! (fabs(f) < 2147483648.0)) throw runtime_error("dimension mismatch");
+	return (int)f;
+}
+
+static void run(Program const& program, IntervalRegisters& reg, std::vector<Instruction> const& code)
+{
+	std::vector<Interval>& s = reg.s;
+	for (size_t k=0; k<code.size(); k++)
+	{
+		Instruction const& in = code[k];
+		switch (in.op)
+		{
+		case opSNeg:
+			s[in.dst] = neg(s[in.a]);
+			break;
+		case opSAdd:
+			s[in.dst] = add(s[in.a], s[in.b]);
+			break;
+		case opSSub:
+			s[in.dst] = sub(s[in.a], s[in.b]);
+			break;
+		case opSMul:
+			s[in.dst] = mul(s[in.a], s[in.b]);
+			break;
+		case opSDiv:
+			s[in.dst] = div(s[in.a], s[in.b]);
+			break;
+		case opSPow:
+			s[in.dst] = power(s[in.a], s[in.b]);
+			break;
+		case opSFunc:
+		{
+			IntervalFunction f = enclosure(in.f);
+			if (! f) throw runtime_error("function has no interval extension");
+			s[in.dst] = f(s[in.a]);
+			break;
+		}
+		case opSDim:
+			s[in.dst] = point((double)reg.v[in.a].size());
+			break;
+		case opSEntry:
+		{
+			// union of all entries the index may refer to
+			std::vector<Interval> const& a = reg.v[in.a];
+			double f = floor(s[in.b].lower), l = floor(s[in.b].upper);
+			if (! (f >= 1.0 && l <= (double)a.size())) throw runtime_error("index out of bounds");
+			Interval ret = a[(size_t)f - 1];
+			for (size_t i=(size_t)f; i<(size_t)l; i++) ret = hull(ret, a[i]);
+			s[in.dst] = ret;
+			break;
+		}
+		case opSDot:
+		{
+			std::vector<Interval> const& a = reg.v[in.a];
+			std::vector<Interval> const& b = reg.v[in.b];
+			if (a.size() != b.size()) throw runtime_error("dimension mismatch");
+			Interval ret = point(0.0);
+			for (size_t i=0; i<a.size(); i++) ret = add(ret, mul(a[i], b[i]));
+			s[in.dst] = ret;
+			break;
+		}
+		case opSSum:
+		case opSProd:
+		case opSNorm:
+		case opSSqrNorm:
+		{
+			std::vector<Interval> const& a = reg.v[in.a];
+			Interval ret = point((in.op == opSProd) ? 1.0 : 0.0);
+			for (size_t i=0; i<a.size(); i++)
+			{
+				if (in.op == opSSum) ret = add(ret, a[i]);
+				else if (in.op == opSProd) ret = mul(ret, a[i]);
+				else ret = add(ret, intervalSqr(a[i]));
+			}
+			s[in.dst] = (in.op == opSNorm) ? intervalSqrt(ret) : ret;
+			break;
+		}
+		case opSMin:
+		case opSMax:
+		{
+			std::vector<Interval> const& a = reg.v[in.a];
+			if (a.empty()) { s[in.dst] = entire(); break; }
+			Interval ret = a[0];
+			for (size_t i=1; i<a.size(); i++)
+			{
+				if (in.op == opSMin) ret = make(min(ret.lower, a[i].lower), min(ret.upper, a[i].upper));
+				else ret = make(max(ret.lower, a[i].lower), max(ret.upper, a[i].upper));
+			}
+			s[in.dst] = ret;
+			break;
+		}
+		case opVNeg:
+		case opVAdd:
+		case opVSub:
+		case opVEMul:
+		case opVEDiv:
+		case opVEPowV:
+		{
+			std::vector<Interval> const& a = reg.v[in.a];
+			std::vector<Interval> const& b = reg.v[(in.op == opVNeg) ? in.a : in.b];
+			if (a.size() != b.size()) throw runtime_error("dimension mismatch");
+			std::vector<Interval>& d = reg.v[in.dst];
+			d.resize(a.size());
+			for (size_t i=0; i<a.size(); i++)
+			{
+				switch (in.op)
+				{
+				case opVNeg:
+					d[i] = neg(a[i]);
+					break;
+				case opVAdd:
+					d[i] = add(a[i], b[i]);
+					break;
+				case opVSub:
+					d[i] = sub(a[i], b[i]);
+					break;
+				case opVEMul:
+					d[i] = mul(a[i], b[i]);
+					break;
+				case opVEDiv:
+					d[i] = div(a[i], b[i]);
+					break;
+				default:
+					d[i] = power(a[i], b[i]);
+					break;
+				}
+			}
+			break;
+		}
+		case opVScale:
+		case opVDiv:
+		case opVEPowS:
+		case opVScaleAdd:
+		case opVScaleSub:
+		{
+			std::vector<Interval> const& a = reg.v[in.a];
+			Interval b = s[in.b];
+			bool affine = (in.op == opVScaleAdd || in.op == opVScaleSub);
+			std::vector<Interval> const& c = reg.v[affine ? in.c : in.a];
+			if (a.size() != c.size()) throw runtime_error("dimension mismatch");
+			std::vector<Interval>& d = reg.v[in.dst];
+			d.resize(a.size());
+			for (size_t i=0; i<a.size(); i++)
+			{
+				switch (in.op)
+				{
+				case opVScale:
+					d[i] = mul(a[i], b);
+					break;
+				case opVDiv:
+					d[i] = div(a[i], b);
+					break;
+				case opVEPowS:
+					d[i] = power(a[i], b);
+					break;
+				case opVScaleAdd:
+					d[i] = add(mul(a[i], b), c[i]);
+					break;
+				default:
+					d[i] = sub(mul(a[i], b), c[i]);
+					break;
+				}
+			}
+			break;
+		}
+		case opVCompose:
+		{
+			std::vector<Operand> const& parts = program.composition[in.a];
+			std::vector<Interval>& d = reg.v[in.dst];
+			d.clear();
+			for (size_t k=0; k<parts.size(); k++)
+			{
+				if (parts[k].isVector) d.insert(d.end(), reg.v[parts[k].reg].begin(), reg.v[parts[k].reg].end());
+				else d.push_back(s[parts[k].reg]);
+			}
+			break;
+		}
+		case opVRange:
+		{
+			std::vector<Interval> const& a = reg.v[in.a];
+			int f = integer(s[in.b]);
+			int l = integer(s[in.c]);
+			int size = l - f + 1;
+			if (f < 1 || l > (int)a.size() || size < 0) throw runtime_error("dimension mismatch");
+			reg.v[in.dst].assign(a.begin() + (f - 1), a.begin() + (f - 1) + size);
+			break;
+		}
+		case opVFill:
+		case opVIota:
+		{
+			int size = integer(s[in.a]);
+			if (size < 0) throw runtime_error("dimension must be non-negative");
+			std::vector<Interval>& d = reg.v[in.dst];
+			d.resize(size);
+			for (int i=0; i<size; i++) d[i] = point((in.op == opVFill) ? in.imm : i + 1);
+			break;
+		}
+		case opVApply:
+		{
+			// the body once per component
+			Lambda const& l = program.lambda[in.b];
+			std::vector<Interval> const& a = reg.v[in.a];
+			std::vector<Interval>& d = reg.v[in.dst];
+			d.resize(a.size());
+			for (size_t i=0; i<a.size(); i++)
+			{
+				s[l.argument] = a[i];
+				run(program, reg, program.block[l.block]);
+				d[i] = s[l.result];
+			}
+			break;
+		}
+		default:
+			assert(false);
+			break;
+		}
+	}
+}
+
+Interval enclose(Program const& program, IntervalRegisters& registers, const double* lower, const double* upper, size_t dimension)
+{
+	assert(registers.s.size() == (size_t)program.scalars);
+	std::vector<Interval>& x = registers.v[0];
+	x.resize(dimension);
+	for (size_t i=0; i<dimension; i++)
+	{
+		if (! (lower[i] <= upper[i])) throw runtime_error("empty box");
+		x[i] = make(lower[i], upper[i]);
+	}
+	run(program, registers, program.block[0]);
+	return registers.s[program.result];
+}
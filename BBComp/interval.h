@@ -0,0 +1,93 @@
+
+#pragma once
+
+
+//
+// Interval Arithmetic
+// -------------------
+//
+// Programs (see bytecode.h) can be evaluated on boxes instead of points:
+// every scalar register holds an interval, and every instruction maps
+// intervals to an interval containing all possible results. Hence the
+// result encloses the values of the function at all points of the box.
+//
+// Bounds are rounded outwards after every arithmetic operation. The
+// elementary functions are evaluated at the bounds (or at the known
+// extrema, e.g., at multiples of pi/2 for sin and cos) and widened by
+// a few units in the last place, which covers the errors of both the C
+// library and the VectorizedMath mode (see vecmath.h). Therefore the
+// enclosure holds for the exact value of the expression as well as for
+// its floating-point evaluation, up to effects of rounding right at the
+// discontinuities of floor, ceil, and round.
+//
+// Where an operation is undefined for part of its arguments (division
+// by an interval containing zero, logarithms and roots of negative
+// numbers, poles of tan and of negative powers, non-integral powers of
+// negative numbers), its result is the whole real line. Products follow
+// the convention 0 * inf = 0 of interval arithmetic.
+//
+// Indices of vector entries may vary over the box, then the entry is
+// the union of all candidates; an index interval reaching outside the
+// vector raises the same error as the point evaluation. Vector sizes
+// must not depend on the input.
+//
+
+
+#include <vector>
+#include <cstddef>
+
+
+struct Program;
+
+
+// closed interval [lower, upper]
+struct Interval
+{
+	double lower;
+	double upper;
+};
+
+
+typedef Interval (*IntervalFunction)(Interval);
+
+// Interval extension of a scalar function of the expression language
+// (defined in interpreter.cpp), or nullptr for unknown functions.
+IntervalFunction enclosure(double (*f)(double));
+
+// interval extensions of the elementary functions
+Interval intervalAbs(Interval x);
+Interval intervalSqr(Interval x);
+Interval intervalSqrt(Interval x);
+Interval intervalExp(Interval x);
+Interval intervalLog(Interval x);
+Interval intervalLog10(Interval x);
+Interval intervalSin(Interval x);
+Interval intervalCos(Interval x);
+Interval intervalTan(Interval x);
+Interval intervalSinh(Interval x);
+Interval intervalCosh(Interval x);
+Interval intervalTanh(Interval x);
+Interval intervalAsin(Interval x);
+Interval intervalAcos(Interval x);
+Interval intervalAtan(Interval x);
+Interval intervalFloor(Interval x);
+Interval intervalCeil(Interval x);
+Interval intervalRound(Interval x);
+
+
+// Interval registers for the evaluation of a program.
+struct IntervalRegisters
+{
+	IntervalRegisters()
+	{ }
+
+	explicit IntervalRegisters(Program const& program);
+
+	std::vector<Interval> s;                           // scalar registers
+	std::vector< std::vector<Interval> > v;            // vector registers
+};
+
+
+// Enclosure of the values of a program on the box with the given
+// corners, each holding dimension components.
+Interval enclose(Program const& program, IntervalRegisters& registers, const double* lower, const double* upper, std::size_t dimension);
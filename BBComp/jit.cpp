@@ -0,0 +1,467 @@
+#include "jit.h"
+#include "kernels.h"
+#include "vecmath.h"
+
+#include <exception>
+#include <vector>
+#include <cassert>
+#include <cstring>
+#include <cstdint>
+
+#if (defined(__GNUC__) || defined(__clang__)) && defined(__x86_64__) && ! defined(_WIN32)
+#define JIT_X86_64
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+
+using namespace std;
+
+
+class NativeCode
+{
+public:
+	typedef void (*Entry)(void* state, double* s, const double** vp);
+
+	NativeCode(void* memory, size_t size)
+	: entry(reinterpret_cast<Entry>(memory))
+	, m_memory(memory)
+	, m_size(size)
+	{ }
+
+	~NativeCode()
+	{
+#ifdef JIT_X86_64
+		munmap(m_memory, m_size);
+#endif
+	}
+
+	Entry entry;
+
+private:
+	NativeCode(NativeCode const&);
+	NativeCode& operator = (NativeCode const&);
+
+	void* m_memory;
+	size_t m_size;
+};
+
+
+namespace {
+
+
+// state of an evaluation, passed to the interpreter callback
+struct State
+{
+	Program const* program;
+	Registers* registers;
+	exception_ptr error;
+};
+
+
+#ifdef JIT_X86_64
+
+// Execute a single instruction in the interpreter. Exceptions must not
+// propagate through the generated code, hence they are stored, and a
+// non-zero return value makes the code return immediately.
+int interpret(State* state, const Instruction* instruction)
+{
+	try
+	{
+		step(*state->program, *state->registers, *instruction);
+		return 0;
+	}
+	catch (...)
+	{
+		state->error = current_exception();
+		return 1;
+	}
+}
+
+////////////////////////////////////////////////////////////
+// x86-64 instruction encoding
+//
+
+enum Register
+{
+	RAX = 0, RCX = 1, RDX = 2, RBX = 3, RSP = 4, RBP = 5, RSI = 6, RDI = 7, R12 = 12,
+};
+
+enum XmmRegister
+{
+	XMM0 = 0, XMM1 = 1,
+};
+
+enum SseOperation
+{
+	MOVSD_LOAD = 0x10, MOVSD_STORE = 0x11, SQRTSD = 0x51, ADDSD = 0x58, MULSD = 0x59, SUBSD = 0x5c, DIVSD = 0x5e,
+};
+
+template <typename F>
+uint64_t address(F f)
+{ return (uint64_t)reinterpret_cast<uintptr_t>(f); }
+
+class Assembler
+{
+public:
+	void push(int r)
+	{ rex(false, 0, r); byte(0x50 | (r & 7)); }
+	void pop(int r)
+	{ rex(false, 0, r); byte(0x58 | (r & 7)); }
+	void ret()
+	{ byte(0xc3); }
+	void call(int r)
+	{ rex(false, 0, r); byte(0xff); byte(0xd0 | (r & 7)); }
+
+	// dst = src
+	void mov(int dst, int src)
+	{ rex(true, src, dst); byte(0x89); byte(0xc0 | ((src & 7) << 3) | (dst & 7)); }
+	// dst = imm
+	void mov(int dst, uint64_t imm)
+	{ rex(true, 0, dst); byte(0xb8 | (dst & 7)); qword(imm); }
+	// dst = [base + disp]
+	void load(int dst, int base, int32_t disp)
+	{ rex(true, dst, base); byte(0x8b); memory(dst, base, disp); }
+	// [base + disp] = src
+	void store(int base, int32_t disp, int src)
+	{ rex(true, src, base); byte(0x89); memory(src, base, disp); }
+
+	// scalar double operation of an xmm register with [base + disp]
+	void sse(SseOperation op, int xmm, int base, int32_t disp)
+	{ byte(0xf2); rex(false, xmm, base); byte(0x0f); byte(op); memory(xmm, base, disp); }
+	void sqrtsd(int dst, int src)
+	{ byte(0xf2); byte(0x0f); byte(SQRTSD); byte(0xc0 | (dst << 3) | src); }
+	void xorpd(int dst, int src)
+	{ byte(0x66); byte(0x0f); byte(0x57); byte(0xc0 | (dst << 3) | src); }
+	// xmm = r, bitwise
+	void movq(int xmm, int r)
+	{ byte(0x66); rex(true, xmm, r); byte(0x0f); byte(0x6e); byte(0xc0 | ((xmm & 7) << 3) | (r & 7)); }
+
+	// test eax for zero and jump if non-zero, the target is patched later
+	size_t jumpIfNonZero()
+	{
+		byte(0x85); byte(0xc0);
+		byte(0x0f); byte(0x85); dword(0);
+		return m_code.size();
+	}
+	void patch(size_t jump, size_t target)
+	{
+		int32_t rel = (int32_t)((int64_t)target - (int64_t)jump);
+		memcpy(&m_code[jump - 4], &rel, 4);
+	}
+
+	size_t position() const
+	{ return m_code.size(); }
+	std::vector<unsigned char> const& code() const
+	{ return m_code; }
+
+private:
+	void byte(unsigned int b)
+	{ m_code.push_back((unsigned char)b); }
+	void dword(uint32_t v)
+	{ for (int i=0; i<4; i++) byte((v >> (8 * i)) & 0xff); }
+	void qword(uint64_t v)
+	{ for (int i=0; i<8; i++) byte((v >> (8 * i)) & 0xff); }
+
+	void rex(bool wide, int reg, int base)
+	{
+		unsigned int r = 0x40 | (wide ? 8 : 0) | ((reg & 8) ? 4 : 0) | ((base & 8) ? 1 : 0);
+		if (r != 0x40) byte(r);
+	}
+	// ModR/M addressing of [base + disp32]
+	void memory(int reg, int base, int32_t disp)
+	{
+		byte(0x80 | ((reg & 7) << 3) | (base & 7));
+		if ((base & 7) == RSP) byte(0x24);
+		dword((uint32_t)disp);
+	}
+
+	std::vector<unsigned char> m_code;
+};
+
+
+////////////////////////////////////////////////////////////
+// code generation
+//
+// Register assignment: rbx points to the scalar registers, rbp to the
+// data pointers of the vector registers, and r12 to the evaluation
+// state. All three are callee-saved, hence they survive calls into the
+// kernels and the interpreter.
+//
+
+class Generator
+{
+public:
+	Generator(Program const& program, size_t dimension)
+	: m_program(program)
+	, m_size(program.vectors, -1)
+	{
+		m_size[0] = (long)dimension;
+		for (size_t i=0; i<program.vectorConstant.size(); i++) m_size[program.vectorConstant[i].first] = (long)program.vectorConstant[i].second.size();
+		for (size_t i=0; i<program.shape.size(); i++) m_size[program.shape[i].first] = (long)program.shape[i].second;
+	}
+
+	std::vector<unsigned char> const& generate()
+	{
+		m_as.push(RBX);
+		m_as.push(RBP);
+		m_as.push(R12);
+		m_as.mov(R12, RDI);
+		m_as.mov(RBX, RSI);
+		m_as.mov(RBP, RDX);
+
+		std::vector<Instruction> const& code = m_program.block[0];
+		for (size_t i=0; i<code.size(); i++) instruction(code[i]);
+
+		size_t epilogue = m_as.position();
+		m_as.pop(R12);
+		m_as.pop(RBP);
+		m_as.pop(RBX);
+		m_as.ret();
+		for (size_t i=0; i<m_fail.size(); i++) m_as.patch(m_fail[i], epilogue);
+		return m_as.code();
+	}
+
+private:
+	static int32_t scalar(int r)
+	{ return 8 * r; }
+	static int32_t vector(int r)
+	{ return 8 * r; }
+
+	// element-wise operations require static sizes of the operand and the destination
+	bool elementwise(Instruction const& in) const
+	{ return m_size[in.a] >= 0 && m_size[in.dst] == m_size[in.a]; }
+
+	void scalarBinary(Instruction const& in, SseOperation op)
+	{
+		m_as.sse(MOVSD_LOAD, XMM0, RBX, scalar(in.a));
+		m_as.sse(op, XMM0, RBX, scalar(in.b));
+		m_as.sse(MOVSD_STORE, XMM0, RBX, scalar(in.dst));
+	}
+
+	// call f, the arguments must be in place
+	void call(uint64_t f)
+	{
+		m_as.mov(RAX, f);
+		m_as.call(RAX);
+	}
+
+	// s[dst] = f(vp[a], n) or f(vp[a], vp[b], n)
+	void reduction(Instruction const& in, uint64_t f, bool binary)
+	{
+		m_as.load(RDI, RBP, vector(in.a));
+		if (binary)
+		{
+			m_as.load(RSI, RBP, vector(in.b));
+			m_as.mov(RDX, (uint64_t)m_size[in.a]);
+		}
+		else m_as.mov(RSI, (uint64_t)m_size[in.a]);
+		call(f);
+		if (in.op == opSNorm) m_as.sqrtsd(XMM0, XMM0);
+		m_as.sse(MOVSD_STORE, XMM0, RBX, scalar(in.dst));
+	}
+
+	// f(vp[dst], vp[a], n)
+	void vectorUnary(Instruction const& in, uint64_t f)
+	{
+		m_as.load(RDI, RBP, vector(in.dst));
+		m_as.load(RSI, RBP, vector(in.a));
+		m_as.mov(RDX, (uint64_t)m_size[in.a]);
+		call(f);
+	}
+
+	// f(vp[dst], vp[a], vp[b], n)
+	void vectorBinary(Instruction const& in, uint64_t f)
+	{
+		m_as.load(RDI, RBP, vector(in.dst));
+		m_as.load(RSI, RBP, vector(in.a));
+		m_as.load(RDX, RBP, vector(in.b));
+		m_as.mov(RCX, (uint64_t)m_size[in.a]);
+		call(f);
+	}
+
+	// f(vp[dst], vp[a], s[b], n) or f(vp[dst], vp[a], s[b], vp[c], n)
+	void vectorScalar(Instruction const& in, uint64_t f, bool affine)
+	{
+		m_as.load(RDI, RBP, vector(in.dst));
+		m_as.load(RSI, RBP, vector(in.a));
+		m_as.sse(MOVSD_LOAD, XMM0, RBX, scalar(in.b));
+		if (affine)
+		{
+			m_as.load(RDX, RBP, vector(in.c));
+			m_as.mov(RCX, (uint64_t)m_size[in.a]);
+		}
+		else m_as.mov(RDX, (uint64_t)m_size[in.a]);
+		call(f);
+	}
+
+	// hand the instruction to the interpreter
+	void fallback(Instruction const& in)
+	{
+		m_as.mov(RDI, R12);
+		m_as.mov(RSI, address(&in));
+		call(address(&interpret));
+		m_fail.push_back(m_as.jumpIfNonZero());
+	}
+
+	void instruction(Instruction const& in)
+	{
+		typedef void (*PowV)(double*, const double*, const double*, size_t);
+		typedef void (*PowS)(double*, const double*, double, size_t);
+
+		switch (in.op)
+		{
+		case opSNeg:
+		{
+			uint64_t sign = 0x8000000000000000ull;
+			m_as.sse(MOVSD_LOAD, XMM0, RBX, scalar(in.a));
+			m_as.mov(RAX, sign);
+			m_as.movq(XMM1, RAX);
+			m_as.xorpd(XMM0, XMM1);
+			m_as.sse(MOVSD_STORE, XMM0, RBX, scalar(in.dst));
+			return;
+		}
+		case opSAdd:
+			scalarBinary(in, ADDSD);
+			return;
+		case opSSub:
+			scalarBinary(in, SUBSD);
+			return;
+		case opSMul:
+			scalarBinary(in, MULSD);
+			return;
+		case opSDiv:
+			scalarBinary(in, DIVSD);
+			return;
+		case opSPow:
+			m_as.sse(MOVSD_LOAD, XMM0, RBX, scalar(in.a));
+			m_as.sse(MOVSD_LOAD, XMM1, RBX, scalar(in.b));
+			call(address(&mathPow));
+			m_as.sse(MOVSD_STORE, XMM0, RBX, scalar(in.dst));
+			return;
+		case opSFunc:
+			m_as.sse(MOVSD_LOAD, XMM0, RBX, scalar(in.a));
+			call(address(in.f));
+			m_as.sse(MOVSD_STORE, XMM0, RBX, scalar(in.dst));
+			return;
+		case opSDim:
+			if (m_size[in.a] < 0) break;
+			{
+				double value = (double)m_size[in.a];
+				uint64_t bits;
+				memcpy(&bits, &value, sizeof(bits));
+				m_as.mov(RAX, bits);
+				m_as.store(RBX, scalar(in.dst), RAX);
+			}
+			return;
+		case opSDot:
+			if (m_size[in.a] < 0) break;
+			reduction(in, address(&kernelDot), true);
+			return;
+		case opSSum:
+			if (m_size[in.a] < 0) break;
+			reduction(in, address(&kernelSum), false);
+			return;
+		case opSProd:
+			if (m_size[in.a] < 0) break;
+			reduction(in, address(&kernelProduct), false);
+			return;
+		case opSNorm:
+		case opSSqrNorm:
+			if (m_size[in.a] < 0) break;
+			reduction(in, address(&kernelSqrNorm), false);
+			return;
+		case opVNeg:
+			if (! elementwise(in)) break;
+			vectorUnary(in, address(&kernelNeg));
+			return;
+		case opVAdd:
+			if (! elementwise(in)) break;
+			vectorBinary(in, address(&kernelAdd));
+			return;
+		case opVSub:
+			if (! elementwise(in)) break;
+			vectorBinary(in, address(&kernelSub));
+			return;
+		case opVEMul:
+			if (! elementwise(in)) break;
+			vectorBinary(in, address(&kernelMul));
+			return;
+		case opVEDiv:
+			if (! elementwise(in)) break;
+			vectorBinary(in, address(&kernelDiv));
+			return;
+		case opVEPowV:
+			if (! elementwise(in)) break;
+			vectorBinary(in, address(static_cast<PowV>(&kernelPow)));
+			return;
+		case opVScale:
+			if (! elementwise(in)) break;
+			vectorScalar(in, address(&kernelScale), false);
+			return;
+		case opVDiv:
+			if (! elementwise(in)) break;
+			vectorScalar(in, address(&kernelDivide), false);
+			return;
+		case opVEPowS:
+			if (! elementwise(in)) break;
+			vectorScalar(in, address(static_cast<PowS>(&kernelPow)), false);
+			return;
+		case opVScaleAdd:
+			if (! elementwise(in)) break;
+			vectorScalar(in, address(&kernelScaleAdd), true);
+			return;
+		case opVScaleSub:
+			if (! elementwise(in)) break;
+			vectorScalar(in, address(&kernelScaleSub), true);
+			return;
+		default:
+			break;
+		}
+		fallback(in);
+	}
+
+	Program const& m_program;
+	std::vector<long> m_size;            // static sizes of the vector registers, -1 if unknown
+	Assembler m_as;
+	std::vector<size_t> m_fail;          // jumps to the epilogue
+};
+
+#endif
+
+
+}
+
+
+NativeCodePtr compileNative(Program const& program, size_t dimension)
+{
+#ifdef JIT_X86_64
+	Generator gen(program, dimension);
+	std::vector<unsigned char> const& code = gen.generate();
+
+	size_t page = (size_t)sysconf(_SC_PAGESIZE);
+	size_t size = (code.size() + page - 1) / page * page;
+	void* memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (memory == MAP_FAILED) return NativeCodePtr();
+	memcpy(memory, code.data(), code.size());
+	if (mprotect(memory, size, PROT_READ | PROT_EXEC) != 0)
+	{
+		munmap(memory, size);
+		return NativeCodePtr();
+	}
+	return NativeCodePtr(new NativeCode(memory, size));
+#else
+	return NativeCodePtr();
+#endif
+}
+
+double executeNative(NativeCode const& code, Program const& program, Registers& registers, Vector const& x)
+{
+	assert(registers.s.size() == (size_t)program.scalars);
+	registers.vp[0] = x.data();
+	registers.vn[0] = x.size();
+	State state = { &program, &registers, exception_ptr() };
+	code.entry(&state, registers.s.data(), registers.vp.data());
+	if (state.error) rethrow_exception(state.error);
+	return registers.s[program.result];
+}
@@ -0,0 +1,42 @@
+
+#pragma once
+
+
+//
+// Native Code
+// -----------
+//
+// A bytecode program specialized for a fixed dimension (see bytecode.h)
+// can be translated into x86-64 machine code. Scalar arithmetic is
+// performed inline on SSE2 registers, element-wise vector operations and
+// reductions over vectors of static size call the array kernels directly,
+// and all remaining instructions (indexing, ranges, compositions, apply
+// statements, and operations on vectors of dynamic size) call back into
+// the interpreter one instruction at a time. The machine code performs
+// exactly the operations of the interpreter, hence results coincide bit
+// for bit, including the errors raised.
+//
+// Native code requires an x86-64 POSIX system (System V calling
+// convention, executable memory through mmap). On other platforms, or if
+// executable memory cannot be obtained, compileNative returns null and
+// the caller is expected to fall back to the interpreter.
+//
+
+
+#include <memory>
+#include <cstddef>
+
+#include "bytecode.h"
+
+
+class NativeCode;
+typedef std::shared_ptr<NativeCode> NativeCodePtr;
+
+// Translate the main block of a program specialized for the given
+// dimension. The program must outlive the code, since the code refers to
+// its instructions.
+NativeCodePtr compileNative(Program const& program, std::size_t dimension);
+
+// Evaluate a program through its native code. The registers must have
+// been set up for the program, and x must be of the specialized dimension.
+double executeNative(NativeCode const& code, Program const& program, Registers& registers, Vector const& x);
@@ -0,0 +1,79 @@
+#include "checks.h"
+#include "kernels.h"
+#include "vecmath.h"
+#include "rng.h"
+#include <iostream>
+#include <string>
+#include <vector>
+
+
+using namespace std;
+
+
+// This program validates the machine code generated for specialized
+// expressions (see jit.h) against the bytecode interpreter: for all
+// functions defined in a problems.json file, in several dimensions and
+// at random points, NativeInterpreter and BytecodeInterpreter mode must
+// yield bit-identical values, or raise the same errors. The comparison
+// is repeated for all supported instruction sets and for all summation
+// and math modes, since the machine code calls the array kernels. A
+// function for which no machine code is generated counts as a failure,
+// hence the check fails on platforms without native code.
+//
+// usage: jitcheck problems.json
+
+
+int main(int argc, char** argv)
+{
+	if (argc != 2) { cerr << "usage: " << argv[0] << " problems.json" << endl; return 1; }
+
+	const size_t dimensions[] = { 1, 2, 3, 5, 10, 40, 100 };
+	const unsigned int points = 5;
+	const char* sets[] = { "scalar", "AVX2", "AVX-512" };
+	const char* summation[] = { "ordered", "reassociated" };
+	const char* math[] = { "library", "vectorized" };
+
+	return checkFunctions(argv[1], [&](string const& name, ExpressionPtr generic, string& info)
+	{
+		RNG rng(1);
+		string problem;
+		for (size_t k=0; k<sizeof(dimensions)/sizeof(dimensions[0]) && problem.empty(); k++)
+		{
+			size_t d = dimensions[k];
+			vector<Vector> x(points);
+			for (unsigned int p=0; p<points; p++)
+			{
+				x[p] = Vector(d);
+				for (size_t i=0; i<d; i++) x[p][i] = 4.0 * rng.uniform() - 2.0;
+			}
+
+			for (int s=ScalarInstructions; s<=supportedInstructionSet() && problem.empty(); s++)
+			for (int m=OrderedSummation; m<=ReassociatedSummation && problem.empty(); m++)
+			for (int f=LibraryMath; f<=VectorizedMath && problem.empty(); f++)
+			{
+				setInstructionSet((InstructionSet)s);
+				setSummationMode((SummationMode)m);
+				setMathMode((MathMode)f);
+
+				// separate expressions, such that neither evaluation sees
+				// registers left behind by the other
+				ExpressionPtr native = specialize(generic, d);
+				ExpressionPtr bytecode = specialize(generic, d);
+				if (! hasNativeCode(native)) { problem = "no machine code in dimension " + to_string(d); break; }
+
+				setInterpreterMode(NativeInterpreter);
+				vector<Result> values(points);
+				for (unsigned int p=0; p<points; p++) values[p] = result([&]() { return evaluate(native, x[p]); });
+				setInterpreterMode(BytecodeInterpreter);
+				for (unsigned int p=0; p<points; p++)
+				{
+					if (result([&]() { return evaluate(bytecode, x[p]); }) == values[p]) continue;
+					problem = "machine code differs from bytecode in dimension " + to_string(d)
+							+ " (" + sets[s] + " instructions, " + summation[m] + " summation, " + math[f] + " math)";
+					break;
+				}
+			}
+		}
+		return problem;
+	});
+}
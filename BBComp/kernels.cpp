@@ -0,0 +1,770 @@
+
+#include "kernels.h"
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define KERNELS_X86
+#include <immintrin.h>
+#endif
+
+
+using namespace std;
+
+
+namespace {
+
+
+////////////////////////////////////////////////////////////
+// dispatch table
+//
+
+struct Kernels
+{
+	void (*neg)(double*, const double*, size_t);
+	void (*add)(double*, const double*, const double*, size_t);
+	void (*sub)(double*, const double*, const double*, size_t);
+	void (*mul)(double*, const double*, const double*, size_t);
+	void (*div)(double*, const double*, const double*, size_t);
+	void (*scale)(double*, const double*, double, size_t);
+	void (*divide)(double*, const double*, double, size_t);
+	void (*scaleAdd)(double*, const double*, double, const double*, size_t);
+	void (*scaleSub)(double*, const double*, double, const double*, size_t);
+	double (*sum)(const double*, size_t);
+	double (*product)(const double*, size_t);
+	double (*dot)(const double*, const double*, size_t);
+	double (*sqrnorm)(const double*, size_t);
+	void (*gemm)(double*, size_t, const double*, size_t, const double*, size_t, size_t, size_t, size_t);
+	void (*givens)(double*, const unsigned int*, const unsigned int*, const double*, const double*, size_t);
+	void (*rotate)(double*, double*, double, double, size_t);
+};
+
+// fixed combination of the eight partial results of a reassociated reduction
+inline double combineSum(double const* p)
+{ return ((p[0] + p[4]) + (p[2] + p[6])) + ((p[1] + p[5]) + (p[3] + p[7])); }
+
+inline double combineProduct(double const* p)
+{ return ((p[0] * p[4]) * (p[2] * p[6])) * ((p[1] * p[5]) * (p[3] * p[7])); }
+
+
+////////////////////////////////////////////////////////////
+// scalar kernels
+//
+
+void negScalar(double* d, const double* a, size_t n)
+{ for (size_t i=0; i<n; i++) d[i] = -a[i]; }
+
+void addScalar(double* d, const double* a, const double* b, size_t n)
+{ for (size_t i=0; i<n; i++) d[i] = a[i] + b[i]; }
+
+void subScalar(double* d, const double* a, const double* b, size_t n)
+{ for (size_t i=0; i<n; i++) d[i] = a[i] - b[i]; }
+
+void mulScalar(double* d, const double* a, const double* b, size_t n)
+{ for (size_t i=0; i<n; i++) d[i] = a[i] * b[i]; }
+
+void divScalar(double* d, const double* a, const double* b, size_t n)
+{ for (size_t i=0; i<n; i++) d[i] = a[i] / b[i]; }
+
+void scaleScalar(double* d, const double* a, double b, size_t n)
+{ for (size_t i=0; i<n; i++) d[i] = a[i] * b; }
+
+void divideScalar(double* d, const double* a, double b, size_t n)
+{ for (size_t i=0; i<n; i++) d[i] = a[i] / b; }
+
+void scaleAddScalar(double* d, const double* a, double b, const double* c, size_t n)
+{ for (size_t i=0; i<n; i++) d[i] = a[i] * b + c[i]; }
+
+void scaleSubScalar(double* d, const double* a, double b, const double* c, size_t n)
+{ for (size_t i=0; i<n; i++) d[i] = a[i] * b - c[i]; }
+
+// ordered reductions, these do not depend on the instruction set
+double sumOrdered(const double* a, size_t n)
+{
+	double ret = 0.0;
+	for (size_t i=0; i<n; i++) ret += a[i];
+	return ret;
+}
+
+double productOrdered(const double* a, size_t n)
+{
+	double ret = 1.0;
+	for (size_t i=0; i<n; i++) ret *= a[i];
+	return ret;
+}
+
+double dotOrdered(const double* a, const double* b, size_t n)
+{
+	double ret = 0.0;
+	for (size_t i=0; i<n; i++) ret += a[i] * b[i];
+	return ret;
+}
+
+double sqrnormOrdered(const double* a, size_t n)
+{
+	double ret = 0.0;
+	for (size_t i=0; i<n; i++) ret += a[i] * a[i];
+	return ret;
+}
+
+// reassociated reductions
+double sumScalar(const double* a, size_t n)
+{
+	double p[8] = {0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0};
+	for (size_t i=0; i<n; i++) p[i % 8] += a[i];
+	return combineSum(p);
+}
+
+double productScalar(const double* a, size_t n)
+{
+	double p[8] = {1.0, 1.0, 1.0, 1.0, 1.0, 1.0, 1.0, 1.0};
+	for (size_t i=0; i<n; i++) p[i % 8] *= a[i];
+	return combineProduct(p);
+}
+
+double dotScalar(const double* a, const double* b, size_t n)
+{
+	double p[8] = {0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0};
+	for (size_t i=0; i<n; i++) p[i % 8] += a[i] * b[i];
+	return combineSum(p);
+}
+
+double sqrnormScalar(const double* a, size_t n)
+{
+	double p[8] = {0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0};
+	for (size_t i=0; i<n; i++) p[i % 8] += a[i] * a[i];
+	return combineSum(p);
+}
+
+// y += A x for a single point, column by column
+void gemvScalar(double* y, const double* a, size_t lda, const double* x, size_t rows, size_t cols)
+{
+	for (size_t j=0; j<cols; j++)
+	{
+		const double* aj = a + j * lda;
+		double xj = x[j];
+		for (size_t i=0; i<rows; i++) y[i] += aj[i] * xj;
+	}
+}
+
+void gemmScalar(double* y, size_t ldy, const double* a, size_t lda, const double* x, size_t ldx, size_t rows, size_t cols, size_t count)
+{
+	for (size_t p=0; p<count; p++) gemvScalar(y + p * ldy, a, lda, x + p * ldx, rows, cols);
+}
+
+void givensScalar(double* x, const unsigned int* i, const unsigned int* j, const double* sin, const double* cos, size_t n)
+{
+	for (size_t k=0; k<n; k++)
+	{
+		double a = x[i[k]];
+		double b = x[j[k]];
+		x[i[k]] = cos[k] * a - sin[k] * b;
+		x[j[k]] = sin[k] * a + cos[k] * b;
+	}
+}
+
+void rotateScalar(double* a, double* b, double sin, double cos, size_t n)
+{
+	for (size_t k=0; k<n; k++)
+	{
+		double u = a[k];
+		double v = b[k];
+		a[k] = cos * u - sin * v;
+		b[k] = sin * u + cos * v;
+	}
+}
+
+const Kernels scalarKernels = {
+	negScalar, addScalar, subScalar, mulScalar, divScalar, scaleScalar, divideScalar,
+	scaleAddScalar, scaleSubScalar,
+	sumScalar, productScalar, dotScalar, sqrnormScalar,
+	gemmScalar, givensScalar, rotateScalar,
+};
+
+
+#ifdef KERNELS_X86
+
+////////////////////////////////////////////////////////////
+// AVX2 kernels
+//
+// The reductions keep the eight partial results in two registers, lanes
+// 0-3 and 4-7, and finish the tail in scalar code, such that every term
+// ends up in the same partial result as in the scalar kernels.
+//
+
+#define AVX2 __attribute__((target("avx2")))
+
+#define AVX2_BINARY(name, op) \
+	AVX2 void name##AVX2(double* d, const double* a, const double* b, size_t n) \
+	{ \
+		size_t i = 0; \
+		for (; i+4<=n; i+=4) _mm256_storeu_pd(d + i, op(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i))); \
+		name##Scalar(d + i, a + i, b + i, n - i); \
+	}
+
+#define AVX2_SCALAR(name, op) \
+	AVX2 void name##AVX2(double* d, const double* a, double b, size_t n) \
+	{ \
+		__m256d s = _mm256_set1_pd(b); \
+		size_t i = 0; \
+		for (; i+4<=n; i+=4) _mm256_storeu_pd(d + i, op(_mm256_loadu_pd(a + i), s)); \
+		name##Scalar(d + i, a + i, b, n - i); \
+	}
+
+AVX2_BINARY(add, _mm256_add_pd)
+AVX2_BINARY(sub, _mm256_sub_pd)
+AVX2_BINARY(mul, _mm256_mul_pd)
+AVX2_BINARY(div, _mm256_div_pd)
+AVX2_SCALAR(scale, _mm256_mul_pd)
+AVX2_SCALAR(divide, _mm256_div_pd)
+
+#define AVX2_AFFINE(name, op) \
+	AVX2 void name##AVX2(double* d, const double* a, double b, const double* c, size_t n) \
+	{ \
+		__m256d s = _mm256_set1_pd(b); \
+		size_t i = 0; \
+		for (; i+4<=n; i+=4) _mm256_storeu_pd(d + i, op(_mm256_mul_pd(_mm256_loadu_pd(a + i), s), _mm256_loadu_pd(c + i))); \
+		name##Scalar(d + i, a + i, b, c + i, n - i); \
+	}
+
+AVX2_AFFINE(scaleAdd, _mm256_add_pd)
+AVX2_AFFINE(scaleSub, _mm256_sub_pd)
+
+AVX2 void negAVX2(double* d, const double* a, size_t n)
+{
+	__m256d sign = _mm256_set1_pd(-0.0);
+	size_t i = 0;
+	for (; i+4<=n; i+=4) _mm256_storeu_pd(d + i, _mm256_xor_pd(_mm256_loadu_pd(a + i), sign));
+	negScalar(d + i, a + i, n - i);
+}
+
+AVX2 double sumAVX2(const double* a, size_t n)
+{
+	__m256d lo = _mm256_setzero_pd(), hi = _mm256_setzero_pd();
+	size_t i = 0;
+	for (; i+8<=n; i+=8)
+	{
+		lo = _mm256_add_pd(lo, _mm256_loadu_pd(a + i));
+		hi = _mm256_add_pd(hi, _mm256_loadu_pd(a + i + 4));
+	}
+	double p[8];
+	_mm256_storeu_pd(p, lo);
+	_mm256_storeu_pd(p + 4, hi);
+	for (; i<n; i++) p[i % 8] += a[i];
+	return combineSum(p);
+}
+
+AVX2 double productAVX2(const double* a, size_t n)
+{
+	__m256d lo = _mm256_set1_pd(1.0), hi = _mm256_set1_pd(1.0);
+	size_t i = 0;
+	for (; i+8<=n; i+=8)
+	{
+		lo = _mm256_mul_pd(lo, _mm256_loadu_pd(a + i));
+		hi = _mm256_mul_pd(hi, _mm256_loadu_pd(a + i + 4));
+	}
+	double p[8];
+	_mm256_storeu_pd(p, lo);
+	_mm256_storeu_pd(p + 4, hi);
+	for (; i<n; i++) p[i % 8] *= a[i];
+	return combineProduct(p);
+}
+
+AVX2 double dotAVX2(const double* a, const double* b, size_t n)
+{
+	__m256d lo = _mm256_setzero_pd(), hi = _mm256_setzero_pd();
+	size_t i = 0;
+	for (; i+8<=n; i+=8)
+	{
+		lo = _mm256_add_pd(lo, _mm256_mul_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i)));
+		hi = _mm256_add_pd(hi, _mm256_mul_pd(_mm256_loadu_pd(a + i + 4), _mm256_loadu_pd(b + i + 4)));
+	}
+	double p[8];
+	_mm256_storeu_pd(p, lo);
+	_mm256_storeu_pd(p + 4, hi);
+	for (; i<n; i++) p[i % 8] += a[i] * b[i];
+	return combineSum(p);
+}
+
+AVX2 double sqrnormAVX2(const double* a, size_t n)
+{
+	__m256d lo = _mm256_setzero_pd(), hi = _mm256_setzero_pd();
+	size_t i = 0;
+	for (; i+8<=n; i+=8)
+	{
+		__m256d x = _mm256_loadu_pd(a + i);
+		__m256d y = _mm256_loadu_pd(a + i + 4);
+		lo = _mm256_add_pd(lo, _mm256_mul_pd(x, x));
+		hi = _mm256_add_pd(hi, _mm256_mul_pd(y, y));
+	}
+	double p[8];
+	_mm256_storeu_pd(p, lo);
+	_mm256_storeu_pd(p + 4, hi);
+	for (; i<n; i++) p[i % 8] += a[i] * a[i];
+	return combineSum(p);
+}
+
+// Matrix products keep blocks of the result in registers while running
+// over the columns: 16 rows of a single point, or 8 rows of four points
+// sharing the loads of the matrix.
+AVX2 void gemvAVX2(double* y, const double* a, size_t lda, const double* x, size_t rows, size_t cols)
+{
+	size_t i = 0;
+	for (; i+16<=rows; i+=16)
+	{
+		__m256d c0 = _mm256_loadu_pd(y + i), c1 = _mm256_loadu_pd(y + i + 4);
+		__m256d c2 = _mm256_loadu_pd(y + i + 8), c3 = _mm256_loadu_pd(y + i + 12);
+		for (size_t j=0; j<cols; j++)
+		{
+			const double* aj = a + j * lda + i;
+			__m256d b = _mm256_set1_pd(x[j]);
+			c0 = _mm256_add_pd(c0, _mm256_mul_pd(_mm256_loadu_pd(aj), b));
+			c1 = _mm256_add_pd(c1, _mm256_mul_pd(_mm256_loadu_pd(aj + 4), b));
+			c2 = _mm256_add_pd(c2, _mm256_mul_pd(_mm256_loadu_pd(aj + 8), b));
+			c3 = _mm256_add_pd(c3, _mm256_mul_pd(_mm256_loadu_pd(aj + 12), b));
+		}
+		_mm256_storeu_pd(y + i, c0);
+		_mm256_storeu_pd(y + i + 4, c1);
+		_mm256_storeu_pd(y + i + 8, c2);
+		_mm256_storeu_pd(y + i + 12, c3);
+	}
+	for (; i+4<=rows; i+=4)
+	{
+		__m256d c = _mm256_loadu_pd(y + i);
+		for (size_t j=0; j<cols; j++) c = _mm256_add_pd(c, _mm256_mul_pd(_mm256_loadu_pd(a + j * lda + i), _mm256_set1_pd(x[j])));
+		_mm256_storeu_pd(y + i, c);
+	}
+	gemvScalar(y + i, a + i, lda, x, rows - i, cols);
+}
+
+AVX2 void gemmAVX2(double* y, size_t ldy, const double* a, size_t lda, const double* x, size_t ldx, size_t rows, size_t cols, size_t count)
+{
+	size_t p = 0;
+	for (; p+4<=count; p+=4)
+	{
+		double* y0 = y + p * ldy;
+		double* y1 = y0 + ldy;
+		double* y2 = y1 + ldy;
+		double* y3 = y2 + ldy;
+		const double* x0 = x + p * ldx;
+		const double* x1 = x0 + ldx;
+		const double* x2 = x1 + ldx;
+		const double* x3 = x2 + ldx;
+		size_t i = 0;
+		for (; i+8<=rows; i+=8)
+		{
+			__m256d c00 = _mm256_loadu_pd(y0 + i), c01 = _mm256_loadu_pd(y0 + i + 4);
+			__m256d c10 = _mm256_loadu_pd(y1 + i), c11 = _mm256_loadu_pd(y1 + i + 4);
+			__m256d c20 = _mm256_loadu_pd(y2 + i), c21 = _mm256_loadu_pd(y2 + i + 4);
+			__m256d c30 = _mm256_loadu_pd(y3 + i), c31 = _mm256_loadu_pd(y3 + i + 4);
+			for (size_t j=0; j<cols; j++)
+			{
+				const double* aj = a + j * lda + i;
+				__m256d a0 = _mm256_loadu_pd(aj), a1 = _mm256_loadu_pd(aj + 4);
+				__m256d b = _mm256_set1_pd(x0[j]);
+				c00 = _mm256_add_pd(c00, _mm256_mul_pd(a0, b));
+				c01 = _mm256_add_pd(c01, _mm256_mul_pd(a1, b));
+				b = _mm256_set1_pd(x1[j]);
+				c10 = _mm256_add_pd(c10, _mm256_mul_pd(a0, b));
+				c11 = _mm256_add_pd(c11, _mm256_mul_pd(a1, b));
+				b = _mm256_set1_pd(x2[j]);
+				c20 = _mm256_add_pd(c20, _mm256_mul_pd(a0, b));
+				c21 = _mm256_add_pd(c21, _mm256_mul_pd(a1, b));
+				b = _mm256_set1_pd(x3[j]);
+				c30 = _mm256_add_pd(c30, _mm256_mul_pd(a0, b));
+				c31 = _mm256_add_pd(c31, _mm256_mul_pd(a1, b));
+			}
+			_mm256_storeu_pd(y0 + i, c00); _mm256_storeu_pd(y0 + i + 4, c01);
+			_mm256_storeu_pd(y1 + i, c10); _mm256_storeu_pd(y1 + i + 4, c11);
+			_mm256_storeu_pd(y2 + i, c20); _mm256_storeu_pd(y2 + i + 4, c21);
+			_mm256_storeu_pd(y3 + i, c30); _mm256_storeu_pd(y3 + i + 4, c31);
+		}
+		if (i < rows)
+		{
+			gemvAVX2(y0 + i, a + i, lda, x0, rows - i, cols);
+			gemvAVX2(y1 + i, a + i, lda, x1, rows - i, cols);
+			gemvAVX2(y2 + i, a + i, lda, x2, rows - i, cols);
+			gemvAVX2(y3 + i, a + i, lda, x3, rows - i, cols);
+		}
+	}
+	for (; p<count; p++) gemvAVX2(y + p * ldy, a, lda, x + p * ldx, rows, cols);
+}
+
+// AVX2 lacks scatter instructions, hence only pairs are vectorized
+AVX2 void rotateAVX2(double* a, double* b, double sin, double cos, size_t n)
+{
+	__m256d s = _mm256_set1_pd(sin), c = _mm256_set1_pd(cos);
+	size_t k = 0;
+	for (; k+4<=n; k+=4)
+	{
+		__m256d u = _mm256_loadu_pd(a + k), v = _mm256_loadu_pd(b + k);
+		_mm256_storeu_pd(a + k, _mm256_sub_pd(_mm256_mul_pd(c, u), _mm256_mul_pd(s, v)));
+		_mm256_storeu_pd(b + k, _mm256_add_pd(_mm256_mul_pd(s, u), _mm256_mul_pd(c, v)));
+	}
+	rotateScalar(a + k, b + k, sin, cos, n - k);
+}
+
+const Kernels avx2Kernels = {
+	negAVX2, addAVX2, subAVX2, mulAVX2, divAVX2, scaleAVX2, divideAVX2,
+	scaleAddAVX2, scaleSubAVX2,
+	sumAVX2, productAVX2, dotAVX2, sqrnormAVX2,
+	gemmAVX2, givensScalar, rotateAVX2,
+};
+
+
+////////////////////////////////////////////////////////////
+// AVX-512 kernels
+//
+// One register holds all eight partial results.
+//
+
+#define AVX512 __attribute__((target("avx512f")))
+
+#define AVX512_BINARY(name, op) \
+	AVX512 void name##AVX512(double* d, const double* a, const double* b, size_t n) \
+	{ \
+		size_t i = 0; \
+		for (; i+8<=n; i+=8) _mm512_storeu_pd(d + i, op(_mm512_loadu_pd(a + i), _mm512_loadu_pd(b + i))); \
+		name##Scalar(d + i, a + i, b + i, n - i); \
+	}
+
+#define AVX512_SCALAR(name, op) \
+	AVX512 void name##AVX512(double* d, const double* a, double b, size_t n) \
+	{ \
+		__m512d s = _mm512_set1_pd(b); \
+		size_t i = 0; \
+		for (; i+8<=n; i+=8) _mm512_storeu_pd(d + i, op(_mm512_loadu_pd(a + i), s)); \
+		name##Scalar(d + i, a + i, b, n - i); \
+	}
+
+AVX512_BINARY(add, _mm512_add_pd)
+AVX512_BINARY(sub, _mm512_sub_pd)
+AVX512_BINARY(mul, _mm512_mul_pd)
+AVX512_BINARY(div, _mm512_div_pd)
+AVX512_SCALAR(scale, _mm512_mul_pd)
+AVX512_SCALAR(divide, _mm512_div_pd)
+
+#define AVX512_AFFINE(name, op) \
+	AVX512 void name##AVX512(double* d, const double* a, double b, const double* c, size_t n) \
+	{ \
+		__m512d s = _mm512_set1_pd(b); \
+		size_t i = 0; \
+		for (; i+8<=n; i+=8) _mm512_storeu_pd(d + i, op(_mm512_mul_pd(_mm512_loadu_pd(a + i), s), _mm512_loadu_pd(c + i))); \
+		name##Scalar(d + i, a + i, b, c + i, n - i); \
+	}
+
+AVX512_AFFINE(scaleAdd, _mm512_add_pd)
+AVX512_AFFINE(scaleSub, _mm512_sub_pd)
+
+AVX512 void negAVX512(double* d, const double* a, size_t n)
+{
+	// flip the sign bit (_mm512_xor_pd would require AVX512DQ)
+	__m512i sign = _mm512_set1_epi64((long long)0x8000000000000000ULL);
+	size_t i = 0;
+	for (; i+8<=n; i+=8) _mm512_storeu_pd(d + i, _mm512_castsi512_pd(_mm512_xor_epi64(_mm512_castpd_si512(_mm512_loadu_pd(a + i)), sign)));
+	negScalar(d + i, a + i, n - i);
+}
+
+AVX512 double sumAVX512(const double* a, size_t n)
+{
+	__m512d acc = _mm512_setzero_pd();
+	size_t i = 0;
+	for (; i+8<=n; i+=8) acc = _mm512_add_pd(acc, _mm512_loadu_pd(a + i));
+	double p[8];
+	_mm512_storeu_pd(p, acc);
+	for (; i<n; i++) p[i % 8] += a[i];
+	return combineSum(p);
+}
+
+AVX512 double productAVX512(const double* a, size_t n)
+{
+	__m512d acc = _mm512_set1_pd(1.0);
+	size_t i = 0;
+	for (; i+8<=n; i+=8) acc = _mm512_mul_pd(acc, _mm512_loadu_pd(a + i));
+	double p[8];
+	_mm512_storeu_pd(p, acc);
+	for (; i<n; i++) p[i % 8] *= a[i];
+	return combineProduct(p);
+}
+
+AVX512 double dotAVX512(const double* a, const double* b, size_t n)
+{
+	__m512d acc = _mm512_setzero_pd();
+	size_t i = 0;
+	for (; i+8<=n; i+=8) acc = _mm512_add_pd(acc, _mm512_mul_pd(_mm512_loadu_pd(a + i), _mm512_loadu_pd(b + i)));
+	double p[8];
+	_mm512_storeu_pd(p, acc);
+	for (; i<n; i++) p[i % 8] += a[i] * b[i];
+	return combineSum(p);
+}
+
+AVX512 double sqrnormAVX512(const double* a, size_t n)
+{
+	__m512d acc = _mm512_setzero_pd();
+	size_t i = 0;
+	for (; i+8<=n; i+=8)
+	{
+		__m512d x = _mm512_loadu_pd(a + i);
+		acc = _mm512_add_pd(acc, _mm512_mul_pd(x, x));
+	}
+	double p[8];
+	_mm512_storeu_pd(p, acc);
+	for (; i<n; i++) p[i % 8] += a[i] * a[i];
+	return combineSum(p);
+}
+
+// matrix products: 32 rows of a single point, or 16 rows of four points
+AVX512 void gemvAVX512(double* y, const double* a, size_t lda, const double* x, size_t rows, size_t cols)
+{
+	size_t i = 0;
+	for (; i+32<=rows; i+=32)
+	{
+		__m512d c0 = _mm512_loadu_pd(y + i), c1 = _mm512_loadu_pd(y + i + 8);
+		__m512d c2 = _mm512_loadu_pd(y + i + 16), c3 = _mm512_loadu_pd(y + i + 24);
+		for (size_t j=0; j<cols; j++)
+		{
+			const double* aj = a + j * lda + i;
+			__m512d b = _mm512_set1_pd(x[j]);
+			c0 = _mm512_add_pd(c0, _mm512_mul_pd(_mm512_loadu_pd(aj), b));
+			c1 = _mm512_add_pd(c1, _mm512_mul_pd(_mm512_loadu_pd(aj + 8), b));
+			c2 = _mm512_add_pd(c2, _mm512_mul_pd(_mm512_loadu_pd(aj + 16), b));
+			c3 = _mm512_add_pd(c3, _mm512_mul_pd(_mm512_loadu_pd(aj + 24), b));
+		}
+		_mm512_storeu_pd(y + i, c0);
+		_mm512_storeu_pd(y + i + 8, c1);
+		_mm512_storeu_pd(y + i + 16, c2);
+		_mm512_storeu_pd(y + i + 24, c3);
+	}
+	for (; i+8<=rows; i+=8)
+	{
+		__m512d c = _mm512_loadu_pd(y + i);
+		for (size_t j=0; j<cols; j++) c = _mm512_add_pd(c, _mm512_mul_pd(_mm512_loadu_pd(a + j * lda + i), _mm512_set1_pd(x[j])));
+		_mm512_storeu_pd(y + i, c);
+	}
+	gemvScalar(y + i, a + i, lda, x, rows - i, cols);
+}
+
+AVX512 void gemmAVX512(double* y, size_t ldy, const double* a, size_t lda, const double* x, size_t ldx, size_t rows, size_t cols, size_t count)
+{
+	size_t p = 0;
+	for (; p+4<=count; p+=4)
+	{
+		double* y0 = y + p * ldy;
+		double* y1 = y0 + ldy;
+		double* y2 = y1 + ldy;
+		double* y3 = y2 + ldy;
+		const double* x0 = x + p * ldx;
+		const double* x1 = x0 + ldx;
+		const double* x2 = x1 + ldx;
+		const double* x3 = x2 + ldx;
+		size_t i = 0;
+		for (; i+16<=rows; i+=16)
+		{
+			__m512d c00 = _mm512_loadu_pd(y0 + i), c01 = _mm512_loadu_pd(y0 + i + 8);
+			__m512d c10 = _mm512_loadu_pd(y1 + i), c11 = _mm512_loadu_pd(y1 + i + 8);
+			__m512d c20 = _mm512_loadu_pd(y2 + i), c21 = _mm512_loadu_pd(y2 + i + 8);
+			__m512d c30 = _mm512_loadu_pd(y3 + i), c31 = _mm512_loadu_pd(y3 + i + 8);
+			for (size_t j=0; j<cols; j++)
+			{
+				const double* aj = a + j * lda + i;
+				__m512d a0 = _mm512_loadu_pd(aj), a1 = _mm512_loadu_pd(aj + 8);
+				__m512d b = _mm512_set1_pd(x0[j]);
+				c00 = _mm512_add_pd(c00, _mm512_mul_pd(a0, b));
+				c01 = _mm512_add_pd(c01, _mm512_mul_pd(a1, b));
+				b = _mm512_set1_pd(x1[j]);
+				c10 = _mm512_add_pd(c10, _mm512_mul_pd(a0, b));
+				c11 = _mm512_add_pd(c11, _mm512_mul_pd(a1, b));
+				b = _mm512_set1_pd(x2[j]);
+				c20 = _mm512_add_pd(c20, _mm512_mul_pd(a0, b));
+				c21 = _mm512_add_pd(c21, _mm512_mul_pd(a1, b));
+				b = _mm512_set1_pd(x3[j]);
+				c30 = _mm512_add_pd(c30, _mm512_mul_pd(a0, b));
+				c31 = _mm512_add_pd(c31, _mm512_mul_pd(a1, b));
+			}
+			_mm512_storeu_pd(y0 + i, c00); _mm512_storeu_pd(y0 + i + 8, c01);
+			_mm512_storeu_pd(y1 + i, c10); _mm512_storeu_pd(y1 + i + 8, c11);
+			_mm512_storeu_pd(y2 + i, c20); _mm512_storeu_pd(y2 + i + 8, c21);
+			_mm512_storeu_pd(y3 + i, c30); _mm512_storeu_pd(y3 + i + 8, c31);
+		}
+		if (i < rows)
+		{
+			gemvAVX512(y0 + i, a + i, lda, x0, rows - i, cols);
+			gemvAVX512(y1 + i, a + i, lda, x1, rows - i, cols);
+			gemvAVX512(y2 + i, a + i, lda, x2, rows - i, cols);
+			gemvAVX512(y3 + i, a + i, lda, x3, rows - i, cols);
+		}
+	}
+	for (; p<count; p++) gemvAVX512(y + p * ldy, a, lda, x + p * ldx, rows, cols);
+}
+
+AVX512 void givensAVX512(double* x, const unsigned int* i, const unsigned int* j, const double* sin, const double* cos, size_t n)
+{
+	size_t k = 0;
+	for (; k+8<=n; k+=8)
+	{
+		__m256i ii = _mm256_loadu_si256((const __m256i*)(i + k));
+		__m256i jj = _mm256_loadu_si256((const __m256i*)(j + k));
+		// masked gathers, the plain ones trigger false warnings of GCC 12
+		__m512d a = _mm512_mask_i32gather_pd(_mm512_setzero_pd(), 0xff, ii, x, 8);
+		__m512d b = _mm512_mask_i32gather_pd(_mm512_setzero_pd(), 0xff, jj, x, 8);
+		__m512d s = _mm512_loadu_pd(sin + k), c = _mm512_loadu_pd(cos + k);
+		_mm512_i32scatter_pd(x, ii, _mm512_sub_pd(_mm512_mul_pd(c, a), _mm512_mul_pd(s, b)), 8);
+		_mm512_i32scatter_pd(x, jj, _mm512_add_pd(_mm512_mul_pd(s, a), _mm512_mul_pd(c, b)), 8);
+	}
+	givensScalar(x, i + k, j + k, sin + k, cos + k, n - k);
+}
+
+AVX512 void rotateAVX512(double* a, double* b, double sin, double cos, size_t n)
+{
+	__m512d s = _mm512_set1_pd(sin), c = _mm512_set1_pd(cos);
+	size_t k = 0;
+	for (; k+8<=n; k+=8)
+	{
+		__m512d u = _mm512_loadu_pd(a + k), v = _mm512_loadu_pd(b + k);
+		_mm512_storeu_pd(a + k, _mm512_sub_pd(_mm512_mul_pd(c, u), _mm512_mul_pd(s, v)));
+		_mm512_storeu_pd(b + k, _mm512_add_pd(_mm512_mul_pd(s, u), _mm512_mul_pd(c, v)));
+	}
+	rotateScalar(a + k, b + k, sin, cos, n - k);
+}
+
+const Kernels avx512Kernels = {
+	negAVX512, addAVX512, subAVX512, mulAVX512, divAVX512, scaleAVX512, divideAVX512,
+	scaleAddAVX512, scaleSubAVX512,
+	sumAVX512, productAVX512, dotAVX512, sqrnormAVX512,
+	gemmAVX512, givensAVX512, rotateAVX512,
+};
+
+#endif
+
+
+////////////////////////////////////////////////////////////
+// selection
+//
+
+InstructionSet detect()
+{
+#ifdef KERNELS_X86
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx512f")) return AVX512Instructions;
+	if (__builtin_cpu_supports("avx2")) return AVX2Instructions;
+#endif
+	return ScalarInstructions;
+}
+
+const Kernels* table(InstructionSet set)
+{
+#ifdef KERNELS_X86
+	if (set == AVX512Instructions) return &avx512Kernels;
+	if (set == AVX2Instructions) return &avx2Kernels;
+#endif
+	return &scalarKernels;
+}
+
+// Statically initialized to the scalar kernels, such that kernels used
+// during static initialization of other translation units are safe. All
+// instruction sets yield identical results.
+InstructionSet g_supported = ScalarInstructions;
+InstructionSet g_set = ScalarInstructions;
+const Kernels* g_kernels = &scalarKernels;
+SummationMode g_summation = OrderedSummation;
+
+struct Initializer
+{
+	Initializer()
+	{
+		g_supported = g_set = detect();
+		g_kernels = table(g_set);
+	}
+} initializer;
+
+
+}
+
+
+InstructionSet supportedInstructionSet()
+{ return g_supported; }
+
+InstructionSet instructionSet()
+{ return g_set; }
+
+void setInstructionSet(InstructionSet set)
+{
+	g_set = (set < g_supported) ? set : g_supported;
+	g_kernels = table(g_set);
+}
+
+SummationMode summationMode()
+{ return g_summation; }
+
+void setSummationMode(SummationMode mode)
+{ g_summation = mode; }
+
+
+////////////////////////////////////////////////////////////
+// kernels
+//
+
+void kernelNeg(double* dst, const double* a, size_t n)
+{ g_kernels->neg(dst, a, n); }
+
+void kernelAdd(double* dst, const double* a, const double* b, size_t n)
+{ g_kernels->add(dst, a, b, n); }
+
+void kernelSub(double* dst, const double* a, const double* b, size_t n)
+{ g_kernels->sub(dst, a, b, n); }
+
+void kernelMul(double* dst, const double* a, const double* b, size_t n)
+{ g_kernels->mul(dst, a, b, n); }
+
+void kernelDiv(double* dst, const double* a, const double* b, size_t n)
+{ g_kernels->div(dst, a, b, n); }
+
+void kernelScale(double* dst, const double* a, double b, size_t n)
+{ g_kernels->scale(dst, a, b, n); }
+
+void kernelDivide(double* dst, const double* a, double b, size_t n)
+{ g_kernels->divide(dst, a, b, n); }
+
+void kernelScaleAdd(double* dst, const double* a, double b, const double* c, size_t n)
+{ g_kernels->scaleAdd(dst, a, b, c, n); }
+
+void kernelScaleSub(double* dst, const double* a, double b, const double* c, size_t n)
+{ g_kernels->scaleSub(dst, a, b, c, n); }
+
+double kernelSum(const double* a, size_t n)
+{ return (g_summation == OrderedSummation) ? sumOrdered(a, n) : g_kernels->sum(a, n); }
+
+double kernelProduct(const double* a, size_t n)
+{ return (g_summation == OrderedSummation) ? productOrdered(a, n) : g_kernels->product(a, n); }
+
+double kernelDot(const double* a, const double* b, size_t n)
+{ return (g_summation == OrderedSummation) ? dotOrdered(a, b, n) : g_kernels->dot(a, b, n); }
+
+double kernelSqrNorm(const double* a, size_t n)
+{ return (g_summation == OrderedSummation) ? sqrnormOrdered(a, n) : g_kernels->sqrnorm(a, n); }
+
+// Blocks of the matrix are processed for all points before moving on,
+// such that they are loaded from the cache rather than from memory. The
+// blocks of columns are traversed in order, which keeps the order of the
+// accumulation. A single point reads the matrix only once anyway.
+void kernelGemm(double* y, size_t ldy, const double* a, size_t lda, const double* x, size_t ldx, size_t rows, size_t cols, size_t count)
+{
+	const size_t blockRows = 128;
+	const size_t blockCols = (count < 4) ? cols : 128;
+	for (size_t i=0; i<rows; i+=blockRows)
+	{
+		size_t m = (rows - i < blockRows) ? rows - i : blockRows;
+		for (size_t j=0; j<cols; j+=blockCols)
+		{
+			size_t n = (cols - j < blockCols) ? cols - j : blockCols;
+			g_kernels->gemm(y + i, ldy, a + j * lda + i, lda, x + j, ldx, m, n, count);
+		}
+	}
+}
+
+void kernelGemv(double* y, const double* a, size_t lda, const double* x, size_t rows, size_t cols)
+{ g_kernels->gemm(y, rows, a, lda, x, cols, rows, cols, 1); }
+
+void kernelGivens(double* x, const unsigned int* i, const unsigned int* j, const double* sin, const double* cos, size_t n)
+{ g_kernels->givens(x, i, j, sin, cos, n); }
+
+void kernelRotate(double* a, double* b, double sin, double cos, size_t n)
+{ g_kernels->rotate(a, b, sin, cos, n); }
@@ -0,0 +1,104 @@
+
+#pragma once
+
+
+//
+// Numerical Kernels
+// -----------------
+//
+// Loops over arrays of doubles shared by Vector and by both expression
+// interpreters. Each kernel comes in a scalar version and, on x86 with
+// GCC or Clang, in AVX2 and AVX-512 versions. The best version supported
+// by the CPU is selected at startup.
+//
+// Accuracy contract:
+// Element-wise kernels perform exactly the IEEE operations of the plain
+// scalar loops, hence their results do not depend on the instruction set.
+//
+// Reductions (sum, product, dot product, squared norm) are subject to the
+// summation mode. In OrderedSummation mode (the default) the terms are
+// accumulated from first to last, exactly as in earlier versions of the
+// library. These results are bit-identical to previously published
+// values, but they are not vectorized. In ReassociatedSummation mode term
+// i is accumulated into partial result i mod 8, and the eight partial
+// results are combined as ((p0+p4) + (p2+p6)) + ((p1+p5) + (p3+p7)).
+// This association is fixed, hence also these results do not depend on
+// the instruction set, but they can differ from the ordered results in
+// the last bits. For a sum of n terms x_1, ..., x_n the rounding error is
+// bounded by
+//     gamma(ceil(n/8) + 2) * (|x_1| + ... + |x_n|),
+// with gamma(k) = k u / (1 - k u) and u = 2^-53. The corresponding bound
+// for ordered summation is gamma(n - 1) * (|x_1| + ... + |x_n|). Products
+// obey the analogous relative bound. No fused multiply-add is used.
+//
+
+
+#include <cstddef>
+
+
+enum InstructionSet
+{
+	ScalarInstructions,
+	AVX2Instructions,
+	AVX512Instructions,
+};
+
+enum SummationMode
+{
+	OrderedSummation,
+	ReassociatedSummation,
+};
+
+// best instruction set supported by the CPU
+InstructionSet supportedInstructionSet();
+
+// The instruction set in use is the best supported one by default. It
+// can be lowered, e.g., for testing; requests beyond the supported
+// instruction set are clamped.
+InstructionSet instructionSet();
+void setInstructionSet(InstructionSet set);
+
+// The summation mode applies to all threads, it should be set before
+// evaluations start.
+SummationMode summationMode();
+void setSummationMode(SummationMode mode);
+
+
+// element-wise operations, the destination may coincide with an argument
+void kernelNeg(double* dst, const double* a, std::size_t n);                      // dst = -a
+void kernelAdd(double* dst, const double* a, const double* b, std::size_t n);     // dst = a + b
+void kernelSub(double* dst, const double* a, const double* b, std::size_t n);     // dst = a - b
+void kernelMul(double* dst, const double* a, const double* b, std::size_t n);     // dst = a .* b
+void kernelDiv(double* dst, const double* a, const double* b, std::size_t n);     // dst = a ./ b
+void kernelScale(double* dst, const double* a, double b, std::size_t n);          // dst = a * b
+void kernelDivide(double* dst, const double* a, double b, std::size_t n);         // dst = a / b
+void kernelScaleAdd(double* dst, const double* a, double b, const double* c, std::size_t n);   // dst = a * b + c
+void kernelScaleSub(double* dst, const double* a, double b, const double* c, std::size_t n);   // dst = a * b - c
+
+// Matrix products y_p += A x_p for count points x_0, ..., x_{count-1}.
+// The matrix A has the given numbers of rows and columns and is stored
+// column by column, column j starting at a + j * lda. Point p starts at
+// x + p * ldx and its result at y + p * ldy. Every component of y_p
+// accumulates the products A(i, j) * x_p(j) in the order of the columns,
+// exactly as the plain loop
+//     for (j=0; j<cols; j++) y_p[i] += a[j * lda + i] * x_p[j];
+// hence the results depend neither on the instruction set nor on the
+// summation mode. The kernels are register blocked over rows and points
+// and cache blocked over the matrix. The result must not overlap the
+// arguments.
+void kernelGemm(double* y, std::size_t ldy, const double* a, std::size_t lda, const double* x, std::size_t ldx, std::size_t rows, std::size_t cols, std::size_t count);
+void kernelGemv(double* y, const double* a, std::size_t lda, const double* x, std::size_t rows, std::size_t cols);
+
+// Givens rotations (see givens.h). kernelGivens applies n rotations to
+// x, rotation k acting on the coordinates i[k] and j[k], which must all
+// be distinct. kernelRotate rotates pairs (a[k], b[k]) by the same
+// angle. Both perform exactly the operations
+//     (a, b) = (cos * a - sin * b, sin * a + cos * b).
+void kernelGivens(double* x, const unsigned int* i, const unsigned int* j, const double* sin, const double* cos, std::size_t n);
+void kernelRotate(double* a, double* b, double sin, double cos, std::size_t n);
+
+// reductions, subject to the summation mode
+double kernelSum(const double* a, std::size_t n);
+double kernelProduct(const double* a, std::size_t n);
+double kernelDot(const double* a, const double* b, std::size_t n);
+double kernelSqrNorm(const double* a, std::size_t n);
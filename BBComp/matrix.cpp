@@ -1,8 +1,7 @@
 
 #include "matrix.h"
-#ifdef _WIN32
-#include <algorithm>	// otherwise "'min' : is not a member of 'std'"  
-#endif
+#include "kernels.h"
+#include <algorithm>
 
 using namespace std;
 
@@ -12,6 +11,54 @@ Matrix operator * (double lhs, Matrix const& rhs)
 	return (rhs * lhs);
 }
 
+// The rows of the result and of this matrix take the role of the points
+// of kernelGemm, and the rows of the other matrix that of the columns of
+// the kernel's matrix.
+Matrix Matrix::operator * (Matrix const& other) const
+{
+	assert(m_cols == other.rows());
+	Matrix ret(m_rows, other.cols());
+	if (ret.empty() || m_cols == 0) return ret;
+	kernelGemm(ret.data(), ret.cols(), other.data(), other.cols(), data(), m_cols, other.cols(), m_cols, m_rows);
+	return ret;
+}
+
+// Eight rows are accumulated at once, in independent registers.
+Vector Matrix::operator * (Vector const& other) const
+{
+	assert(m_cols == other.size());
+	Vector ret(m_rows);
+	const double* a = m_data.data();
+	const double* x = other.data();
+	size_t i = 0;
+	for (; i+8<=m_rows; i+=8)
+	{
+		const double* r = a + i * m_cols;
+		double v0 = 0.0, v1 = 0.0, v2 = 0.0, v3 = 0.0, v4 = 0.0, v5 = 0.0, v6 = 0.0, v7 = 0.0;
+		for (size_t j=0; j<m_cols; j++)
+		{
+			double xj = x[j];
+			v0 += r[j] * xj;
+			v1 += r[m_cols + j] * xj;
+			v2 += r[2 * m_cols + j] * xj;
+			v3 += r[3 * m_cols + j] * xj;
+			v4 += r[4 * m_cols + j] * xj;
+			v5 += r[5 * m_cols + j] * xj;
+			v6 += r[6 * m_cols + j] * xj;
+			v7 += r[7 * m_cols + j] * xj;
+		}
+		ret[i] = v0; ret[i + 1] = v1; ret[i + 2] = v2; ret[i + 3] = v3;
+		ret[i + 4] = v4; ret[i + 5] = v5; ret[i + 6] = v6; ret[i + 7] = v7;
+	}
+	for (; i<m_rows; i++)
+	{
+		double value = 0.0;
+		for (size_t j=0; j<m_cols; j++) value += a[i * m_cols + j] * x[j];
+		ret[i] = value;
+	}
+	return ret;
+}
+
 Matrix Matrix::inverse() const
 {
 	size_t m = rows();
@@ -159,41 +159,11 @@ public:
 		ret /= scalar;
 		return ret;
 	}
-	inline Matrix operator * (Matrix const& other) const
-	{
-		assert(m_cols == other.rows());
-		Matrix ret(m_rows, other.cols());
-		std::size_t i, j, k;
-		for (i=0; i<m_rows; i++)
-		{
-			for (j=0; j<other.cols(); j++)
-			{
-				double value = 0.0;
-				for (k=0; k<m_cols; k++)
-				{
-					value += (*this)(i, k) * other(k, j);
-				}
-				ret(i, j) = value;
-			}
-		}
-		return ret;
-	}
-	inline Vector operator * (Vector const& other) const
-	{
-		assert(m_cols == other.size());
-		Vector ret(m_rows);
-		std::size_t i, j;
-		for (i=0; i<m_rows; i++)
-		{
-			double value = 0.0;
-			for (j=0; j<m_cols; j++)
-			{
-				value += (*this)(i, j) * other[j];
-			}
-			ret[i] = value;
-		}
-		return ret;
-	}
+	// Products are computed with the matrix kernels (see kernels.h).
+	// Every entry accumulates its terms in order, exactly as the plain
+	// loop value += (*this)(i, k) * other(k, j) starting from zero.
+	Matrix operator * (Matrix const& other) const;
+	Vector operator * (Vector const& other) const;
 
 	inline void operator *= (Matrix const& other)
 	{ *this = Matrix::operator *((Matrix const&)other); }
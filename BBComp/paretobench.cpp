@@ -0,0 +1,123 @@
+
+#include "paretofront.h"
+#include "rng.h"
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+
+using namespace std;
+
+
+// This program compares the indexed ParetoFront (a map for two
+// objectives, a k-d tree otherwise, see paretofront.h) with the linear
+// scan of earlier versions, on sequences of n random points close to a
+// spherical front with m objectives. It reports the final size of the
+// front and the time per insertion of both, which grows linearly with
+// the size of the front for the scan and far slower for the index, and
+// it checks that both accept the same points and end up with the same
+// set.
+//
+// usage: paretobench
+
+
+// the non-dominated set of ParetoFront in earlier versions
+class LinearFront
+{
+public:
+	bool insert(Vector const& point)
+	{
+		for (size_t j=0; j<m_points.size(); j++)
+		{
+			Vector& x = m_points[j];
+			int dom = 3;
+			for (size_t i=0; i<point.size(); i++)
+			{
+				if (point[i] < x[i]) dom &= 1;
+				else if (x[i] < point[i]) dom &= 2;
+				if (dom == 0) break;
+			}
+			if (dom & 2) return false;
+			else if (dom == 1)
+			{
+				Vector& y = m_points.back();
+				x = y;
+				m_points.pop_back();
+				j--;
+			}
+		}
+		m_points.push_back(point);
+		return true;
+	}
+
+	vector<Vector> const& points() const
+	{ return m_points; }
+
+private:
+	vector<Vector> m_points;
+};
+
+// points in lexicographic order, for comparing sets
+vector< vector<double> > sorted(vector<Vector> const& points)
+{
+	vector< vector<double> > ret;
+	for (size_t k=0; k<points.size(); k++) ret.push_back(vector<double>(points[k].begin(), points[k].end()));
+	sort(ret.begin(), ret.end());
+	return ret;
+}
+
+int main(int argc, char** argv)
+{
+	if (argc != 1) { cerr << "usage: " << argv[0] << endl; return 1; }
+
+	const size_t objectives[] = { 2, 3, 4, 5 };
+	const size_t counts[] = { 1000, 4000, 16000 };
+
+	RNG rng(1);
+	bool identical = true;
+	cout << setw(4) << "m" << setw(8) << "n" << setw(8) << "front" << setw(14) << "linear [us]" << setw(14) << "indexed [us]" << endl;
+	for (size_t i=0; i<sizeof(objectives)/sizeof(objectives[0]); i++)
+	{
+		for (size_t j=0; j<sizeof(counts)/sizeof(counts[0]); j++)
+		{
+			size_t m = objectives[i], n = counts[j];
+
+			// uniform directions, at distance 1 to 1.05 from the origin
+			vector<Vector> points(n);
+			for (size_t k=0; k<n; k++)
+			{
+				Vector x(m);
+				double r = 0.0;
+				for (size_t l=0; l<m; l++)
+				{
+					x[l] = fabs(rng.gauss());
+					r += x[l] * x[l];
+				}
+				r = (1.0 + 0.05 * rng.uniform()) / sqrt(r);
+				for (size_t l=0; l<m; l++) x[l] *= r;
+				points[k] = x;
+			}
+
+			LinearFront linear;
+			vector<bool> accepted(n);
+			chrono::steady_clock::time_point t0 = chrono::steady_clock::now();
+			for (size_t k=0; k<n; k++) accepted[k] = linear.insert(points[k]);
+			chrono::steady_clock::time_point t1 = chrono::steady_clock::now();
+			ParetoFront indexed;
+			for (size_t k=0; k<n; k++) if (indexed.insert(points[k]) != accepted[k]) identical = false;
+			chrono::steady_clock::time_point t2 = chrono::steady_clock::now();
+			if (sorted(linear.points()) != sorted(indexed.points())) identical = false;
+
+			double tl = chrono::duration<double>(t1 - t0).count() / n;
+			double ti = chrono::duration<double>(t2 - t1).count() / n;
+			cout << setw(4) << m << setw(8) << n << setw(8) << indexed.size()
+				<< fixed << setprecision(3) << setw(14) << 1e6 * tl << setw(14) << 1e6 * ti << endl;
+		}
+	}
+
+	cout << (identical ? "results are identical" : "RESULTS DIFFER") << endl;
+	return identical ? 0 : 1;
+}
@@ -16,6 +16,12 @@ void ParetoFront::clear()
 {
 	m_points.clear();
 	m_objectives = 0;
+	m_index2D.clear();
+	m_root = -1;
+	m_node.clear();
+	m_lower.clear();
+	m_upper.clear();
+	m_nodeOf.clear();
 }
 
 bool ParetoFront::insert(Vector const& point)
@@ -27,25 +33,224 @@ bool ParetoFront::insert(Vector const& point)
 	}
 	else assert(point.size() == m_objectives);
 
-	for (size_t j=0; j<m_points.size(); j++)
+	if (m_objectives == 2) return insert2D(point);
+	else return insertTree(point);
+}
+
+bool ParetoFront::dominates(Vector const& point) const
+{
+	if (m_points.empty()) return false;
+	assert(point.size() == m_objectives);
+	if (m_objectives == 2)
+	{
+		map<double, size_t>::const_iterator it = m_index2D.upper_bound(point[0]);
+		if (it == m_index2D.begin()) return false;
+		--it;
+		return (m_points[it->second][1] <= point[1]);
+	}
+	else return dominated(m_root, point);
+}
+
+bool ParetoFront::insert2D(Vector const& point)
+{
+	double x = point[0];
+	double y = point[1];
+
+	// check whether the point is weakly dominated
+	map<double, size_t>::iterator it = m_index2D.lower_bound(x);
+	if (it != m_index2D.end() && it->first == x && m_points[it->second][1] <= y) return false;
+	if (it != m_index2D.begin())
+	{
+		map<double, size_t>::iterator prev = it;
+		--prev;
+		if (m_points[prev->second][1] <= y) return false;
+	}
+
+	// remove dominated points, they follow in the order of the first objective
+	vector<size_t> removed;
+	while (it != m_index2D.end() && m_points[it->second][1] >= y)
+	{
+		removed.push_back(it->second);
+		it = m_index2D.erase(it);
+	}
+	erase(removed);
+
+	m_index2D.insert(it, make_pair(x, m_points.size()));
+	m_points.push_back(point);
+	return true;
+}
+
+bool ParetoFront::insertTree(Vector const& point)
+{
+	if (dominated(m_root, point)) return false;
+
+	vector<size_t> removed;
+	collectDominated(m_root, point, removed);
+	erase(removed);
+
+	m_points.push_back(point);
+	add(m_points.size() - 1);
+
+	// get rid of dead nodes
+	if (m_node.size() > 2 * m_points.size() + 16) rebuild();
+	return true;
+}
+
+// remove points by swapping with the last point
+void ParetoFront::erase(vector<size_t>& indices)
+{
+	sort(indices.begin(), indices.end(), greater<size_t>());
+	for (size_t k=0; k<indices.size(); k++)
+	{
+		size_t j = indices[k];
+		size_t last = m_points.size() - 1;
+		if (j != last)
+		{
+			m_points[j] = m_points[last];
+			if (m_objectives == 2) m_index2D[m_points[j][0]] = j;
+			else
+			{
+				m_nodeOf[j] = m_nodeOf[last];
+				m_node[m_nodeOf[j]].point = (int)j;
+			}
+		}
+		m_points.pop_back();
+		if (m_objectives != 2) m_nodeOf.pop_back();
+	}
+}
+
+// is there a point in the sub-tree weakly dominating #point?
+bool ParetoFront::dominated(int node, Vector const& point) const
+{
+	if (node < 0) return false;
+	const double* lower = &m_lower[node * m_objectives];
+	for (size_t i=0; i<m_objectives; i++) if (lower[i] > point[i]) return false;
+
+	Node const& n = m_node[node];
+	if (n.point >= 0)
+	{
+		Vector const& x = m_points[n.point];
+		size_t i = 0;
+		while (i < m_objectives && x[i] <= point[i]) i++;
+		if (i == m_objectives) return true;
+	}
+	return dominated(n.left, point) || dominated(n.right, point);
+}
+
+// remove all points in the sub-tree dominated by #point from the tree
+void ParetoFront::collectDominated(int node, Vector const& point, vector<size_t>& indices)
+{
+	if (node < 0) return;
+	const double* upper = &m_upper[node * m_objectives];
+	for (size_t i=0; i<m_objectives; i++) if (upper[i] < point[i]) return;
+
+	Node& n = m_node[node];
+	if (n.point >= 0)
+	{
+		Vector const& x = m_points[n.point];
+		size_t i = 0;
+		while (i < m_objectives && x[i] >= point[i]) i++;
+		if (i == m_objectives)
+		{
+			indices.push_back(n.point);
+			n.point = -1;
+		}
+	}
+	collectDominated(n.left, point, indices);
+	collectDominated(n.right, point, indices);
+}
+
+int ParetoFront::addNode(size_t index, size_t axis)
+{
+	Vector const& x = m_points[index];
+	Node n;
+	n.split = x[axis];
+	n.axis = axis;
+	n.point = (int)index;
+	n.left = -1;
+	n.right = -1;
+	m_node.push_back(n);
+	m_lower.insert(m_lower.end(), x.begin(), x.end());
+	m_upper.insert(m_upper.end(), x.begin(), x.end());
+	return (int)m_node.size() - 1;
+}
+
+// insert point #index into the tree
+void ParetoFront::add(size_t index)
+{
+	Vector const& x = m_points[index];
+	if (m_nodeOf.size() <= index) m_nodeOf.resize(index + 1);
+	if (m_root < 0)
 	{
-		Vector& x = m_points[j];
-		int dom = 3;
+		m_root = addNode(index, 0);
+		m_nodeOf[index] = m_root;
+		return;
+	}
+
+	int node = m_root;
+	size_t depth = 0;
+	while (true)
+	{
+		double* lower = &m_lower[node * m_objectives];
+		double* upper = &m_upper[node * m_objectives];
 		for (size_t i=0; i<m_objectives; i++)
 		{
-			if (point[i] < x[i]) dom &= 1;
-			else if (x[i] < point[i]) dom &= 2;
-			if (dom == 0) break;
+			lower[i] = std::min(lower[i], x[i]);
+			upper[i] = std::max(upper[i], x[i]);
 		}
-		if (dom & 2) return false;
-		else if (dom == 1)
+		depth++;
+		size_t axis = m_node[node].axis;
+		bool left = (x[axis] < m_node[node].split);
+		int child = left ? m_node[node].left : m_node[node].right;
+		if (child < 0)
 		{
-			Vector& y = m_points.back();
-			x = y;
-			m_points.pop_back();
-			j--;
+			child = addNode(index, (axis + 1) % m_objectives);
+			if (left) m_node[node].left = child; else m_node[node].right = child;
+			m_nodeOf[index] = child;
+			break;
 		}
+		node = child;
 	}
-	m_points.push_back(point);
-	return true;
+
+	// rebuild if the tree is far from balanced
+	if ((double)depth > 3.0 * std::log2((double)m_points.size()) + 8.0) rebuild();
+}
+
+int ParetoFront::build(vector<size_t>& indices, size_t begin, size_t end, size_t depth)
+{
+	if (begin == end) return -1;
+	size_t axis = depth % m_objectives;
+	size_t mid = (begin + end) / 2;
+	nth_element(indices.begin() + begin, indices.begin() + mid, indices.begin() + end, [this, axis](size_t i, size_t j)
+	{
+		return m_points[i][axis] < m_points[j][axis];
+	});
+	int node = addNode(indices[mid], axis);
+	m_nodeOf[indices[mid]] = node;
+	int left = build(indices, begin, mid, depth + 1);
+	int right = build(indices, mid + 1, end, depth + 1);
+	m_node[node].left = left;
+	m_node[node].right = right;
+	for (int c=0; c<2; c++)
+	{
+		int child = c ? right : left;
+		if (child < 0) continue;
+		for (size_t i=0; i<m_objectives; i++)
+		{
+			m_lower[node * m_objectives + i] = std::min(m_lower[node * m_objectives + i], m_lower[child * m_objectives + i]);
+			m_upper[node * m_objectives + i] = std::max(m_upper[node * m_objectives + i], m_upper[child * m_objectives + i]);
+		}
+	}
+	return node;
+}
+
+void ParetoFront::rebuild()
+{
+	m_node.clear();
+	m_lower.clear();
+	m_upper.clear();
+	m_nodeOf.assign(m_points.size(), -1);
+	vector<size_t> indices(m_points.size());
+	for (size_t i=0; i<indices.size(); i++) indices[i] = i;
+	m_root = build(indices, 0, indices.size(), 0);
 }
@@ -5,16 +5,21 @@
 #include "vector.h"
 #include <vector>
 #include <list>
+#include <map>
 #include <cmath>
 #include <cassert>
 
 
 // A front is a set of mutually non-dominated points.
+// Dominance queries are answered by an index: a map sorted by the
+// first objective for two objectives, and a k-d tree with bounding
+// boxes of sub-trees otherwise.
 class ParetoFront
 {
 public:
 	ParetoFront()
 	: m_objectives(0)
+	, m_root(-1)
 	{ }
 
 	bool empty() const
@@ -37,7 +42,41 @@ public:
 	// update the non-dominated set, return true if the point was added
 	bool insert(Vector const& point);
 
+	// is the point weakly dominated by a point of the front?
+	bool dominates(Vector const& point) const;
+
 private:
+	// k-d tree node, removed points leave dead nodes behind
+	struct Node
+	{
+		double split;            // coordinate of the point along the axis
+		std::size_t axis;
+		int point;               // index into m_points, -1 if removed
+		int left;                // coordinates < split (up to ties after rebuild)
+		int right;               // coordinates >= split
+	};
+
+	bool insert2D(Vector const& point);
+	bool insertTree(Vector const& point);
+	void erase(std::vector<std::size_t>& indices);
+
+	bool dominated(int node, Vector const& point) const;
+	void collectDominated(int node, Vector const& point, std::vector<std::size_t>& indices);
+	int addNode(std::size_t index, std::size_t axis);
+	void add(std::size_t index);
+	int build(std::vector<std::size_t>& indices, std::size_t begin, std::size_t end, std::size_t depth);
+	void rebuild();
+
 	std::size_t m_objectives;
 	std::vector<Vector> m_points;
+
+	// two objectives: first objective -> index into m_points
+	std::map<double, std::size_t> m_index2D;
+
+	// otherwise: k-d tree
+	int m_root;
+	std::vector<Node> m_node;
+	std::vector<double> m_lower;           // bounding boxes of sub-trees, m_objectives entries per node
+	std::vector<double> m_upper;
+	std::vector<int> m_nodeOf;             // node of each point
 };
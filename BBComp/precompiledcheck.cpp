@@ -0,0 +1,70 @@
+#include "checks.h"
+#include "bytecode.h"
+#include "rng.h"
+#include <iostream>
+#include <string>
+#include <vector>
+
+
+using namespace std;
+
+
+// This program validates the code generated ahead of time from
+// problems.json (see generate.cpp) against the interpreters: for all
+// functions, in several dimensions and at random points, the precompiled
+// code, the specialized and the generic bytecode, and the expression tree
+// must yield bit-identical values, or raise the same errors. Functions
+// without precompiled code, or whose program no longer has the structure
+// the code was generated for, are reported as failures as well, since
+// the library would silently fall back to the interpreter for them.
+//
+// usage: precompiledcheck problems.json
+
+
+int main(int argc, char** argv)
+{
+	if (argc != 2) { cerr << "usage: " << argv[0] << " problems.json" << endl; return 1; }
+
+	const size_t dimensions[] = { 1, 2, 3, 5, 10, 40, 100 };
+	const unsigned int points = 5;
+
+	setInterpreterMode(BytecodeInterpreter);
+	RNG rng(1);
+	return checkFunctions(argv[1], [&](string const& name, ExpressionPtr generic, string& info)
+	{
+		const PrecompiledProgram* code = nullptr;
+		for (size_t i=0; i<precompiledProgramCount; i++) if (name == precompiledPrograms[i].name) code = &precompiledPrograms[i];
+		uint64_t structure;
+		generateSource(generic, "f", structure);
+		string problem;
+		if (! code) problem = "no precompiled code";
+		else if (code->structure != structure) problem = "precompiled code does not match the program";
+
+		for (size_t k=0; k<sizeof(dimensions)/sizeof(dimensions[0]) && problem.empty(); k++)
+		{
+			size_t d = dimensions[k];
+			ExpressionPtr precompiled = specialize(generic, d, *code);
+			ExpressionPtr specialized = specialize(generic, d);
+			vector<Vector> x(points);
+			vector<Result> values(points);
+			for (unsigned int p=0; p<points; p++)
+			{
+				x[p] = Vector(d);
+				for (size_t i=0; i<d; i++) x[p][i] = 4.0 * rng.uniform() - 2.0;
+			}
+
+			// the precompiled code runs first, such that state left behind by
+			// the interpreters cannot mask state it keeps between calls
+			for (unsigned int p=0; p<points; p++) values[p] = result([&]() { return evaluate(precompiled, x[p]); });
+			for (unsigned int p=0; p<points && problem.empty(); p++)
+			{
+				Result reference = result([&]() { return evaluateTree(generic, x[p]); });
+				if (result([&]() { return evaluate(generic, x[p]); }) != reference) problem = "generic bytecode differs from the tree";
+				else if (result([&]() { return evaluate(specialized, x[p]); }) != reference) problem = "specialized bytecode differs from the tree";
+				else if (values[p] != reference) problem = "precompiled code differs from the tree";
+				if (! problem.empty()) problem += " in dimension " + to_string(d);
+			}
+		}
+		return problem;
+	});
+}
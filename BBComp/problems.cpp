@@ -3,13 +3,21 @@
 #include "problems.h"
 #include "rng.h"
 #include "interpreter.h"
+#include "bytecode.h"
+#include "kernels.h"
+#include "vecmath.h"
+#include "givens.h"
 
 #include <string>
+#include <tuple>
+#include <list>
+#include <mutex>
 #include <algorithm>
 #include <stdexcept>
 #include <iostream>
 #include <cmath>
 #include <cstdlib>
+#include <cstdio>
 #include <cassert>
 
 
@@ -34,6 +42,37 @@ ExpressionPtr getObjectiveFunction(std::string const& name)
 	else return it->second;
 }
 
+// code generated from problems.json at build time, if any
+const PrecompiledProgram* getPrecompiledProgram(std::string const& name)
+{
+	for (size_t i=0; i<precompiledProgramCount; i++)
+	{
+		if (name == precompiledPrograms[i].name) return &precompiledPrograms[i];
+	}
+	return nullptr;
+}
+
+// Specializations for fixed dimensions, shared by all problems. They
+// reflect the summation and math modes, which are hence part of the key.
+// Precompiled code is preferred where it matches the parsed program.
+typedef std::tuple<std::string, unsigned int, SummationMode, MathMode> SpecializationKey;
+std::map<SpecializationKey, ExpressionPtr> lookupSpecialization;
+std::mutex specializationMutex;
+ExpressionPtr getObjectiveFunction(std::string const& name, unsigned int dimension)
+{
+	ExpressionPtr generic = getObjectiveFunction(name);
+	if (! generic) return generic;
+	SpecializationKey key(name, dimension, summationMode(), mathMode());
+	std::lock_guard<std::mutex> lock(specializationMutex);
+	ExpressionPtr& ret = lookupSpecialization[key];
+	if (! ret)
+	{
+		const PrecompiledProgram* code = getPrecompiledProgram(name);
+		ret = code ? specialize(generic, dimension, *code) : specialize(generic, dimension);
+	}
+	return ret;
+}
+
 void compileFunctions(Json dict)
 {
 	if (!lookupObjectiveFunction.empty()) return;
@@ -72,6 +111,20 @@ public:
 
 	virtual Vector apply(Vector const& x) const = 0;
 
+	// transformation of count points of the given dimension, stored row-major
+	virtual void applyBatch(const double* points, size_t count, size_t dim, double* result) const
+	{
+		for (size_t k=0; k<count; k++)
+		{
+			ArenaScope scope;
+			Vector y = apply(Vector(dim, points + k * dim));
+			std::copy(y.begin(), y.end(), result + k * dim);
+		}
+	}
+
+	// product of the transposed Jacobian at x with v
+	virtual Vector transposedJacobian(Vector const& x, Vector const& v) const = 0;
+
 	Vector operator () (Vector const& x) const
 	{
 		return apply(x);
@@ -89,6 +142,11 @@ public:
 	{
 		return x;
 	}
+
+	Vector transposedJacobian(Vector const& x, Vector const& v) const
+	{
+		return v;
+	}
 };
 
 
@@ -122,26 +180,55 @@ public:
 			double norm = sqrt(norm2);
 			for (unsigned int k = 0; k<dim; k++) row_i[k] /= norm;
 		}
+
+		// column-major copy for the matrix kernels
+		m_columns.resize(dim * dim);
+		for (unsigned int i = 0; i<dim; i++)
+			for (unsigned int j = 0; j<dim; j++) m_columns[j * dim + i] = m_rotation[i * dim + j];
 	}
 
+	// The kernels accumulate each row in the order of the columns, hence
+	// the result coincides with the plain loop
+	//     v = shift[i]; for all j: v += rotation(i, j) * (2.5*(x[j] - 0.5));
+	//     result[i] = v + 0.5;
+	// The scaling makes sure that the optimum is in the feasible region.
 	Vector apply(Vector const& x) const
 	{
 		size_t dim = x.size();
-		Vector result(dim);
+		Vector u(dim), result(dim);
+		for (size_t j = 0; j<dim; j++) u[j] = 2.5*(x[j] - 0.5);
+		std::copy(m_shift.begin(), m_shift.end(), result.begin());
+		kernelGemv(result.data(), m_columns.data(), dim, u.data(), dim, dim);
+		for (size_t i = 0; i<dim; i++) result[i] += 0.5;
+		return result;
+	}
+
+	void applyBatch(const double* points, size_t count, size_t dim, double* result) const
+	{
+		std::vector<double> u(count * dim);
+		for (size_t k = 0; k<count * dim; k++) u[k] = 2.5*(points[k] - 0.5);
+		for (size_t k = 0; k<count; k++) std::copy(m_shift.begin(), m_shift.end(), result + k * dim);
+		kernelGemm(result, dim, m_columns.data(), dim, u.data(), dim, dim, dim, count);
+		for (size_t k = 0; k<count * dim; k++) result[k] += 0.5;
+	}
+
+	Vector transposedJacobian(Vector const& x, Vector const& v) const
+	{
+		size_t dim = x.size();
+		Vector result(dim, 0.0);
 		for (size_t i = 0; i<dim; i++)
 		{
-			double v = m_shift[i];
 			const double* row = &m_rotation[dim * i];
-			for (size_t j = 0; j<dim; j++) v += row[j] * (2.5*(x[j] - 0.5)); //multiply to make sure the optimum is in the feasible region
-			result[i] = v + 0.5;
+			for (size_t j = 0; j<dim; j++) result[j] += row[j] * v[i];
 		}
-
+		for (size_t j = 0; j<dim; j++) result[j] *= 2.5;
 		return result;
 	}
 
 protected:
 	vector<double> m_shift;
 	vector<double> m_rotation;
+	vector<double> m_columns;                    // m_rotation stored column by column
 };
 
 
@@ -166,6 +253,11 @@ public:
 		return result;
 	}
 
+	Vector transposedJacobian(Vector const& x, Vector const& v) const
+	{
+		return v;
+	}
+
 protected:
 	vector<double> m_shift;
 };
@@ -193,23 +285,44 @@ public:
 			m_sin[i] = sin(angle);
 			m_cos[i] = cos(angle);
 		}
+		m_rotations = GivensRotations(dim, m_axis1, m_axis2, m_sin, m_cos);
 	}
 
+	// The rotations are applied in independent layers, with the same
+	// result as applying them one by one in the order of generation.
 	Vector apply(Vector const& x) const
 	{
 		size_t dim = x.size();
 		Vector result(dim);
 		for (size_t i = 0; i<dim; i++) result[i] = 2.5*(x[i] - 0.5);	//multiply to make sure the optimum is in the feasible region
-		for (size_t i = 0; i<2 * dim; i++)
+		m_rotations.apply(result.data());
+		for (size_t i = 0; i<dim; i++) result[i] += m_shift[i] + 0.5;
+		return result;
+	}
+
+	// all points at once, in structure-of-arrays layout
+	void applyBatch(const double* points, size_t count, size_t dim, double* result) const
+	{
+		std::vector<double> t(dim * count);
+		for (size_t k = 0; k<count; k++)
+			for (size_t i = 0; i<dim; i++) t[i * count + k] = 2.5*(points[k * dim + i] - 0.5);
+		m_rotations.applyBatch(t.data(), count, count);
+		for (size_t k = 0; k<count; k++)
+			for (size_t i = 0; i<dim; i++) result[k * dim + i] = t[i * count + k] + (m_shift[i] + 0.5);
+	}
+
+	Vector transposedJacobian(Vector const& x, Vector const& v) const
+	{
+		size_t dim = x.size();
+		Vector result = v.copy();
+		for (size_t i = 2 * dim; i>0; i--)
 		{
-			double a = result[m_axis1[i]];
-			double b = result[m_axis2[i]];
-			double x = m_cos[i] * a - m_sin[i] * b;
-			double y = m_sin[i] * a + m_cos[i] * b;
-			result[m_axis1[i]] = x;
-			result[m_axis2[i]] = y;
+			double a = result[m_axis1[i-1]];
+			double b = result[m_axis2[i-1]];
+			result[m_axis1[i-1]] = m_cos[i-1] * a + m_sin[i-1] * b;
+			result[m_axis2[i-1]] = -m_sin[i-1] * a + m_cos[i-1] * b;
 		}
-		for (size_t i = 0; i<dim; i++) result[i] += m_shift[i] + 0.5;
+		for (size_t i = 0; i<dim; i++) result[i] *= 2.5;
 		return result;
 	}
 
@@ -219,6 +332,7 @@ protected:
 	vector<unsigned int> m_axis2;
 	vector<double> m_sin;
 	vector<double> m_cos;
+	GivensRotations m_rotations;                 // the above, in layers
 };
 
 
@@ -248,6 +362,9 @@ public:
 
 	virtual double apply(double value) const = 0;
 
+	// derivative at the given value
+	virtual double derivative(double value) const = 0;
+
 	double operator () (double value) const
 	{
 		return apply(value);
@@ -265,6 +382,11 @@ public:
 	{
 		return value;
 	}
+
+	double derivative(double value) const
+	{
+		return 1.0;
+	}
 };
 
 
@@ -278,6 +400,12 @@ public:
 	{
 		return tanh(value);
 	}
+
+	double derivative(double value) const
+	{
+		double t = tanh(value);
+		return 1.0 - t * t;
+	}
 };
 
 class AbsPow05 : public ValueTransformation
@@ -290,6 +418,13 @@ public:
 	{
 		return std::pow(std::fabs(value), 0.5);
 	}
+
+	double derivative(double value) const
+	{
+		if (value > 0.0) return 0.5 / std::sqrt(value);
+		else if (value < 0.0) return -0.5 / std::sqrt(-value);
+		else return 0.0;
+	}
 };
 
 class Steps : public ValueTransformation
@@ -313,6 +448,11 @@ public:
 		return (value + m_value[index]);
 	}
 
+	double derivative(double value) const
+	{
+		return 1.0;
+	}
+
 protected:
 	vector<double> m_pos;
 	vector<double> m_value;
@@ -344,6 +484,19 @@ public:
 		return (v0 + ((2.25 - 1.5 * x) * x + 0.25) * x);
 	}
 
+	double derivative(double value) const
+	{
+		if (value <= m_pos[0]) return 1.0;
+		if (value >= m_pos[99]) return 1.0;
+		vector<double>::const_iterator it = upper_bound(m_pos.begin(), m_pos.end(), value);
+		unsigned int index = distance(m_pos.begin(), it);
+		if (index == 0) index = 1;
+		double v0 = m_pos[index - 1];
+		double v1 = m_pos[index];
+		double x = (value - v0) / (v1 - v0);
+		return ((4.5 - 4.5 * x) * x + 0.25) / (v1 - v0);
+	}
+
 protected:
 	vector<double> m_pos;
 };
@@ -369,6 +522,15 @@ public:
 		value = 1 * pow(value, 4.0);
 		return value;
 	}
+
+	double derivative(double value) const
+	{
+		if (value < 0) return 0.0;
+		double lv = log10(value);
+		if (lv < -10) return 0.0;
+		double u = (lv + 10) / 20;
+		return 4.0 * u * u * u / (20 * value * log(10.0));
+	}
 };
 
 ValueTransformation* createValueTransformation(string const& name, long seed)
@@ -398,8 +560,13 @@ public:
 
 	double evalSO(Vector const& x) const;
 	Vector evalMO(Vector const& x) const;
+	double evalSOWithGradient(Vector const& x, Vector& gradient) const;
+	void evalSOBatch(const double* points, size_t count, double* values) const;
 
 private:
+	// evalSO after the global point transformation
+	double evalTransformedSO(Vector& xx) const;
+
 	// component (inner function)
 	struct Component
 	{
@@ -408,6 +575,7 @@ private:
 		~Component();
 
 		double eval(Vector const& x) const;
+		double eval(Vector const& x, Vector& gradient) const;
 
 		unsigned int dimension;                     // input dimensionality of the component
 		PointTransformation* pointTransformation;   // can be nullptr
@@ -423,6 +591,7 @@ private:
 		~Objective();
 
 		double eval(Vector const& x) const;
+		double eval(Vector const& x, Vector& gradient) const;
 
 		ExpressionPtr function;                     // objective function
 		ValueTransformation* valueTransformation;   // can be nullptr
@@ -458,7 +627,7 @@ Problem1::Problem1(Json definition)
 				{
 					m_component.push_back(new Component());
 					m_component[i]->dimension = (unsigned int)jcomp[i]["dimension"].asNumber();
-					m_component[i]->function = getObjectiveFunction(jcomp[i]["function"].asString());
+					m_component[i]->function = getObjectiveFunction(jcomp[i]["function"].asString(), m_component[i]->dimension);
 					if (jcomp[i].has("inputTrans")) m_component[i]->pointTransformation = createPointTransformation(jcomp[i]["inputTrans"], curseed++, m_component[i]->dimension);
 				}
 				for (size_t i = 0; i < jcomp.size(); i++)
@@ -524,6 +693,43 @@ double Problem1::evalSO(Vector const& x) const
 	// global transformation
 	Vector xx = (m_globalPointTransformation) ? (*m_globalPointTransformation)(x) : x;
 
+	return evalTransformedSO(xx);
+}
+
+// The global transformation is applied to blocks of points at once.
+void Problem1::evalSOBatch(const double* points, size_t count, double* values) const
+{
+	assert(objectives() == 1);
+
+	size_t dim = dimension();
+	if (! m_globalPointTransformation)
+	{
+		for (size_t k = 0; k<count; k++)
+		{
+			ArenaScope scope;
+			Vector x(dim, points + k * dim);
+			values[k] = evalTransformedSO(x);
+		}
+		return;
+	}
+
+	const size_t block = 64;
+	std::vector<double> xx(std::min(count, block) * dim);
+	for (size_t start = 0; start<count; start += block)
+	{
+		size_t n = std::min(block, count - start);
+		m_globalPointTransformation->applyBatch(points + start * dim, n, dim, xx.data());
+		for (size_t k = 0; k<n; k++)
+		{
+			ArenaScope scope;
+			Vector x(dim, xx.data() + k * dim);
+			values[start + k] = evalTransformedSO(x);
+		}
+	}
+}
+
+double Problem1::evalTransformedSO(Vector& xx) const
+{
 	// component operations
 	Vector intermediate(m_component.size());
 	unsigned int start = 0;
@@ -545,6 +751,55 @@ double Problem1::evalSO(Vector const& x) const
 	return fx;
 }
 
+// The gradient is obtained by the chain rule from the gradients of the
+// components and the objective, computed by automatic differentiation.
+// Where the value is replaced by 1e99 the gradient is zero.
+double Problem1::evalSOWithGradient(Vector const& x, Vector& gradient) const
+{
+	assert(x.size() == dimension());
+	assert(objectives() == 1);
+
+	// global transformation
+	Vector xx = (m_globalPointTransformation) ? (*m_globalPointTransformation)(x) : x;
+
+	// component operations
+	Vector intermediate(m_component.size());
+	std::vector<Vector> cgrad(m_component.size());
+	unsigned int start = 0;
+	for (size_t i = 0; i<m_component.size(); i++)
+	{
+		unsigned int dim = m_component[i]->dimension;
+		intermediate[i] = m_component[i]->eval(xx.sub(start, start + dim), cgrad[i]);
+		start += dim;
+	}
+	assert(start == dimension());
+
+	// value operations
+	Vector ograd;
+	double fx = m_objective[0]->eval(intermediate, ograd);
+
+	// never return INF/NaN
+	if (!std::isfinite(fx))
+	{
+		gradient = Vector((size_t)dimension(), 0.0);
+		return 1e99;
+	}
+
+	// chain rule
+	Vector gxx((size_t)dimension());
+	start = 0;
+	for (size_t i = 0; i<m_component.size(); i++)
+	{
+		unsigned int dim = m_component[i]->dimension;
+		for (unsigned int j = 0; j<dim; j++) gxx[start + j] = ograd[i] * cgrad[i][j];
+		start += dim;
+	}
+	gradient = (m_globalPointTransformation) ? m_globalPointTransformation->transposedJacobian(x, gxx) : gxx;
+
+	// return objective value
+	return fx;
+}
+
 Vector Problem1::evalMO(Vector const& x) const
 {
 	assert(x.size() == dimension());
@@ -602,7 +857,7 @@ Problem1::Component::Component(Json definition, int& seed)
 	, valueTransformation(nullptr)
 {
 	dimension = (unsigned int)definition["dimension"].asNumber();
-	function = getObjectiveFunction(definition["function"].asString());
+	function = getObjectiveFunction(definition["function"].asString(), dimension);
 	if (definition.has("inputTrans")) pointTransformation = createPointTransformation(definition["inputTrans"], seed++, dimension);
 	if (definition.has("valueTrans")) valueTransformation = createValueTransformation(definition["valueTrans"], seed++);
 }
@@ -622,6 +877,18 @@ double Problem1::Component::eval(Vector const& x) const
 	return ret;
 }
 
+double Problem1::Component::eval(Vector const& x, Vector& gradient) const
+{
+	assert(x.size() == dimension);
+	Vector xx = (pointTransformation) ? (*pointTransformation)(x) : x;
+	Vector g;
+	double fx = evaluateWithGradient(function, xx, g);
+	double ret = (valueTransformation) ? (*valueTransformation)(fx) : fx;
+	if (valueTransformation) g *= valueTransformation->derivative(fx);
+	gradient = (pointTransformation) ? pointTransformation->transposedJacobian(x, g) : g;
+	return ret;
+}
+
 
 Problem1::Objective::Objective()
 	: valueTransformation(nullptr)
@@ -658,6 +925,26 @@ double Problem1::Objective::eval(Vector const& x) const
 	return (valueTransformation) ? (*valueTransformation)(fx) : fx;
 }
 
+double Problem1::Objective::eval(Vector const& x, Vector& gradient) const
+{
+	double fx;
+	if (function)
+	{
+		Vector xx(x);
+		for (size_t i = 0; i<xx.size(); i++)
+			xx[i] = xx[i] + 0.5;   // optimum at (1/2, ..., 1/2)
+		fx = evaluateWithGradient(function, xx, gradient);
+	}
+	else
+	{
+		assert(x.size() == 1);
+		fx = x[0];
+		gradient = Vector((size_t)1, 1.0);
+	}
+	if (valueTransformation) gradient *= valueTransformation->derivative(fx);
+	return (valueTransformation) ? (*valueTransformation)(fx) : fx;
+}
+
 
 ////////////////////////////////////////////////////////////
 
@@ -735,6 +1022,31 @@ public:
 		return ret;
 	}
 
+	// The feature map and the rotations of the objectives are applied
+	// to blocks of points as matrix products.
+	void evalMOBatch(const double* points, size_t count, double* values) const
+	{
+		assert(m_mo.size() == m_objectives);
+		const size_t block = 64;
+		std::vector<double> f(std::min(count, block)), g(f.size());
+		for (size_t start = 0; start<count; start += block)
+		{
+			size_t n = std::min(block, count - start);
+			Matrix T = m_featuremap(Matrix(n, m_dimension, points + start * m_dimension));
+			m_so(T, 0, f.data());
+			for (unsigned int j = 0; j<m_objectives; j++)
+			{
+				m_mo[j](T, m_cooperative, g.data());
+				for (size_t k = 0; k<n; k++)
+				{
+					double v = pow(squash(f[k] + g[k]), m_shaping);
+					if (v < 0.0 || v > 1.0 || !std::isfinite(v)) v = 1.0;
+					values[(start + k) * m_objectives + j] = v;
+				}
+			}
+		}
+	}
+
 private:
 	// squashing function [-\infty, \infty] \to [0, 1]
 	static double sigmoid(double t)
@@ -802,25 +1114,30 @@ private:
 		// evaluate the distortion function
 		Vector operator () (Vector const& x) const
 		{
-			double f = 0.0;
+			return factor(x) * v;
+		}
+
+		// factor of the output vector at x
+		double factor(Vector const& x) const
+		{
+			if (type == bump) return exp((x - m).twonorm2() / (-2.0 * s * s));
+			else return shape(m * x);
+		}
+
+		// factor of wave, ramp, and cliff as a function of the projection m * x
+		double shape(double t) const
+		{
 			switch (type)
 			{
 			case wave:
-				f = cos(m * x + s);
-				break;
-			case bump:
-				f = exp((x - m).twonorm2() / (-2.0 * s * s));
-				break;
+				return cos(t + s);
 			case ramp:
-				f = sigmoid(m * x + s);
-				break;
+				return sigmoid(t + s);
 			case cliff:
-				f = (m * x + s >= 0.0) ? 1.0 : 0.0;
-				break;
+				return (t + s >= 0.0) ? 1.0 : 0.0;
 			default:
 				throw runtime_error("[Distortion] unknown type");
 			}
-			return f * v;
 		}
 
 		enum Type
@@ -853,6 +1170,17 @@ private:
 			nonlinear.resize(n);
 			for (size_t i = 0; i<n; i++) nonlinear[i] = Distortion(rng, dimension);
 
+			// stacked parameters of the distortions
+			V = Matrix(n, dimension);
+			for (size_t i = 0; i<n; i++)
+			{
+				V.row(i) = nonlinear[i].v;
+				if (nonlinear[i].type != Distortion::bump) projected.push_back(i);
+			}
+			M = Matrix(projected.size(), dimension);
+			for (size_t r = 0; r<projected.size(); r++) M.row(r) = nonlinear[projected[r]].m;
+			Mt = M.transpose();
+
 			// compensate for distortions in the first #cooperative components at the given points
 			size_t m = points.size();
 			if (cooperative > 0)
@@ -868,18 +1196,71 @@ private:
 				Matrix A = (X.inverse() * F).transpose();
 				B -= A;
 			}
+			Bt = B.transpose();
 		}
 
-		// evaluate the feature map
+		// Evaluate the feature map
+		//     B x + sum_i f_i(x) v_i
+		// as B x plus the product of the stacked output vectors with the
+		// factors f_i. The result accumulates the terms in the order of
+		// the distortions, as the sum of the individual distortions. In
+		// OrderedSummation mode the projections m * x of all distortions
+		// but bumps are a single matrix product as well, otherwise they
+		// are dot products subject to the summation mode.
 		Vector operator () (Vector const& x) const
 		{
 			Vector ret = B * x;
-			for (unsigned int i = 0; i<nonlinear.size(); i++) ret += nonlinear[i](x);
+			size_t n = nonlinear.size();
+			if (n == 0) return ret;
+			Vector f(n);
+			if (summationMode() == OrderedSummation)
+			{
+				Vector t = M * x;
+				for (size_t r = 0; r<projected.size(); r++) f[projected[r]] = nonlinear[projected[r]].shape(t[r]);
+				for (size_t i = 0; i<n; i++) if (nonlinear[i].type == Distortion::bump) f[i] = nonlinear[i].factor(x);
+			}
+			else
+			{
+				for (size_t i = 0; i<n; i++) f[i] = nonlinear[i].factor(x);
+			}
+			kernelGemv(ret.data(), V.data(), V.cols(), f.data(), V.cols(), n);
+			return ret;
+		}
+
+		// evaluate the feature map at the rows of X, with matrix products
+		// in place of the above matrix-vector products
+		Matrix operator () (Matrix const& X) const
+		{
+			Matrix ret = X * Bt;
+			size_t n = nonlinear.size(), count = X.rows();
+			if (n == 0 || count == 0) return ret;
+			Matrix F(count, n);
+			if (summationMode() == OrderedSummation)
+			{
+				Matrix T = X * Mt;
+				for (size_t k = 0; k<count; k++)
+					for (size_t r = 0; r<projected.size(); r++) F(k, projected[r]) = nonlinear[projected[r]].shape(T(k, r));
+			}
+			for (size_t k = 0; k<count; k++)
+			{
+				ArenaScope scope;
+				Vector x = X.row(k);
+				for (size_t i = 0; i<n; i++)
+				{
+					if (nonlinear[i].type == Distortion::bump || summationMode() != OrderedSummation) F(k, i) = nonlinear[i].factor(x);
+				}
+			}
+			kernelGemm(ret.data(), ret.cols(), V.data(), V.cols(), F.data(), n, V.cols(), n, count);
 			return ret;
 		}
 
 		Matrix B;                        // linear transformation
+		Matrix Bt;                       // transpose of B
 		vector<Distortion> nonlinear;    // non-linear distortions
+		Matrix V;                        // output vectors of the distortions, one per row
+		Matrix M;                        // input vectors of the projected distortions, one per row
+		Matrix Mt;                       // transpose of M
+		vector<size_t> projected;        // indices of the distortions depending on m * x (all but bumps)
 	};
 
 	struct TransformedObjective
@@ -889,7 +1270,7 @@ private:
 
 		TransformedObjective(RNG& rng, Vector const& opt, Json definition)
 			: optimum(opt)
-			, function(getObjectiveFunction(definition["function"].asString()))
+			, function(getObjectiveFunction(definition["function"].asString(), opt.size()))
 			, scaling(definition["scaling"].asNumber())
 		{
 			if (!function) throw runtime_error("[Problem2MO::TransformedObjective] unknown function");
@@ -901,6 +1282,7 @@ private:
 				if (r == "none") rotation = Matrix::identity(dimension);
 				else if (r == "random") rotation = rng.orthogonalMatrix(dimension);
 				else throw runtime_error("[Problem2MO::TransformedObjective] invalid rotation type");
+				rotationT = rotation.transpose();
 			}
 		}
 
@@ -910,8 +1292,26 @@ private:
 			else return scaling * evaluate(function, rotation * (x - optimum));
 		}
 
+		// values at the rows of X, restricted to the columns starting at begin
+		void operator () (Matrix const& X, size_t begin, double* values) const
+		{
+			size_t n = X.rows(), dim = optimum.size();
+			if (dim == 0)
+			{
+				std::fill(values, values + n, 0.0);
+				return;
+			}
+			Matrix D(n, dim);
+			for (size_t k = 0; k<n; k++)
+				for (size_t i = 0; i<dim; i++) D(k, i) = X(k, begin + i) - optimum[i];
+			Matrix Y = D * rotationT;
+			evaluateBatch(function, dim, Y.data(), n, values);
+			for (size_t k = 0; k<n; k++) values[k] = scaling * values[k];
+		}
+
 		Vector optimum;                 // optimal input
 		Matrix rotation;                // rotation of the input vector
+		Matrix rotationT;               // transpose of the rotation
 		ExpressionPtr function;         // actual objective function
 		double scaling;                 // scaling of the output value
 	};
@@ -940,3 +1340,91 @@ Problem* createProblem(Json definition)
 	else if (cls == "Problem2MO") return new Problem2MO(definition);
 	else throw runtime_error("[createProblem] unknown problem class '" + cls + "'");
 }
+
+// Append an unambiguous serialization of a Json value to key. Numbers
+// are written with 17 significant digits, which identifies doubles
+// exactly, and strings are prefixed with their length. Undefined object
+// members (created by lookups of missing keys) are skipped.
+void appendProblemKey(Json const& json, string& key)
+{
+	if (json.isNull()) key += 'n';
+	else if (json.isBoolean()) key += json.asBoolean() ? 't' : 'f';
+	else if (json.isNumber())
+	{
+		char buffer[32];
+		snprintf(buffer, sizeof(buffer), "%.17g,", json.asNumber());
+		key += buffer;
+	}
+	else if (json.isString())
+	{
+		string str = json.asString();
+		key += 's' + to_string(str.size()) + ':' + str;
+	}
+	else if (json.isArray())
+	{
+		key += '[';
+		for (size_t i=0; i<json.size(); i++) appendProblemKey(json[i], key);
+		key += ']';
+	}
+	else if (json.isObject())
+	{
+		key += '{';
+		for (Json::const_object_iterator it = json.object_begin(); it != json.object_end(); ++it)
+		{
+			if (it->second.isUndefined()) continue;
+			key += 's' + to_string(it->first.size()) + ':' + it->first;
+			appendProblemKey(it->second, key);
+		}
+		key += '}';
+	}
+}
+
+// least recently used problems at the back of the list
+typedef std::list< std::pair<std::string, std::shared_ptr<const Problem> > > ProblemCacheList;
+ProblemCacheList problemCacheList;
+std::map<std::string, ProblemCacheList::iterator> problemCache;
+std::mutex problemCacheMutex;
+
+std::shared_ptr<const Problem> getProblem(Json definition)
+{
+	string key;
+	appendProblemKey(definition, key);
+	key += '|' + to_string((int)summationMode()) + ',' + to_string((int)mathMode());
+
+	{
+		std::lock_guard<std::mutex> lock(problemCacheMutex);
+		std::map<std::string, ProblemCacheList::iterator>::iterator it = problemCache.find(key);
+		if (it != problemCache.end())
+		{
+			problemCacheList.splice(problemCacheList.begin(), problemCacheList, it->second);
+			return it->second->second;
+		}
+	}
+
+	// construct outside of the lock, errors are not cached
+	std::shared_ptr<const Problem> problem(createProblem(definition));
+
+	std::lock_guard<std::mutex> lock(problemCacheMutex);
+	std::map<std::string, ProblemCacheList::iterator>::iterator it = problemCache.find(key);
+	if (it != problemCache.end())
+	{
+		// constructed concurrently by another thread
+		problemCacheList.splice(problemCacheList.begin(), problemCacheList, it->second);
+		return it->second->second;
+	}
+	problemCacheList.push_front(std::make_pair(key, problem));
+	problemCache[key] = problemCacheList.begin();
+	if (problemCacheList.size() > problemCacheCapacity)
+	{
+		problemCache.erase(problemCacheList.back().first);
+		problemCacheList.pop_back();
+	}
+	return problem;
+}
+
+void clearProblemCache()
+{
+	std::lock_guard<std::mutex> lock(problemCacheMutex);
+	problemCache.clear();
+	problemCacheList.clear();
+}
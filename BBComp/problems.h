@@ -3,6 +3,8 @@
 
 #include <string>
 #include <map>
+#include <stdexcept>
+#include <memory>
 
 #include "json.h"
 #include "vector.h"
@@ -28,6 +30,33 @@ public:
 	virtual double evalSO(Vector const& x) const = 0;
 	virtual Vector evalMO(Vector const& x) const = 0;
 
+	// values of a single-objective problem at count points, stored
+	// row-major, identical to those of evalSO
+	virtual void evalSOBatch(const double* points, std::size_t count, double* values) const
+	{
+		for (std::size_t k=0; k<count; k++)
+		{
+			ArenaScope scope;
+			values[k] = evalSO(Vector(m_dimension, points + k * m_dimension));
+		}
+	}
+
+	// values of a multi-objective problem at count points, stored
+	// row-major, written row-major, identical to those of evalMO
+	virtual void evalMOBatch(const double* points, std::size_t count, double* values) const
+	{
+		for (std::size_t k=0; k<count; k++)
+		{
+			ArenaScope scope;
+			Vector v = evalMO(Vector(m_dimension, points + k * m_dimension));
+			for (std::size_t i=0; i<m_objectives; i++) values[k * m_objectives + i] = v[i];
+		}
+	}
+
+	// value and gradient of a single-objective problem
+	virtual double evalSOWithGradient(Vector const& x, Vector& gradient) const
+	{ throw std::runtime_error("[Problem::evalSOWithGradient] gradients are not available for this problem class"); }
+
 protected:
 	unsigned int m_dimension;
 	unsigned int m_objectives;
@@ -44,3 +73,18 @@ void compileFunctions(Json dict);
 // corresponding constructors directly. This allows for extending the
 // set of Problem subclasses in a transparent manner.
 Problem* createProblem(Json definition);
+
+
+// Shared problem objects, cached by content: the key is an exact
+// serialization of the definition (including seeds and parameters) and
+// the current summation and math modes, which determine the
+// specializations of the objective functions. Requesting a previously
+// seen problem hence returns the existing object without repeating the
+// construction (random rotations, orthogonal matrices, inverses). The
+// objects are immutable and can be evaluated concurrently. The cache
+// holds the problemCacheCapacity most recently requested problems.
+const std::size_t problemCacheCapacity = 1024;
+std::shared_ptr<const Problem> getProblem(Json definition);
+
+// Drop all cached problems; objects still in use remain valid.
+void clearProblemCache();
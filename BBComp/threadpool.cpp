@@ -0,0 +1,149 @@
+
+#include "threadpool.h"
+
+#include <algorithm>
+#include <cmath>
+
+
+using namespace std;
+
+
+ThreadPool::ThreadPool(unsigned int threads)
+: m_queue(std::max(threads, 1u))
+, m_generation(0)
+, m_stop(false)
+, m_pending(0)
+{
+	for (unsigned int i=1; i<m_queue.size(); i++) m_thread.push_back(thread(&ThreadPool::loop, this, i));
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		lock_guard<mutex> lock(m_mutex);
+		m_stop = true;
+	}
+	m_wakeup.notify_all();
+	for (size_t i=0; i<m_thread.size(); i++) m_thread[i].join();
+}
+
+size_t ThreadPool::chunkSize(size_t n, double cost) const
+{
+	const double target = 1e-4;
+	size_t chunk = (cost > 0.0) ? (size_t)std::ceil(target / cost) : n;
+	size_t balance = n / (4 * threads());
+	return std::max<size_t>(1, std::min(chunk, balance));
+}
+
+void ThreadPool::parallelFor(size_t n, size_t chunk, Task const& task)
+{
+	if (n == 0) return;
+	if (chunk == 0) chunk = 1;
+	if (threads() == 1 || chunk >= n)
+	{
+		task(0, n);
+		return;
+	}
+
+	lock_guard<mutex> job(m_job);
+	m_exception = exception_ptr();
+
+	// distribute contiguous blocks of chunks over the queues
+	size_t chunks = (n + chunk - 1) / chunk;
+	m_pending = chunks;
+	for (unsigned int q=0; q<threads(); q++)
+	{
+		size_t first = chunks * q / threads();
+		size_t last = chunks * (q + 1) / threads();
+		lock_guard<mutex> lock(m_queue[q].mutex);
+		for (size_t c=first; c<last; c++)
+		{
+			Chunk ch;
+			ch.begin = c * chunk;
+			ch.end = std::min(n, ch.begin + chunk);
+			ch.task = &task;
+			m_queue[q].chunks.push_back(ch);
+		}
+	}
+
+	// wake up the workers and participate
+	{
+		lock_guard<mutex> lock(m_mutex);
+		m_generation++;
+	}
+	m_wakeup.notify_all();
+	work(0);
+
+	// wait for chunks stolen by other threads
+	{
+		unique_lock<mutex> lock(m_mutex);
+		m_done.wait(lock, [this] { return m_pending == 0; });
+	}
+	if (m_exception) rethrow_exception(m_exception);
+}
+
+void ThreadPool::loop(unsigned int index)
+{
+	size_t seen = 0;
+	while (true)
+	{
+		{
+			unique_lock<mutex> lock(m_mutex);
+			m_wakeup.wait(lock, [this, seen] { return m_stop || m_generation != seen; });
+			if (m_stop) return;
+			seen = m_generation;
+		}
+		work(index);
+	}
+}
+
+void ThreadPool::work(unsigned int index)
+{
+	Chunk chunk;
+	while (take(index, chunk))
+	{
+		try
+		{
+			(*chunk.task)(chunk.begin, chunk.end);
+		}
+		catch (...)
+		{
+			lock_guard<mutex> lock(m_mutex);
+			if (! m_exception) m_exception = current_exception();
+		}
+		if (--m_pending == 0)
+		{
+			lock_guard<mutex> lock(m_mutex);
+			m_done.notify_all();
+		}
+	}
+}
+
+bool ThreadPool::take(unsigned int index, Chunk& chunk)
+{
+	// own queue first, from the front
+	{
+		Queue& q = m_queue[index];
+		lock_guard<mutex> lock(q.mutex);
+		if (! q.chunks.empty())
+		{
+			chunk = q.chunks.front();
+			q.chunks.pop_front();
+			return true;
+		}
+	}
+
+	// steal from the back of the other queues
+	for (unsigned int i=1; i<threads(); i++)
+	{
+		Queue& q = m_queue[(index + i) % threads()];
+		lock_guard<mutex> lock(q.mutex);
+		if (! q.chunks.empty())
+		{
+			chunk = q.chunks.back();
+			q.chunks.pop_back();
+			return true;
+		}
+	}
+	return false;
+}
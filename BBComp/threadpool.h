@@ -0,0 +1,76 @@
+
+#pragma once
+
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <exception>
+#include <functional>
+#include <cstddef>
+
+
+//
+// Work-stealing thread pool for data-parallel loops.
+//
+// A loop over [0, n) is cut into chunks. Each participating thread
+// (the workers and the calling thread) initially receives a contiguous
+// block of chunks in its own queue. It processes its queue from the
+// front and, once it runs dry, steals chunks from the back of the
+// other queues. Chunk sizes are chosen from the measured cost per loop
+// iteration, such that cheap iterations are grouped into large chunks
+// while expensive iterations are distributed individually.
+//
+class ThreadPool
+{
+public:
+	typedef std::function<void(std::size_t, std::size_t)> Task;
+
+	// #threads includes the calling thread
+	explicit ThreadPool(unsigned int threads);
+	~ThreadPool();
+
+	unsigned int threads() const
+	{ return (unsigned int)m_queue.size(); }
+
+	// Chunk size for n iterations with given cost per iteration (in
+	// seconds), aiming at about 100 microseconds per chunk and at least
+	// four chunks per thread.
+	std::size_t chunkSize(std::size_t n, double cost) const;
+
+	// Call task(begin, end) for chunks covering [0, n), block until all
+	// chunks are done. The first exception thrown by a task is re-thrown.
+	void parallelFor(std::size_t n, std::size_t chunk, Task const& task);
+
+private:
+	struct Chunk
+	{
+		std::size_t begin;
+		std::size_t end;
+		Task const* task;
+	};
+
+	struct Queue
+	{
+		std::mutex mutex;
+		std::deque<Chunk> chunks;
+	};
+
+	void loop(unsigned int index);
+	void work(unsigned int index);
+	bool take(unsigned int index, Chunk& chunk);
+
+	std::vector<Queue> m_queue;              // one queue per thread, index 0 is the calling thread
+	std::vector<std::thread> m_thread;
+	std::mutex m_job;                        // one loop at a time
+	std::mutex m_mutex;                      // protects generation, stop, and exception
+	std::condition_variable m_wakeup;
+	std::condition_variable m_done;
+	std::size_t m_generation;
+	bool m_stop;
+	std::atomic<std::size_t> m_pending;      // chunks not yet completed
+	std::exception_ptr m_exception;
+};
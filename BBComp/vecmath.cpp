@@ -0,0 +1,625 @@
+
+#include "vecmath.h"
+#include "kernels.h"
+
+#include <cmath>
+#include <cstring>
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define VECMATH_X86
+#endif
+
+// vector types are passed only between inlined functions
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic ignored "-Wpsabi"
+#endif
+
+
+using namespace std;
+
+
+namespace {
+
+
+MathMode g_math = LibraryMath;
+
+
+////////////////////////////////////////////////////////////
+// packs of doubles
+//
+// The approximations are written once, as templates over a pack T of
+// doubles: either double itself, or a GCC vector of four or eight
+// doubles. Vector operators act lane by lane with IEEE semantics, hence
+// all instantiations yield identical results. The vector instantiations
+// are inlined into functions compiled for AVX2 and AVX-512.
+//
+
+typedef double Double4 __attribute__((vector_size(32)));
+typedef long long Int4 __attribute__((vector_size(32)));
+typedef double Double8 __attribute__((vector_size(64)));
+typedef long long Int8 __attribute__((vector_size(64)));
+
+template <class T> struct Pack;
+template <> struct Pack<double> { typedef long long Int; static const size_t lanes = 1; };
+template <> struct Pack<Double4> { typedef Int4 Int; static const size_t lanes = 4; };
+template <> struct Pack<Double8> { typedef Int8 Int; static const size_t lanes = 8; };
+
+#define INLINE inline __attribute__((always_inline))
+
+template <class T> INLINE T splat(double value)
+{
+	double v[Pack<T>::lanes];
+	for (size_t l=0; l<Pack<T>::lanes; l++) v[l] = value;
+	T ret;
+	memcpy(&ret, v, sizeof(ret));
+	return ret;
+}
+
+template <class T> INLINE typename Pack<T>::Int asInt(T const& x)
+{
+	typename Pack<T>::Int ret;
+	memcpy(&ret, &x, sizeof(ret));
+	return ret;
+}
+
+template <class T> INLINE T asDouble(typename Pack<T>::Int const& x)
+{
+	T ret;
+	memcpy(&ret, &x, sizeof(ret));
+	return ret;
+}
+
+template <class T> INLINE T fabsPack(T const& x)
+{ return asDouble<T>(asInt(x) & 0x7fffffffffffffffLL); }
+
+// round to the nearest integer (ties to even), for |x| < 2^51
+const double shifter = 6755399441055744.0;   // 1.5 * 2^52
+template <class T> INLINE T roundInt(T const& x)
+{ return (x + shifter) - shifter; }
+
+// 2^k for integral k in [-1022, 1023]
+template <class T> INLINE T pow2(T const& k)
+{ return asDouble<T>((asInt(k + (shifter + 1023.0)) & 0x7ff) << 52); }
+
+// error-free transformations
+template <class T> INLINE void twoSum(T const& a, T const& b, T& s, T& e)
+{
+	s = a + b;
+	T bb = s - a;
+	e = (a - (s - bb)) + (b - bb);
+}
+
+template <class T> INLINE void fastTwoSum(T const& a, T const& b, T& s, T& e)   // |a| >= |b|
+{
+	s = a + b;
+	e = b - (s - a);
+}
+
+template <class T> INLINE void split(T const& a, T& hi, T& lo)
+{
+	T c = 134217729.0 * a;   // 2^27 + 1
+	hi = c - (c - a);
+	lo = a - hi;
+}
+
+template <class T> INLINE void twoProduct(T const& a, T const& b, T& p, T& e)
+{
+	p = a * b;
+	T ah, al, bh, bl;
+	split(a, ah, al);
+	split(b, bh, bl);
+	e = (((ah * bh - p) + ah * bl) + al * bh) + al * bl;
+}
+
+
+////////////////////////////////////////////////////////////
+// sin and cos
+//
+// Cody-Waite reduction modulo pi/2 with three parts, good to about
+// 150 bits for |x| < 1e6, followed by the kernels of fdlibm.
+//
+
+const double invPio2 = 6.36619772367581382433e-01;
+const double pio2_1 = 1.57079632673412561417e+00;     // first 33 bits of pi/2
+const double pio2_2 = 6.07710050630396597660e-11;     // second 33 bits of pi/2
+const double pio2_2t = 2.02226624879595063154e-21;    // pi/2 - (pio2_1 + pio2_2)
+const double pio2_3 = 2.02226624871116645580e-21;     // third 33 bits of pi/2
+const double pio2_3t = 8.47842766036889956997e-32;    // pi/2 - (pio2_1 + pio2_2 + pio2_3)
+
+const double S1 = -1.66666666666666324348e-01;
+const double S2 = 8.33333333332248946124e-03;
+const double S3 = -1.98412698298579493134e-04;
+const double S4 = 2.75573137070700676789e-06;
+const double S5 = -2.50507602534068634195e-08;
+const double S6 = 1.58969099521155010221e-10;
+
+const double C1 = 4.16666666666666019037e-02;
+const double C2 = -1.38888888888741095749e-03;
+const double C3 = 2.48015872894767294178e-05;
+const double C4 = -2.75573143513906633035e-07;
+const double C5 = 2.08757232129817482790e-09;
+const double C6 = -1.13596475577881948265e-11;
+
+// sin(x + y) for |x + y| <= pi/4
+template <class T> INLINE T sinKernel(T const& x, T const& y)
+{
+	T z = x * x;
+	T v = z * x;
+	T r = S2 + z * (S3 + z * (S4 + z * (S5 + z * S6)));
+	return x - ((z * (0.5 * y - v * r) - y) - v * S1);
+}
+
+// cos(x + y) for |x + y| <= pi/4
+template <class T> INLINE T cosKernel(T const& x, T const& y)
+{
+	T z = x * x;
+	T w = z * z;
+	T r = z * (C1 + z * (C2 + z * C3)) + w * w * (C4 + z * (C5 + z * C6));
+	T hz = 0.5 * z;
+	w = 1.0 - hz;
+	return w + (((1.0 - w) - hz) + (z * r - x * y));
+}
+
+template <class T, bool COSINE> INLINE T sinCos(T const& x)
+{
+	// x = n pi/2 + y0 + y1
+	T n = roundInt(x * invPio2);
+	T r = x - n * pio2_1;
+	T t = r;
+	T w = n * pio2_2;
+	r = t - w;
+	w = n * pio2_2t - ((t - r) - w);
+	t = r;
+	w = n * pio2_3;
+	r = t - w;
+	w = n * pio2_3t - ((t - r) - w);
+	T y0 = r - w;
+	T y1 = (r - y0) - w;
+
+	// quadrant, cos(x) = sin(x + pi/2); all selections use a single
+	// comparison, since combined masks are not vectorized well
+	if (COSINE) n = n + 1.0;
+	T q = n - 4.0 * roundInt(n * 0.25 - 0.375);
+	T odd = q - 2.0 * roundInt(q * 0.5 - 0.25);
+	T ret = (odd == 1.0) ? cosKernel(y0, y1) : sinKernel(y0, y1);
+	ret = (q >= 2.0) ? -ret : ret;
+	return (fabsPack(x) < 1e6) ? ret : splat<T>(NAN);
+}
+
+
+////////////////////////////////////////////////////////////
+// exp
+//
+// Reduction x = k ln(2) + r with |r| <= ln(2)/2, followed by the
+// rational approximation of fdlibm. The argument is given as x + xl
+// with a small tail xl, which is used by pow.
+//
+
+const double invLn2 = 1.44269504088896338700e+00;
+const double ln2Hi = 6.93147180369123816490e-01;      // 32 bits
+const double ln2Lo = 1.90821492927058770002e-10;      // ln(2) - ln2Hi
+const double expMax = 708.39;                         // DBL_MIN < exp(x) < DBL_MAX for |x| <= expMax
+
+const double P1 = 1.66666666666666019037e-01;
+const double P2 = -2.77777777770155933842e-03;
+const double P3 = 6.61375632143793436117e-05;
+const double P4 = -1.65339022054652515390e-06;
+const double P5 = 4.13813679705723846039e-08;
+
+template <class T> INLINE T expTail(T const& x, T const& xl)
+{
+	T k = roundInt(x * invLn2);
+	T hi = x - k * ln2Hi;
+	T lo = k * ln2Lo - xl;
+	T r = hi - lo;
+	T t = r * r;
+	T c = r - t * (P1 + t * (P2 + t * (P3 + t * (P4 + t * P5))));
+	T y = 1.0 - ((lo - (r * c) / (2.0 - c)) - hi);
+
+	// scale by 2^k in two steps, since 2^1024 is not representable
+	T k1 = roundInt(k * 0.5 - 0.25);
+	T k2 = k - k1;
+	y = (y * pow2(k1)) * pow2(k2);
+	return (fabsPack(x) <= expMax) ? y : splat<T>(NAN);
+}
+
+template <class T> INLINE T expPack(T const& x)
+{ return expTail(x, splat<T>(0.0)); }
+
+
+////////////////////////////////////////////////////////////
+// log
+//
+// x = 2^k z with z in [0.6875, 1.375). The interval is split into 64
+// sub-intervals, each with a pivot c. Then log(x) = k ln(2) - log(1/c)
+// + log(1 + r) with r = z/c - 1, where |r| < 1/64 is computed exactly as
+// z (1/c) - 1 in double-double arithmetic. The result is returned as a
+// double-double with a relative accuracy of about 2^-70, which is
+// required by pow.
+//
+
+struct LogEntry
+{
+	double invc;         // 1/c
+	double logcHi;       // log(c) = logcHi + logcLo
+	double logcLo;
+};
+
+// the sub-intervals around z = 1 use c = 1
+const LogEntry logTable[64] = {
+	{ 1.4463276836158192, -0.3690277119057333, -2.7679235568403196e-17 },
+	{ 1.4301675977653632, -0.35779163863880753, 1.857394315781863e-17 },
+	{ 1.4143646408839778, -0.34668041321373666, -2.67824200913148e-17 },
+	{ 1.3989071038251366, -0.33569129163814154, 8.051134758369686e-18 },
+	{ 1.3837837837837839, -0.3248216194012377, 3.716255662863595e-18 },
+	{ 1.3689839572192513, -0.3140688276249758, -4.708988771113312e-18 },
+	{ 1.3544973544973544, -0.30343042941992004, 4.1512585401039935e-18 },
+	{ 1.3403141361256545, -0.2929040164329327, 1.57672734596757e-17 },
+	{ 1.3264248704663213, -0.28248725557467697, 4.5622709592656976e-18 },
+	{ 1.3128205128205128, -0.27217788591581565, -1.859318262481925e-17 },
+	{ 1.299492385786802, -0.2619737157415739, 1.878144810277299e-17 },
+	{ 1.2864321608040201, -0.2518726197550701, -1.2846709260565683e-17 },
+	{ 1.2736318407960199, -0.2418725364204867, -5.086688062206503e-18 },
+	{ 1.2610837438423645, -0.23197146543777517, 1.0705552511300431e-17 },
+	{ 1.248780487804878, -0.2221674653411543, 1.1664564654755913e-17 },
+	{ 1.2367149758454106, -0.21245865121419336, 1.8248974208288598e-18 },
+	{ 1.2248803827751196, -0.20284319251475144, 9.177560001701116e-18 },
+	{ 1.2132701421800949, -0.19331931100349606, 2.3084535888000873e-18 },
+	{ 1.2018779342723005, -0.18388527877013738, -1.51192377141417e-18 },
+	{ 1.1906976744186046, -0.17453941635189965, -1.2294483916404324e-17 },
+	{ 1.1797235023041475, -0.16528009093910292, 1.4935930931804023e-18 },
+	{ 1.1689497716894977, -0.1561057146630616, 1.2806970330932863e-17 },
+	{ 1.158371040723982, -0.14701474296180975, -1.6045849809178003e-18 },
+	{ 1.147982062780269, -0.1380056730194437, -9.927673066865803e-18 },
+	{ 1.1377777777777778, -0.12907704227514236, 1.380833506137427e-17 },
+	{ 1.1277533039647578, -0.12022742699815989, -6.703429385028035e-18 },
+	{ 1.1179039301310043, -0.11145544092532278, 4.722382936838005e-18 },
+	{ 1.1082251082251082, -0.10275973395776894, 5.5749926045490845e-18 },
+	{ 1.0987124463519313, -0.09413899091386191, 1.9720664099579867e-18 },
+	{ 1.0893617021276596, -0.08559193033540353, 4.505830273858094e-18 },
+	{ 1.080168776371308, -0.0771173033444312, -1.6980741255382134e-18 },
+	{ 1.0711297071129706, -0.06871389254805173, 5.131966502090055e-18 },
+	{ 1.062240663900415, -0.06038051098890748, 1.2896019993525642e-18 },
+	{ 1.0534979423868314, -0.0521160011390141, -2.445091174292264e-18 },
+	{ 1.0448979591836736, -0.04391923393483558, -1.7623552700046253e-18 },
+	{ 1.0364372469635628, -0.03578910785158529, -7.2846227792942925e-19 },
+	{ 1.0281124497991967, -0.02772454801485477, -1.6936634670586275e-19 },
+	{ 1.0199203187250996, -0.019724505347778573, 1.3445979863167513e-18 },
+	{ 1.0118577075098814, -0.011787955752042173, -2.208154666796599e-19 },
+	{ 1.0, 0.0, 0.0 },
+	{ 1.0, 0.0, 0.0 },
+	{ 0.9770992366412213, 0.023167059281534418, -3.095927552179262e-19 },
+	{ 0.9624060150375939, 0.03831886430213666, -2.3579961573512846e-18 },
+	{ 0.9481481481481482, 0.05324451451881224, 1.803871134979952e-18 },
+	{ 0.9343065693430657, 0.06795066190850778, 3.9239563038692484e-18 },
+	{ 0.920863309352518, 0.08244366921107454, -4.707903082046854e-18 },
+	{ 0.9078014184397163, 0.09672962645855114, -4.0291867005826106e-18 },
+	{ 0.8951048951048951, 0.11081436634029011, 2.0511100808140527e-18 },
+	{ 0.8827586206896552, 0.12470347850095725, -4.6522609636496624e-18 },
+	{ 0.8707482993197279, 0.1384023228591192, -1.3766819196398948e-17 },
+	{ 0.8590604026845637, 0.151916042025842, 4.1233095848339465e-19 },
+	{ 0.847682119205298, 0.16524957289530717, -9.227573884334224e-18 },
+	{ 0.8366013071895425, 0.17840765747281825, 1.2720936612962572e-17 },
+	{ 0.8258064516129032, 0.19139485299962947, -1.126213516780448e-17 },
+	{ 0.8152866242038217, 0.20421554142869083, 7.9379985298027e-18 },
+	{ 0.8050314465408805, 0.2168739383006143, 6.285749669211092e-18 },
+	{ 0.7950310559006211, 0.2293741010648459, -5.684839459813236e-18 },
+	{ 0.7852760736196319, 0.24171993688714513, 1.323779871210866e-17 },
+	{ 0.7757575757575758, 0.25391520998096345, -7.180735656435798e-18 },
+	{ 0.7664670658682635, 0.2659635484971379, 1.35209848201012e-19 },
+	{ 0.757396449704142, 0.2778684510034563, 2.2502748630777633e-17 },
+	{ 0.7485380116959064, 0.2896332925830427, 2.0535953219858177e-17 },
+	{ 0.7398843930635838, 0.30126133057816185, -1.5120043309967385e-17 },
+	{ 0.7314285714285714, 0.3127557100038969, -1.3650721793001109e-17 }
+};
+
+INLINE void lookup(long long index, double& invc, double& logcHi, double& logcLo)
+{
+	invc = logTable[index].invc;
+	logcHi = logTable[index].logcHi;
+	logcLo = logTable[index].logcLo;
+}
+
+template <class T> INLINE void lookup(typename Pack<T>::Int const& index, T& invc, T& logcHi, T& logcLo)
+{
+	const size_t L = Pack<T>::lanes;
+	long long i[L];
+	memcpy(i, &index, sizeof(i));
+	double a[L], b[L], c[L];
+	for (size_t l=0; l<L; l++)
+	{
+		LogEntry const& e = logTable[i[l]];
+		a[l] = e.invc;
+		b[l] = e.logcHi;
+		c[l] = e.logcLo;
+	}
+	memcpy(&invc, a, sizeof(a));
+	memcpy(&logcHi, b, sizeof(b));
+	memcpy(&logcLo, c, sizeof(c));
+}
+
+template <class T> INLINE T logTail(T const& x, T& tail)
+{
+	typedef typename Pack<T>::Int Int;
+
+	Int ix = asInt(x);
+	Int tmp = ix - 0x3fe6000000000000LL;
+	Int k = tmp >> 52;
+	T z = asDouble<T>(ix - (tmp & ~0xfffffffffffffLL));
+	T kd = asDouble<T>(k + asInt(shifter)) - shifter;
+	T invc, logcHi, logcLo;
+	lookup((tmp >> 46) & 63, invc, logcHi, logcLo);
+
+	// r + rl = z invc - 1
+	T p, pe;
+	twoProduct(z, invc, p, pe);
+	T r, rl;
+	twoSum(p - 1.0, pe, r, rl);
+
+	// log(1 + r) = r - r^2/2 + r^3 (1/3 - r/4 + r^2/5 - ...)
+	T q, qe;
+	twoProduct(r, r, q, qe);
+	T h = 0.5 * q;
+	T he = 0.5 * qe + r * rl;
+	T poly = (r * q) * (1.0/3 - r * (1.0/4 - r * (1.0/5 - r * (1.0/6 - r * (1.0/7 - r * (1.0/8 - r * (1.0/9 - r * (1.0/10 - r * (1.0/11 - r * (1.0/12))))))))));
+
+	T s1, e1, s2, e2, s3, e3;
+	twoSum(kd * ln2Hi, logcHi, s1, e1);
+	twoSum(s1, r, s2, e2);
+	twoSum(s2, -h, s3, e3);
+	T lo = (((e1 + e2) + e3) + ((kd * ln2Lo + logcLo) + (rl - he))) + poly;
+	T hi;
+	fastTwoSum(s3, lo, hi, tail);
+	// positive, normalized, and finite
+	return ((((ix >> 52) - 1) & 0xfff) < 0x7fe) ? hi : splat<T>(NAN);
+}
+
+template <class T> INLINE T logPack(T const& x)
+{
+	T tail;
+	return logTail(x, tail);
+}
+
+
+////////////////////////////////////////////////////////////
+// pow
+//
+// pow(x, y) = exp(y log|x|), with y log|x| in double-double precision.
+//
+
+template <class T> INLINE T powPack(T const& x, T const& y)
+{
+	T tail;
+	T lh = logTail(fabsPack(x), tail);
+	T zh, ze;
+	twoProduct(y, lh, zh, ze);
+	ze = ze + y * tail;
+	T z, zl;
+	fastTwoSum(zh, ze, z, zl);
+	T ret = expTail(z, zl);
+
+	// negative bases are restricted to integral exponents, the sign is
+	// negative for odd exponents; the parity of round(y) is the lowest
+	// bit of y + shifter
+	typedef typename Pack<T>::Int Int;
+	Int neg = asInt(x) >> 63;
+	Int odd = -(asInt(y + shifter) & 1);
+	ret = asDouble<T>(asInt(ret) ^ (odd & neg & ~0x7fffffffffffffffLL));
+	T frac = (fabsPack(y) < 2251799813685248.0) ? y - roundInt(y) : splat<T>(NAN);
+	Int bad = asInt(frac) & neg & 0x7fffffffffffffffLL;
+	ret = (bad == 0) ? ret : splat<T>(NAN);
+
+	// squares are computed exactly rounded, see vecmath.h
+	return (y == 2.0) ? x * x : ret;
+}
+
+
+////////////////////////////////////////////////////////////
+// array drivers
+//
+// The approximations return NaN for arguments they do not cover; these
+// are recomputed by the C library.
+//
+
+struct Sin
+{
+	template <class T> static INLINE T eval(T const& x) { return sinCos<T, false>(x); }
+	static double library(double x) { return std::sin(x); }
+};
+
+struct Cos
+{
+	template <class T> static INLINE T eval(T const& x) { return sinCos<T, true>(x); }
+	static double library(double x) { return std::cos(x); }
+};
+
+struct Exp
+{
+	template <class T> static INLINE T eval(T const& x) { return expPack(x); }
+	static double library(double x) { return std::exp(x); }
+};
+
+struct Log
+{
+	template <class T> static INLINE T eval(T const& x) { return logPack(x); }
+	static double library(double x) { return std::log(x); }
+};
+
+struct Pow
+{
+	template <class T> static INLINE T eval(T const& x, T const& y) { return powPack(x, y); }
+	static double library(double x, double y) { return std::pow(x, y); }
+};
+
+template <class OP> INLINE double single(double x)
+{
+	double ret = OP::eval(x);
+	return (ret == ret) ? ret : OP::library(x);
+}
+
+template <class OP> INLINE double single(double x, double y)
+{
+	double ret = OP::eval(x, y);
+	return (ret == ret) ? ret : OP::library(x, y);
+}
+
+template <class T, class OP> INLINE void unary(double* dst, const double* a, size_t n)
+{
+	const size_t L = Pack<T>::lanes;
+	size_t i = 0;
+	for (; i+L<=n; i+=L)
+	{
+		T x;
+		memcpy(&x, a + i, sizeof(x));
+		double in[L];
+		memcpy(in, &x, sizeof(in));
+		T y = OP::eval(x);
+		memcpy(dst + i, &y, sizeof(y));
+		for (size_t l=0; l<L; l++) if (dst[i + l] != dst[i + l]) dst[i + l] = OP::library(in[l]);
+	}
+	for (; i<n; i++) dst[i] = single<OP>(a[i]);
+}
+
+// stride 0 broadcasts b[0]
+template <class T, class OP> INLINE void binary(double* dst, const double* a, const double* b, size_t stride, size_t n)
+{
+	const size_t L = Pack<T>::lanes;
+	size_t i = 0;
+	for (; i+L<=n; i+=L)
+	{
+		T x, y;
+		memcpy(&x, a + i, sizeof(x));
+		if (stride) memcpy(&y, b + i, sizeof(y));
+		else y = splat<T>(b[0]);
+		double in1[L], in2[L];
+		memcpy(in1, &x, sizeof(in1));
+		memcpy(in2, &y, sizeof(in2));
+		T z = OP::eval(x, y);
+		memcpy(dst + i, &z, sizeof(z));
+		for (size_t l=0; l<L; l++) if (dst[i + l] != dst[i + l]) dst[i + l] = OP::library(in1[l], in2[l]);
+	}
+	for (; i<n; i++) dst[i] = single<OP>(a[i], b[i * stride]);
+}
+
+#ifdef VECMATH_X86
+#define AVX2 __attribute__((target("avx2")))
+#define AVX512 __attribute__((target("avx512f,avx512dq")))
+#endif
+
+template <class OP>
+struct Unary
+{
+	static void scalar(double* dst, const double* a, size_t n)
+	{ unary<double, OP>(dst, a, n); }
+#ifdef VECMATH_X86
+	static AVX2 void avx2(double* dst, const double* a, size_t n)
+	{ unary<Double4, OP>(dst, a, n); }
+	static AVX512 void avx512(double* dst, const double* a, size_t n)
+	{ unary<Double8, OP>(dst, a, n); }
+#endif
+
+	static void run(double* dst, const double* a, size_t n)
+	{
+		if (g_math == LibraryMath)
+		{
+			for (size_t i=0; i<n; i++) dst[i] = OP::library(a[i]);
+			return;
+		}
+#ifdef VECMATH_X86
+		InstructionSet set = instructionSet();
+		if (set == AVX512Instructions) return avx512(dst, a, n);
+		if (set == AVX2Instructions) return avx2(dst, a, n);
+#endif
+		scalar(dst, a, n);
+	}
+};
+
+template <class OP>
+struct Binary
+{
+	static void scalar(double* dst, const double* a, const double* b, size_t stride, size_t n)
+	{ binary<double, OP>(dst, a, b, stride, n); }
+#ifdef VECMATH_X86
+	static AVX2 void avx2(double* dst, const double* a, const double* b, size_t stride, size_t n)
+	{ binary<Double4, OP>(dst, a, b, stride, n); }
+	static AVX512 void avx512(double* dst, const double* a, const double* b, size_t stride, size_t n)
+	{ binary<Double8, OP>(dst, a, b, stride, n); }
+#endif
+
+	static void run(double* dst, const double* a, const double* b, size_t stride, size_t n)
+	{
+		if (g_math == LibraryMath)
+		{
+			for (size_t i=0; i<n; i++) dst[i] = OP::library(a[i], b[i * stride]);
+			return;
+		}
+#ifdef VECMATH_X86
+		InstructionSet set = instructionSet();
+		if (set == AVX512Instructions) return avx512(dst, a, b, stride, n);
+		if (set == AVX2Instructions) return avx2(dst, a, b, stride, n);
+#endif
+		scalar(dst, a, b, stride, n);
+	}
+};
+
+
+}
+
+
+MathMode mathMode()
+{ return g_math; }
+
+void setMathMode(MathMode mode)
+{ g_math = mode; }
+
+
+////////////////////////////////////////////////////////////
+// single values
+//
+
+double mathSin(double x)
+{ return (g_math == LibraryMath) ? std::sin(x) : single<Sin>(x); }
+
+double mathCos(double x)
+{ return (g_math == LibraryMath) ? std::cos(x) : single<Cos>(x); }
+
+double mathExp(double x)
+{ return (g_math == LibraryMath) ? std::exp(x) : single<Exp>(x); }
+
+double mathLog(double x)
+{ return (g_math == LibraryMath) ? std::log(x) : single<Log>(x); }
+
+double mathPow(double x, double y)
+{ return (g_math == LibraryMath) ? std::pow(x, y) : single<Pow>(x, y); }
+
+
+////////////////////////////////////////////////////////////
+// arrays
+//
+
+void kernelSin(double* dst, const double* a, size_t n)
+{ Unary<Sin>::run(dst, a, n); }
+
+void kernelCos(double* dst, const double* a, size_t n)
+{ Unary<Cos>::run(dst, a, n); }
+
+void kernelExp(double* dst, const double* a, size_t n)
+{ Unary<Exp>::run(dst, a, n); }
+
+void kernelLog(double* dst, const double* a, size_t n)
+{ Unary<Log>::run(dst, a, n); }
+
+void kernelPow(double* dst, const double* a, const double* b, size_t n)
+{ Binary<Pow>::run(dst, a, b, 1, n); }
+
+void kernelPow(double* dst, const double* a, double b, size_t n)
+{ Binary<Pow>::run(dst, a, &b, 0, n); }
+
+void kernelFunction(double (*f)(double), double* dst, const double* a, size_t n)
+{
+	if (f == mathSin) kernelSin(dst, a, n);
+	else if (f == mathCos) kernelCos(dst, a, n);
+	else if (f == mathExp) kernelExp(dst, a, n);
+	else if (f == mathLog) kernelLog(dst, a, n);
+	else for (size_t i=0; i<n; i++) dst[i] = f(a[i]);
+}
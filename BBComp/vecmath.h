@@ -0,0 +1,72 @@
+
+#pragma once
+
+
+//
+// Elementary Functions over Arrays
+// --------------------------------
+//
+// The functions sin, cos, exp, log, and pow of the expression language
+// are routed through this module, both for single values and for whole
+// arrays (apply statements and element-wise powers).
+//
+// In LibraryMath mode (the default) the C math library is called for
+// every value. Results are identical to earlier versions of the library.
+//
+// In VectorizedMath mode the functions are evaluated by polynomial
+// approximations that process four (AVX2) or eight (AVX-512) values at
+// a time. The single-value versions perform the same operations, hence
+// results do not depend on the instruction set nor on whether a value
+// is processed alone or as part of an array. Arguments outside of the
+// ranges below (and non-finite arguments) are passed to the C library.
+//
+// ULP budget of VectorizedMath mode, measured as the deviation from the
+// exact result in units in the last place:
+//     sin(x), cos(x)     |x| < 1e6              at most 1.5 ulp
+//     exp(x)             |x| <= 708.39          at most 1 ulp
+//     log(x)             normalized x > 0       at most 1 ulp
+//     pow(x, y)          x > 0, or x < 0 with integral y,
+//                        |y log|x|| <= 708.39,
+//                        |y| < 2^51             at most 1 ulp
+// pow(x, 2) is computed as x * x, which is correctly rounded, hence the
+// expression compiler may replace squares by multiplications in this
+// mode (but not in LibraryMath mode, where pow(x, 2) and x * x differ
+// in rare cases). The C library is accurate to within 1 ulp, hence
+// results of the two modes differ by at most 2.5 ulp (2 ulp for exp,
+// log, and pow). Since the benchmark functions are in general not
+// Lipschitz with small constants, function values can differ by more
+// than that.
+//
+
+
+#include <cstddef>
+
+
+enum MathMode
+{
+	LibraryMath,
+	VectorizedMath,
+};
+
+// The math mode applies to all threads. It should be set before problems
+// are loaded, since constant sub-expressions are evaluated by the parser.
+MathMode mathMode();
+void setMathMode(MathMode mode);
+
+// single values
+double mathSin(double x);
+double mathCos(double x);
+double mathExp(double x);
+double mathLog(double x);
+double mathPow(double x, double y);
+
+// arrays, the destination may coincide with an argument
+void kernelSin(double* dst, const double* a, std::size_t n);
+void kernelCos(double* dst, const double* a, std::size_t n);
+void kernelExp(double* dst, const double* a, std::size_t n);
+void kernelLog(double* dst, const double* a, std::size_t n);
+void kernelPow(double* dst, const double* a, const double* b, std::size_t n);
+void kernelPow(double* dst, const double* a, double b, std::size_t n);
+
+// dst[i] = f(a[i]), using the array versions above where applicable
+void kernelFunction(double (*f)(double), double* dst, const double* a, std::size_t n);
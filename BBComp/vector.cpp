@@ -1,9 +1,12 @@
 
 #include "vector.h"
+#include "kernels.h"
+#include "vecmath.h"
 #include <cstring>
 #include <cstdlib>
 #include <stdexcept>
 #include <cmath>
+#include <new>
 
 
 // check index ranges and dimension only in debug mode
@@ -15,59 +18,171 @@
 using namespace std;
 
 
+////////////////////////////////////////////////////////////
+// per-thread arena for temporary vectors
+//
+
+namespace {
+
+struct Arena
+{
+	Arena()
+	: block(0)
+	, offset(0)
+	, depth(0)
+	{ }
+
+	~Arena()
+	{
+		for (size_t i=0; i<blocks.size(); i++) free(blocks[i].first);
+	}
+
+	double* allocate(size_t n)
+	{
+		// continue in the current or a later block
+		for (; block < blocks.size(); block++, offset = 0)
+		{
+			if (offset + n <= blocks[block].second)
+			{
+				double* p = blocks[block].first + offset;
+				offset += n;
+				return p;
+			}
+		}
+
+		// grow
+		size_t capacity = blocks.empty() ? 4096 : 2 * blocks.back().second;
+		if (capacity < n) capacity = n;
+		double* p = (double*)malloc(sizeof(double) * capacity);
+		if (! p) throw bad_alloc();
+		blocks.push_back(make_pair(p, capacity));
+		block = blocks.size() - 1;
+		offset = n;
+		return p;
+	}
+
+	vector< pair<double*, size_t> > blocks;     // memory and capacity, kept across scopes
+	size_t block;                               // current block
+	size_t offset;                              // first free entry in the current block
+	unsigned int depth;                         // number of active scopes
+};
+
+thread_local Arena t_arena;
+
+}
+
+ArenaScope::ArenaScope()
+: m_block(t_arena.block)
+, m_offset(t_arena.offset)
+{
+	t_arena.depth++;
+}
+
+ArenaScope::~ArenaScope()
+{
+	t_arena.depth--;
+	t_arena.block = m_block;
+	t_arena.offset = m_offset;
+}
+
+bool Vector::useArena(size_t dim)
+{
+	return (dim > inlineCapacity && t_arena.depth > 0);
+}
+
+double* Vector::storage(size_t dim)
+{
+	if (dim <= inlineCapacity) return m_local;
+	if (m_arena) return t_arena.allocate(dim);
+	return (double*)malloc(sizeof(double) * dim);
+}
+
+
+////////////////////////////////////////////////////////////
+// vector
+//
+
 Vector::Vector()
 : m_size(0)
+, m_arena(false)
 , m_data(nullptr)
 , m_view(false)
 { }
 
 Vector::Vector(size_t dim)
 : m_size(dim)
-, m_data((double*)malloc(sizeof(double) * dim))
+, m_arena(useArena(dim))
+, m_data(storage(dim))
 , m_view(false)
 { }
 
 Vector::Vector(double scalar)
 : m_size(1)
-, m_data((double*)malloc(sizeof(double)))
+, m_arena(false)
+, m_data(m_local)
 , m_view(false)
 { m_data[0] = scalar; }
 
 Vector::Vector(size_t dim, double value)
 : m_size(dim)
-, m_data((double*)malloc(sizeof(double) * dim))
+, m_arena(useArena(dim))
+, m_data(storage(dim))
 , m_view(false)
 { for (size_t i=0; i<dim; i++) m_data[i] = value; }
 
 Vector::Vector(std::size_t dim, const double* data)
 : m_size(dim)
-, m_data((double*)malloc(sizeof(double) * dim))
+, m_arena(useArena(dim))
+, m_data(storage(dim))
 , m_view(false)
 { for (size_t i=0; i<dim; i++) m_data[i] = data[i]; }
 
 Vector::Vector(std::vector<double> const& other)
 : m_size(other.size())
-, m_data((double*)malloc(sizeof(double) * other.size()))
+, m_arena(useArena(other.size()))
+, m_data(storage(other.size()))
 , m_view(false)
 { for (size_t i=0; i<other.size(); i++) m_data[i] = other[i]; }
 
 Vector::Vector(double* data, std::size_t dim)
 : m_size(dim)
+, m_arena(false)
 , m_data(data)
 , m_view(true)
 { }
 
 Vector::Vector(Vector const& other)
 : m_size(other.size())
-, m_data(other.isView() ? const_cast<double*>(other.data()) : (double*)malloc(sizeof(double) * other.size()))
+, m_arena(! other.isView() && useArena(other.size()))
+, m_data(other.isView() ? const_cast<double*>(other.data()) : storage(other.size()))
 , m_view(other.isView())
 {
 	if (! other.isView()) memmove(m_data, other.data(), sizeof(double) * m_size);
 }
 
+Vector::Vector(Vector&& other) noexcept
+: m_size(other.m_size)
+, m_arena(other.m_arena)
+, m_data(other.m_data)
+, m_view(other.m_view)
+{
+	if (other.isExternal())
+	{
+		other.m_size = 0;
+		other.m_arena = false;
+		other.m_data = nullptr;
+	}
+	else if (! m_view && other.m_data == other.m_local)
+	{
+		m_data = m_local;
+		memcpy(m_local, other.m_local, sizeof(double) * m_size);
+	}
+}
+
 Vector::Vector(std::initializer_list<double> l)
 : m_size(l.size())
-, m_data((double*)malloc(sizeof(double) * l.size()))
+, m_arena(useArena(l.size()))
+, m_data(storage(l.size()))
 , m_view(false)
 {
 	std::size_t i=0;
@@ -76,7 +191,7 @@ Vector::Vector(std::initializer_list<double> l)
 
 Vector::~Vector()
 {
-	if (! m_view && m_data) free(m_data);
+	if (isHeap()) free(m_data);
 }
 
 
@@ -89,21 +204,44 @@ Vector& Vector::operator = (Vector const& rhs)
 #endif
 		memmove(m_data, rhs.data(), sizeof(double) * m_size);
 	}
-	else
+	else if (this != &rhs)
+	{
+		// allocate before releasing, rhs may be a view on this vector
+		if (! (isExternal() && m_size == rhs.size()))
+		{
+			double* old = isHeap() ? m_data : nullptr;
+			m_arena = useArena(rhs.size());
+			double* data = storage(rhs.size());
+			memmove(data, rhs.m_data, sizeof(double) * rhs.size());
+			if (old) free(old);
+			m_data = data;
+			m_size = rhs.size();
+		}
+		else memmove(m_data, rhs.m_data, sizeof(double) * m_size);
+	}
+	return *this;
+}
+
+Vector& Vector::operator = (Vector&& rhs)
+{
+	// only external storage of an owner can be taken over
+	if (m_view || ! rhs.isExternal()) return operator = (static_cast<Vector const&>(rhs));
+	if (this != &rhs)
 	{
-		free(m_data);
-		m_size = rhs.size();
-		m_data = (double*)malloc(sizeof(double) * m_size);
-		memmove(m_data, rhs.m_data, sizeof(double) * m_size);
+		if (isHeap()) free(m_data);
+		m_size = rhs.m_size;
+		m_arena = rhs.m_arena;
+		m_data = rhs.m_data;
+		rhs.m_size = 0;
+		rhs.m_arena = false;
+		rhs.m_data = nullptr;
 	}
 	return *this;
 }
 
 Vector Vector::copy() const
 {
-	Vector ret(m_size, 0.0);
-	for (size_t i=0; i<m_size; i++) ret[i] = (*this)[i];
-	return ret;
+	return Vector(m_size, m_data);
 }
 
 double& Vector::operator [] (size_t index)
@@ -149,7 +287,7 @@ void Vector::operator += (Vector const& arg)
 #ifdef CHECKRANGE
 	if (arg.size() != m_size) throw runtime_error("dimension mismatch");
 #endif
-	for (size_t i=0; i<m_size; i++) m_data[i] += arg.m_data[i];
+	kernelAdd(m_data, m_data, arg.m_data, m_size);
 }
 
 void Vector::operator -= (Vector const& arg)
@@ -157,17 +295,17 @@ void Vector::operator -= (Vector const& arg)
 #ifdef CHECKRANGE
 	if (arg.size() != m_size) throw runtime_error("dimension mismatch");
 #endif
-	for (size_t i=0; i<m_size; i++) m_data[i] -= arg.m_data[i];
+	kernelSub(m_data, m_data, arg.m_data, m_size);
 }
 
 void Vector::operator *= (double arg)
 {
-	for (size_t i=0; i<m_size; i++) m_data[i] *= arg;
+	kernelScale(m_data, m_data, arg, m_size);
 }
 
 void Vector::operator /= (double arg)
 {
-	for (size_t i=0; i<m_size; i++) m_data[i] /= arg;
+	kernelDivide(m_data, m_data, arg, m_size);
 }
 
 Vector Vector::permute(std::vector<unsigned int> const& permutation) const
@@ -183,7 +321,7 @@ Vector Vector::permute(std::vector<unsigned int> const& permutation) const
 Vector Vector::operator - () const
 {
 	Vector ret(m_size);
-	for (size_t i=0; i<m_size; i++) ret.m_data[i] = -m_data[i];
+	kernelNeg(ret.m_data, m_data, m_size);
 	return ret;
 }
 
@@ -213,9 +351,7 @@ double Vector::operator * (Vector const& rhs) const
 #ifdef CHECKRANGE
 	if (rhs.size() != m_size) throw runtime_error("dimension mismatch");
 #endif
-	double ret = 0.0;
-	for (size_t i=0; i<m_size; i++) ret += m_data[i] * rhs.m_data[i];
-	return ret;
+	return kernelDot(m_data, rhs.m_data, m_size);
 }
 
 Vector Vector::operator / (double rhs) const
@@ -231,7 +367,7 @@ Vector Vector::elemProduct(Vector const& rhs) const
 	if (rhs.size() != m_size) throw runtime_error("dimension mismatch");
 #endif
 	Vector ret(m_size);
-	for (size_t i=0; i<m_size; i++) ret.m_data[i] = m_data[i] * rhs.m_data[i];
+	kernelMul(ret.m_data, m_data, rhs.m_data, m_size);
 	return ret;
 }
 
@@ -241,14 +377,14 @@ Vector Vector::elemQuotient(Vector const& rhs) const
 	if (rhs.size() != m_size) throw runtime_error("dimension mismatch");
 #endif
 	Vector ret(m_size);
-	for (size_t i=0; i<m_size; i++) ret.m_data[i] = m_data[i] / rhs.m_data[i];
+	kernelDiv(ret.m_data, m_data, rhs.m_data, m_size);
 	return ret;
 }
 
 Vector Vector::elemPower(double const& rhs) const
 {
 	Vector ret(m_size);
-	for (size_t i=0; i<m_size; i++) ret.m_data[i] = std::pow(m_data[i], rhs);
+	kernelPow(ret.m_data, m_data, rhs, m_size);
 	return ret;
 }
 
@@ -258,7 +394,7 @@ Vector Vector::elemPower(Vector const& rhs) const
 	if (rhs.size() != m_size) throw runtime_error("dimension mismatch");
 #endif
 	Vector ret(m_size);
-	for (size_t i=0; i<m_size; i++) ret.m_data[i] = std::pow(m_data[i], rhs.m_data[i]);
+	kernelPow(ret.m_data, m_data, rhs.m_data, m_size);
 	return ret;
 }
 
@@ -298,7 +434,7 @@ double Vector::twonorm() const
 { return sqrt(twonorm2()); }
 
 double Vector::twonorm2() const
-{ return (*this) * (*this); }
+{ return kernelSqrNorm(m_data, m_size); }
 
 Vector operator * (double lhs, Vector const& rhs)
 { return rhs * lhs; }
@@ -8,7 +8,30 @@
 #include <cstdlib>
 
 
+// Scope for temporary vectors. While a scope is alive, owning vectors
+// created in the current thread and too large for inline storage take
+// their memory from a per-thread arena instead of the heap. Leaving the
+// scope releases all of them at once. Hence vectors created (or
+// assigned) within a scope must not outlive it. Scopes can be nested.
+class ArenaScope
+{
+public:
+	ArenaScope();
+	~ArenaScope();
+
+private:
+	ArenaScope(ArenaScope const&) = delete;
+	ArenaScope& operator = (ArenaScope const&) = delete;
+
+	std::size_t m_block;
+	std::size_t m_offset;
+};
+
+
 // Numerical vector type with either memory owner or view semantics.
+// Owners of up to #inlineCapacity components store them inline,
+// without heap allocation. Moving an owner with inline storage
+// copies its components, hence views on it refer to the original.
 class Vector
 {
 public:
@@ -21,11 +44,13 @@ public:
 	Vector(std::vector<double> const& other);   // copy of standard vector (not a view!)
 	Vector(double* data, std::size_t dim);      // view on the given data, e.g., for sub-vectors
 	Vector(Vector const& other);                // copy constructor (sloppy, drops const-ness of views)
+	Vector(Vector&& other) noexcept;            // move constructor, views remain views
 	Vector(std::initializer_list<double> l);    // initializer list constructor
 	~Vector();
 
 	// assignment
 	Vector& operator = (Vector const& rhs);
+	Vector& operator = (Vector&& rhs);
 	void operator = (double value)
 	{ for (std::size_t i=0; i<m_size; i++) m_data[i] = value; }
 	void concat(double arg);
@@ -99,10 +124,22 @@ public:
 	double twonorm() const;
 	double twonorm2() const;
 
+	static const std::size_t inlineCapacity = 8;
+
 private:
+	// storage for an owner of given dimension, from the arena if m_arena is set
+	static bool useArena(std::size_t dim);
+	double* storage(std::size_t dim);
+	bool isExternal() const
+	{ return (! m_view && m_data != m_local && m_data != nullptr); }
+	bool isHeap() const
+	{ return (isExternal() && ! m_arena); }
+
 	std::size_t m_size;
+	bool m_arena;                               // memory is owned by the arena
 	double* m_data;
 	bool m_view;
+	double m_local[inlineCapacity];
 };
 
 Vector operator * (double lhs, Vector const& rhs);